@@ -42,6 +42,41 @@
 # include "DataSpy.hh"
 #endif
 
+// DataSpy streams
+#ifndef __SPYSTREAMS_HH
+# include "SpyStreams.hh"
+#endif
+
+// DataSpy producer for the replay
+#ifndef __DATASPYPRODUCER_HH
+# include "DataSpyProducer.hh"
+#endif
+
+// Run file follower for the monitor
+#ifndef __TAILREADER_HH
+# include "TailReader.hh"
+#endif
+
+// Online pipeline header
+#ifndef __ONLINEPIPELINE_HH
+# include "OnlinePipeline.hh"
+#endif
+
+// Rolling spectra
+#ifndef __ROLLINGSPECTRA_HH
+# include "RollingSpectra.hh"
+#endif
+
+// Snapshots for the web server
+#ifndef __HISTSNAPSHOT_HH
+# include "HistSnapshot.hh"
+#endif
+
+// Live metrics
+#ifndef __METRICS_HH
+# include "Metrics.hh"
+#endif
+
 // GreatGUI header
 #ifndef __GREATGUI_HH
 # include "GreatGUI.hh"
@@ -68,6 +103,10 @@ std::vector<std::string> input_names;
 bool flag_convert = false;
 bool flag_events = false;
 bool flag_source = false;
+bool flag_chain = false;
+
+// List of event files for the histogrammer when building across files
+std::vector<std::string> events_names;
 
 // select what steps of the analysis to be forced
 std::vector<bool> force_convert;
@@ -88,6 +127,24 @@ int open_spy_data = -1;
 bool flag_monitor = false;
 int mon_time = -1; // update time in seconds
 
+// Online pipeline for the DataSpy, every step on its own thread
+bool flag_pipeline = false;
+
+// Replay of a file in to the DataSpy shared memory
+std::string name_replay_file;
+double replay_rate = 0; // blocks per second
+double replay_speed = 0; // multiple of real time
+
+// Threads for the histogrammer
+int n_threads = 1;
+
+// Histogram cache for each events file
+bool flag_nocache = false;
+
+// User histogram definitions
+std::string name_hist_def_file;
+std::shared_ptr<GreatUserHists> myuserhists;
+
 // Settings file
 std::shared_ptr<GreatSettings> myset;
 
@@ -116,17 +173,143 @@ std::shared_ptr<GreatConverter> conv_mon;
 std::shared_ptr<GreatEventBuilder> eb_mon;
 std::shared_ptr<GreatHistogrammer> hist_mon;
 
+// Views of the monitor spectra over the last few minutes
+std::shared_ptr<GreatRollingSpectra> roll_conv;
+std::shared_ptr<GreatRollingSpectra> roll_hist;
 
+// Copies of the monitor histograms shown by the web server
+std::shared_ptr<GreatHistSnapshot> snap_conv;
+std::shared_ptr<GreatHistSnapshot> snap_evnt;
+std::shared_ptr<GreatHistSnapshot> snap_hist;
+
+// Throughput and latency of the monitor, also as a text page in metrics_dir
+std::shared_ptr<GreatMetrics> metrics_mon;
+std::shared_ptr<GreatHistSnapshot> snap_metrics;
+std::string metrics_dir;
+
+
+// With snapshots, the resets are done by the thread filling the histograms
 void reset_conv_hists(){
-	conv_mon->ResetHists();
+	if( snap_conv ) snap_conv->RequestReset();
+	else {
+		conv_mon->ResetHists();
+		if( roll_conv ) roll_conv->RequestReset();
+	}
 }
 
 void reset_evnt_hists(){
-	eb_mon->ResetHists();
+	if( snap_evnt ) snap_evnt->RequestReset();
+	else eb_mon->ResetHists();
 }
 
 void reset_phys_hists(){
-	hist_mon->ResetHists();
+	if( snap_hist ) snap_hist->RequestReset();
+	else {
+		hist_mon->ResetHists();
+		if( roll_hist ) roll_hist->RequestReset();
+	}
+}
+
+// Histograms of all steps, in the same folders as in the monitor files
+void make_snapshots( std::shared_ptr<GreatSettings> myset ){
+
+	double period = myset->GetHttpSnapshotPeriod();
+
+	snap_conv = std::make_shared<GreatHistSnapshot>( serv, period );
+	snap_conv->Add( &conv_mon->GetHistogramSet(), "/Singles" );
+
+	if( flag_source ) return;
+
+	snap_evnt = std::make_shared<GreatHistSnapshot>( serv, period );
+	snap_evnt->Add( &eb_mon->GetHistogramSet(), "/Events" );
+
+	snap_hist = std::make_shared<GreatHistSnapshot>( serv, period );
+	snap_hist->Add( &hist_mon->GetHistogramSet(), "/Physics" );
+
+}
+
+// Metrics of all steps, sampled by the monitor thread
+void make_metrics( std::shared_ptr<GreatSettings> myset ){
+
+	metrics_mon = std::make_shared<GreatMetrics>( myset );
+	metrics_mon->SetConverter( conv_mon );
+
+	GreatHistogramSet &hs = metrics_mon->GetHistogramSet();
+	if( myset->GetHttpSnapshotPeriod() > 0 ) {
+		snap_metrics = std::make_shared<GreatHistSnapshot>( serv, 0 );
+		snap_metrics->Add( &hs, "/Metrics" );
+	}
+	else {
+		for( unsigned int i = 0; i < hs.GetSize(); ++i )
+			serv->Register( ( "/Metrics/" + hs.GetDirName(i) ).data(), hs.GetHist(i) );
+	}
+
+}
+
+// New values in the Metrics folder and the text page
+void sample_metrics(){
+
+	metrics_mon->Sample();
+	metrics_mon->WriteText( metrics_dir + "/metrics.txt" );
+	if( snap_metrics ) snap_metrics->Publish( true );
+
+}
+
+// Shows the rolling views, through the snapshots if there are any
+void show_rolling( std::shared_ptr<GreatRollingSpectra> roll,
+				   std::shared_ptr<GreatHistSnapshot> snap, std::string folder ){
+
+	if( !snap ) {
+		roll->Register( serv, folder );
+		return;
+	}
+
+	for( unsigned int i = 0; i < roll->GetNumberOfSpectra(); ++i )
+		for( unsigned int w = 0; w < roll->GetNumberOfWindows(); ++w )
+			snap->Add( roll->GetView( i, w ), folder + "/" + roll->GetWindowLabel(w) );
+
+}
+
+// Writes what the monitor has so far to its files
+void snapshot_monitor(){
+
+	conv_mon->GetHistogramSet().WriteCompact();
+	conv_mon->GetFile()->Write( 0, TObject::kWriteDelete );
+	conv_mon->PurgeOutput();
+
+	if( flag_source ) return;
+
+	eb_mon->WriteHists();
+	eb_mon->GetFile()->Write( 0, TObject::kWriteDelete );
+	eb_mon->PurgeOutput();
+
+	hist_mon->GetHistogramSet().WriteCompact();
+	hist_mon->GetFile()->Write( 0, TObject::kWriteDelete );
+	hist_mon->PurgeOutput();
+
+}
+
+// Calibrated singles spectra of every CAEN channel
+void make_rolling_conv( std::shared_ptr<GreatSettings> myset ){
+
+	roll_conv = std::make_shared<GreatRollingSpectra>( myset->GetRollingSliceTime(),
+													   myset->GetRollingWindows() );
+	for( unsigned int i = 0; i < myset->GetNumberOfCAENModules(); ++i )
+		for( unsigned int j = 0; j < myset->GetNumberOfCAENChannels(); ++j )
+			roll_conv->Add( conv_mon->GetCalSpectrum( i, j ) );
+	show_rolling( roll_conv, snap_conv, "/Rolling/Singles" );
+
+}
+
+// One-dimensional physics histograms, once the histogrammer has made them
+void make_rolling_hist( std::shared_ptr<GreatSettings> myset ){
+
+	roll_hist = std::make_shared<GreatRollingSpectra>( myset->GetRollingSliceTime(),
+													   myset->GetRollingWindows() );
+	for( unsigned int i = 0; i < hist_mon->GetHistogramSet().GetSize(); ++i )
+		roll_hist->Add( hist_mon->GetHistogramSet().GetHist(i) );
+	show_rolling( roll_hist, snap_hist, "/Rolling/Physics" );
+
 }
 
 void stop_monitor(){
@@ -137,6 +320,34 @@ void start_monitor(){
 	bRunMon = kTRUE;
 }
 
+// The monitor finishes its files and the program exits
+void end_monitor(){
+	bEndMon = true;
+}
+
+// Only a lock-free atomic may be written in a signal handler
+void end_monitor_signal( int ){
+	bEndMon = true;
+}
+
+// Writes and closes the monitor files at the end
+// The events file is only there for the histograms when the events stay in memory
+void close_monitor( TFile *events_file ){
+
+	conv_mon->CloseOutput();
+	if( flag_source ) return;
+
+	if( events_file ) {
+		eb_mon->WriteHists();
+		events_file->Write( 0, TObject::kWriteDelete );
+		events_file->Close();
+	}
+	else eb_mon->CloseOutput();
+
+	hist_mon->CloseOutput();
+
+}
+
 // Function to call the monitoring loop
 void* monitor_run( void* ptr ){
 	
@@ -153,33 +364,41 @@ void* monitor_run( void* ptr ){
 	conv_mon = std::make_shared<GreatConverter>( calfiles->myset );
 	eb_mon = std::make_shared<GreatEventBuilder>( calfiles->myset );
 	hist_mon = std::make_shared<GreatHistogrammer>( calfiles->myreact, calfiles->myset );
+	hist_mon->SetUserHists( myuserhists );
 	
-	// Data blocks for Data spy
-	if( flag_spy && myset->GetBlockSize() != 0x10000 ) {
+	// Data blocks for Data spy and for following the run file
+	if( myset->GetBlockSize() != 0x10000 ) {
 	
 		// only 64 kB supported atm
 		std::cerr << "Currently only supporting 64 kB block size" << std::endl;
 		exit(1);
 	
 	}
-	DataSpy myspy;
-	long long buffer[8*1024];
-	int file_id = 0; ///> TapeServer volume = /dev/file/<id> ... <id> = 0 on issdaqpc2
-	if( flag_spy ) myspy.Open( file_id ); /// open the data spy
-	int spy_length = 0;
+	// TapeServer volume = /dev/file/<id> ... <id> = 0 on issdaqpc2, one per stream
+	GreatSpyStreams myspy( calfiles->myset );
+	if( flag_spy ) myspy.Start(); /// open the data spy and start reading
+	unsigned long long spy_lost = 0;
+	unsigned long long spy_bytes = 0;
 
 	// Data/Event counters
-	int start_block = 0;
 	int nblocks = 0;
 	unsigned long nbuild = 0;
 
 	// Converter setup
 	if( !flag_spy ) curFileMon = input_names.at(0); // maybe change in GUI later?
+	GreatTailReader mytail( curFileMon, calfiles->myset->GetBlockSize() );
+	double tail_interval = calfiles->myset->GetTailFollowInterval();
 	if( flag_source ) conv_mon->SourceOnly();
 	conv_mon->AddCalibration( calfiles->mycal );
 	conv_mon->SetOutput( "monitor_singles.root" );
+	conv_mon->SetOnline( flag_spy );
 	conv_mon->MakeTree();
 	conv_mon->MakeHists();
+	if( calfiles->myset->GetHttpSnapshotPeriod() > 0 ) make_snapshots( calfiles->myset );
+	make_metrics( calfiles->myset );
+	if( flag_spy ) metrics_mon->SetSpyStreams( &myspy );
+	bool flag_rolling = calfiles->myset->IsRollingSpectra();
+	if( flag_rolling ) make_rolling_conv( calfiles->myset );
 	
 	// Update server settings
 	// title of web page
@@ -190,67 +409,186 @@ void* monitor_run( void* ptr ){
 	toptitle += " (" + std::to_string( mon_time ) + " s)";
 	serv->SetItemField("/", "_toptitle", toptitle.data() );
 
-	// While the sort is running
-	while( true ) {
+	// Online pipeline, the data go through all steps as they arrive
+	if( flag_pipeline && calfiles->myset->IsTriggerMode() ) {
+
+		std::cout << "The online pipeline builds events in time windows only, ";
+		std::cout << "running the monitor loop for the EventTrigger instead" << std::endl;
+		flag_pipeline = false;
+
+	}
+
+	// Without a tolerance, every hit that comes late in another stream is lost
+	if( flag_pipeline && calfiles->myset->GetReorderTolerance() <= 0 ) {
+
+		std::cout << "The online pipeline needs ReorderTolerance above 0, ";
+		std::cout << "running the monitor loop instead" << std::endl;
+		flag_pipeline = false;
+
+	}
+
+	// The stages own their histograms, so the web server and the resets go through the snapshots
+	if( flag_pipeline && !snap_conv ) {
+
+		std::cout << "The online pipeline needs HttpSnapshotPeriod above 0, ";
+		std::cout << "running the monitor loop instead" << std::endl;
+		flag_pipeline = false;
+
+	}
+
+	// Only for the histograms of the event builder, when the events are not kept in a tree
+	std::unique_ptr<TFile> events_file;
+
+	if( flag_pipeline ) {
+
+		// Events are only histogrammed, not kept in a tree
+		events_file.reset( new TFile( "monitor_events.root", "recreate" ) );
+		eb_mon->SetOutputDirectory( events_file.get(), false );
+		hist_mon->SetOutput( "monitor_hists.root" );
+
+		GreatOnlinePipeline mypipe( calfiles->myset, conv_mon, eb_mon, hist_mon, &myspy );
+		if( flag_rolling ) {
+			make_rolling_hist( calfiles->myset );
+			mypipe.SetRolling( GreatOnlinePipeline::kDecode, roll_conv.get() );
+			mypipe.SetRolling( GreatOnlinePipeline::kHist, roll_hist.get() );
+		}
+		mypipe.SetSnapshot( GreatOnlinePipeline::kDecode, snap_conv.get() );
+		mypipe.SetSnapshot( GreatOnlinePipeline::kBuild, snap_evnt.get() );
+		mypipe.SetSnapshot( GreatOnlinePipeline::kHist, snap_hist.get() );
+		metrics_mon->SetPipeline( &mypipe );
+		mypipe.SetLatencySink( []( double ms ){ metrics_mon->AddLatency( ms ); } );
+
+		// The stages stop when the monitor is paused, the reader waits for them
+		while( !bEndMon ) {
+
+			if( bRunMon && !mypipe.IsRunning() ) mypipe.Start();
+			else if( !bRunMon && mypipe.IsRunning() ) mypipe.Stop();
+
+			gSystem->Sleep( mon_time * 1e3 );
+			if( mypipe.IsRunning() ) {
+				mypipe.PrintMetrics();
+				sample_metrics();
+			}
+			if( snap_conv ) snap_conv->PrintCost( "singles" );
+			if( snap_evnt ) snap_evnt->PrintCost( "events" );
+			if( snap_hist ) snap_hist->PrintCost( "physics" );
+
+		}
+
+		// End of the sort, the last data go through all stages first
+		if( mypipe.IsRunning() ) mypipe.Stop();
+		myspy.Stop();
+		close_monitor( events_file.get() );
+
+		return 0;
+
+	}
+
+	// Hits and events are handed over in memory, only triggered events still go through the trees
+	bool flag_memory = !flag_source && !calfiles->myset->IsTriggerMode();
+	if( flag_memory ) {
+
+		events_file.reset( new TFile( "monitor_events.root", "recreate" ) );
+		eb_mon->SetOutputDirectory( events_file.get(), false );
+		eb_mon->SetEventSink( []( const GreatEvts &evts ){ hist_mon->FillOnline( evts ); } );
+		eb_mon->StartFile();
+		eb_mon->Initialise();
+		hist_mon->SetOutput( "monitor_hists.root" );
+
+	}
+	std::vector<std::shared_ptr<GreatDataPackets>> mon_hits;
+
+	// Files are only written every so often
+	double snapshot_period = calfiles->myset->GetMonitorSnapshotPeriod();
+	auto snapshot_last = std::chrono::steady_clock::now();
+
+	// Until the monitor is ended
+	while( !bEndMon ) {
 		
 		// While the sort is running, bRunMon is true
-		while( bRunMon ) {
+		while( bRunMon && !bEndMon ) {
 			
 			// Lock the main thread
 			//TThread::Lock();
+
+			// Resets asked for from the web page
+			if( snap_conv && snap_conv->TakeReset() ) {
+				conv_mon->ResetHists();
+				if( roll_conv ) roll_conv->Reset();
+			}
+			if( snap_evnt && snap_evnt->TakeReset() ) eb_mon->ResetHists();
+			if( snap_hist && snap_hist->TakeReset() ) {
+				hist_mon->ResetHists();
+				if( roll_hist ) roll_hist->Reset();
+			}
+
+			// For the latency, the oldest block that is histogrammed in this pass
+			auto oldest_block = std::chrono::steady_clock::now();
 			
 			// Convert - from file
 			if( !flag_spy ) {
 				
-				nblocks = conv_mon->ConvertFile( curFileMon, start_block );
-				start_block = nblocks;
+				// Only the blocks completed since the last time
+				nblocks = mytail.ReadBlocks( [&]( char *data, unsigned long nblock ){
+					conv_mon->ConvertBlock( data, nblock );
+				} );
+				std::cout << "Got " << nblocks << " new blocks from " << curFileMon << std::endl;
+				metrics_mon->AddBlocks( nblocks, (unsigned long long)nblocks * calfiles->myset->GetBlockSize() );
+				if( !snap_conv ) conv_mon->SyncHists();
 				
 			}
 			
 			// Convert - from shared memory
 			else {
 				
-				// First check if we have data
-				std::cout << "Looking for data from DataSpy" << std::endl;
-				spy_length = myspy.Read( file_id, (char*)buffer, calfiles->myset->GetBlockSize() );
-				if( spy_length == 0 && bFirstRun ) {
+				// Take everything the readers got since the last time
+				int block_ctr = myspy.Drain( *conv_mon, [&](){
+					oldest_block = std::min( oldest_block, myspy.GetBlockTime() );
+				} );
+				nblocks = block_ctr;
+				if( block_ctr == 0 && bFirstRun ) {
 					std::cout << "No data yet on first pass" << std::endl;
 					gSystem->Sleep( 2e3 );
 					continue;
 				}
-				
-				// Keep reading until we have all the data
-				// This could be multi-threaded to process data and go back to read more
-				int block_ctr = 0;
-				long byte_ctr = 0;
-				int poll_ctr = 0;
-				while( block_ctr < 200 && poll_ctr < 1000 ){
-
-					//std::cout << "Got some data from DataSpy, block " << block_ctr << std::endl;
-					if( spy_length > 0 ) {
-						nblocks = conv_mon->ConvertBlock( (char*)buffer, 0 );
-						block_ctr += nblocks;
-					}
-					
-					// Read a new block
-					gSystem->Sleep( 1 ); // wait 1 ms between each read
-					spy_length = myspy.Read( file_id, (char*)buffer, calfiles->myset->GetBlockSize() );
 
-					byte_ctr += spy_length;
-					poll_ctr++;
-					
-				}
+				// Only merge the streams as far as they have all got
+				conv_mon->SetWatermark( myspy.GetWatermark() );
 
-				std::cout << "Got " << byte_ctr << " bytes of data from DataSpy" << std::endl;
+				std::cout << "Got " << block_ctr << " blocks, " << myspy.GetBytesRead() - spy_bytes;
+				std::cout << " bytes of data from DataSpy" << std::endl;
+				spy_bytes = myspy.GetBytesRead();
+				if( myspy.GetLostBuffers() > spy_lost ) {
+					std::cout << "DataSpy lost " << myspy.GetLostBuffers() - spy_lost;
+					std::cout << " buffers (" << myspy.GetLostBuffers() << " in total)" << std::endl;
+					spy_lost = myspy.GetLostBuffers();
+				}
+				if( myspy.GetNumberOfStreams() > 1 ) myspy.PrintCounters();
 
 				// Sort the packets we just got, then do the rest of the analysis
-				conv_mon->SortTree();
-				conv_mon->PurgeOutput();
+				if( !flag_memory ) {
+					conv_mon->SortTree();
+					conv_mon->PurgeOutput();
+				}
+				if( !snap_conv ) conv_mon->SyncHists();
 
 			}
 			
+			// Hits go straight to the event builder and its events to the histogrammer
+			if( flag_memory ) {
+
+				conv_mon->TakeOrdered( mon_hits );
+				nbuild = eb_mon->BuildEvents( mon_hits );
+				metrics_mon->AddEvents( nbuild );
+				mon_hits.clear();
+				if( !snap_evnt ) eb_mon->SyncHists();
+				std::cout << " Event Building: " << nbuild << " events" << std::endl;
+				bFirstRun = kFALSE;
+
+			}
+
 			// Only do the rest if it is not a source run
-			if( !flag_source ) {
+			else if( !flag_source ) {
 				
 				// Event builder
 				if( bFirstRun ) {
@@ -261,6 +599,7 @@ void* monitor_run( void* ptr ){
 				eb_mon->SetInputTree( sorted_tree );
 				eb_mon->GetTree()->Reset();
 				nbuild = eb_mon->BuildEvents();
+				metrics_mon->AddEvents( nbuild );
 				eb_mon->PurgeOutput();
 				delete sorted_tree;
 				
@@ -285,22 +624,53 @@ void* monitor_run( void* ptr ){
 				
 			}
 			
+			// Throughput and latency of this pass
+			if( nblocks > 0 )
+				metrics_mon->AddLatency( std::chrono::duration<double,std::milli>(
+										 std::chrono::steady_clock::now() - oldest_block ).count() );
+			sample_metrics();
+
+			// Views of the last few minutes, the physics ones once the histograms exist
+			if( flag_rolling ) {
+				roll_conv->Update();
+				if( !roll_hist && !flag_source && hist_mon->GetHistogramSet().GetSize() )
+					make_rolling_hist( calfiles->myset );
+				if( roll_hist ) roll_hist->Update();
+			}
+
+			// New copies for the web server, it never sees the histograms being filled
+			if( snap_conv && snap_conv->Publish() ) snap_conv->PrintCost( "singles" );
+			if( snap_evnt && snap_evnt->Publish() ) snap_evnt->PrintCost( "events" );
+			if( snap_hist && snap_hist->Publish() ) snap_hist->PrintCost( "physics" );
+
+			// Copy of the histograms on disk
+			auto snapshot_now = std::chrono::steady_clock::now();
+			if( snapshot_period > 0 &&
+			    std::chrono::duration<double>( snapshot_now - snapshot_last ).count() > snapshot_period ) {
+				snapshot_monitor();
+				snapshot_last = snapshot_now;
+			}
+
+			// Following a file, new data wake us up early
+			if( !flag_spy ) mytail.Wait( std::min( tail_interval, (double)mon_time ), mon_time );
+
 			// This makes things unresponsive!
 			// Unless we are threading?
-			gSystem->Sleep( mon_time * 1e3 );
+			else gSystem->Sleep( mon_time * 1e3 );
 			
 		} // bRunMon
 		
-	} // always running
+		// Paused
+		if( !bEndMon ) gSystem->Sleep( 100 );
+		
+	} // until ended
 	
 
 	// Close the dataSpy before exiting
-	if( flag_spy ) myspy.Close( file_id );
+	if( flag_spy ) myspy.Stop();
 
 	// Close all outputs
-	conv_mon->CloseOutput();
-	eb_mon->CloseOutput();
-	hist_mon->CloseOutput();
+	close_monitor( events_file.get() );
 
 	return 0;
 	
@@ -314,6 +684,13 @@ void start_http(){
 	serv = new THttpServer( server_name.data() );
 	serv->SetReadOnly(kFALSE);
 
+	// Only show the snapshots of the histograms, see GreatHistSnapshot
+	// The requests are then answered by the main loop, in between two snapshots
+	if( myset->GetHttpSnapshotPeriod() > 0 ) {
+		serv->SetTimer( 0 );
+		serv->GetSniffer()->SetScanGlobalDir( kFALSE );
+	}
+
 	// enable monitoring and
 	// specify items to draw when page is opened
 	serv->SetItemField("/","_monitoring","5000");
@@ -326,10 +703,16 @@ void start_http(){
 	//serv->RegisterCommand("/Stop",  "bRunMon=kFALSE;", "button;/usr/share/root/icons/ed_interrupt.png");
 	serv->RegisterCommand("/Start", "StartMonitor()");
 	serv->RegisterCommand("/Stop", "StopMonitor()");
+	serv->RegisterCommand("/Exit", "EndMonitor()");
 	serv->RegisterCommand("/ResetSingles", "ResetConv()");
 	serv->RegisterCommand("/ResetEvents", "ResetEvnt()");
 	serv->RegisterCommand("/ResetHists", "ResetHist()");
 
+	// Plain text metrics, e.g. http://localhost:8030/metrics/metrics.txt
+	metrics_dir = std::string( gSystem->WorkingDirectory() ) + "/monitor_metrics";
+	gSystem->mkdir( metrics_dir.data(), kTRUE );
+	serv->AddLocation( "metrics/", metrics_dir.data() );
+
 	// hide commands so the only show as buttons
 	//serv->Hide("/Start");
 	//serv->Hide("/Stop");
@@ -516,12 +899,142 @@ bool do_build(){
 	
 }
 
+bool do_build_chain(){
+	
+	//---------------------------------------------//
+	// Physics event builder across all subruns    //
+	//---------------------------------------------//
+	GreatEventBuilder eb( myset );
+	std::cout << "\n +++ Great Analysis:: processing EventBuilder for a chain of files +++" << std::endl;
+	
+	TFile *rtest;
+	std::ifstream ftest;
+	std::string name_input_file;
+	std::string name_output_file;
+	std::vector<std::string> name_input_files;
+	
+	// Update calibration file if given
+	if( overwrite_cal ) eb.AddCalibration( mycal );
+
+	// Collect all files in the order they are given
+	for( unsigned int i = 0; i < input_names.size(); i++ ){
+			
+		name_input_file = input_names.at(i).substr( input_names.at(i).find_last_of("/")+1,
+												   input_names.at(i).length() - input_names.at(i).find_last_of("/")-1 );
+		name_input_file = name_input_file.substr( 0,
+												 name_input_file.find_last_of(".") );
+		
+		// Output is named after the first file
+		if( name_output_file.length() == 0 ) {
+			
+			name_output_file = name_input_file.substr( 0,
+													  name_input_file.find_last_of(".") );
+			name_output_file = datadir_name + "/" + name_output_file + "_chain_events.root";
+			
+		}
+		
+		name_input_file = datadir_name + "/" + name_input_file + ".root";
+
+		// Check if the input file exists
+		ftest.open( name_input_file.data() );
+		if( !ftest.is_open() ) {
+			
+			std::cerr << name_input_file << " does not exist" << std::endl;
+			continue;
+			
+		}
+		else ftest.close();
+		
+		name_input_files.push_back( name_input_file );
+
+		// We need to do event builder if any of them was just converted
+		if( flag_convert || force_convert.at(i) || flag_events )
+			force_events = true;
+
+	}
+	
+	// Nothing to do
+	if( !name_input_files.size() ) return false;
+	
+	// If it doesn't exist, we have to build it anyway
+	if( !force_events ) {
+		
+		ftest.open( name_output_file.data() );
+		if( !ftest.is_open() ) force_events = true;
+		else {
+			
+			ftest.close();
+			rtest = new TFile( name_output_file.data() );
+			if( rtest->IsZombie() ) force_events = true;
+			if( rtest->TestBit(TFile::kRecovered) ){
+				std::cout << name_output_file << " possibly corrupted, rebuilding" << std::endl;
+				force_events = true;
+			}
+			if( !force_events )
+				std::cout << name_output_file << " already built" << std::endl;
+			rtest->Close();
+			
+		}
+		
+	}
+	
+	if( force_events ) {
+
+		std::cout << name_input_files.size() << " files --> ";
+		std::cout << name_output_file << std::endl;
+
+		eb.SetInputFile( name_input_files );
+		eb.SetOutput( name_output_file );
+		eb.BuildEvents();
+		eb.CloseOutput();
+		
+		events_names = eb.GetOutputNames();
+		force_events = false;
+		
+	}
+	
+	// Already built, including any files after a roll over
+	else events_names = GreatEventBuilder::ReadOutputNames( name_output_file );
+	
+	return true;
+	
+}
+
+void do_replay(){
+
+	//--------------------------------------------//
+	// Play a file in to the DataSpy like the DAQ //
+	//--------------------------------------------//
+	std::cout << "\n +++ Great Analysis:: replaying in to the DataSpy +++" << std::endl;
+
+	// The timestamps are needed to replay at a multiple of real time
+	std::shared_ptr<GreatConverter> conv;
+	if( replay_rate <= 0 && replay_speed > 0 ) {
+
+		conv = std::make_shared<GreatConverter>( myset );
+		conv->AddCalibration( mycal );
+		conv->SetOutput( "replay_singles.root" );
+		conv->MakeHists();
+
+	}
+
+	// Into the first stream, where the monitor looks by default
+	GreatDataSpyProducer myproducer( myset->GetSpyStreamID(0), myset->GetBlockSize() );
+	myproducer.Replay( name_replay_file, replay_rate, replay_speed, conv );
+
+	if( conv ) conv->CloseOutput();
+
+	return;
+
+}
+
 void do_hist(){
 	
 	//------------------------------//
 	// Finally make some histograms //
 	//------------------------------//
 	GreatHistogrammer hist( myreact, myset );
+	hist.SetUserHists( myuserhists );
 	std::cout << "\n +++ Great Analysis:: processing Histogrammer +++" << std::endl;
 
 	std::ifstream ftest;
@@ -529,8 +1042,11 @@ void do_hist(){
 	
 	std::vector<std::string> name_hist_files;
 	
+	// Events were built across all files already
+	if( flag_chain ) name_hist_files = events_names;
+	
 	// We are going to chain all the event files now
-	for( unsigned int i = 0; i < input_names.size(); i++ ){
+	for( unsigned int i = 0; i < input_names.size() && !flag_chain; i++ ){
 
 		name_input_file = input_names.at(i).substr( input_names.at(i).find_last_of("/")+1,
 												   input_names.at(i).length() - input_names.at(i).find_last_of("/")-1 );
@@ -555,8 +1071,14 @@ void do_hist(){
 	if( name_hist_files.size() ) {
 		
 		hist.SetOutput( output_name );
-		hist.SetInputFile( name_hist_files );
-		hist.FillHists();
+		hist.SetThreads( n_threads );
+		if( flag_nocache ) {
+			
+			hist.SetInputFile( name_hist_files );
+			hist.FillHists();
+			
+		}
+		else hist.FillHistsCached( name_hist_files );
 		hist.CloseOutput();
 
 	}
@@ -575,13 +1097,21 @@ int main( int argc, char *argv[] ){
 	interface->Add("-s", "Settings file", &name_set_file );
 	interface->Add("-c", "Calibration file", &name_cal_file );
 	interface->Add("-r", "Reaction file", &name_react_file );
+	interface->Add("-hs", "Histogram definition file", &name_hist_def_file );
 	interface->Add("-f", "Flag to force new ROOT conversion", &flag_convert );
 	interface->Add("-e", "Flag to force new event builder (new calibration)", &flag_events );
 	interface->Add("-source", "Flag to define an source only run", &flag_source );
+	interface->Add("-chain", "Flag to build events across all input files as one run", &flag_chain );
 	interface->Add("-spy", "Flag to run the DataSpy", &flag_spy );
+	interface->Add("-pipeline", "Flag to run each step of the DataSpy sort on its own thread", &flag_pipeline );
+	interface->Add("-replay", "File to replay in to the DataSpy shared memory", &name_replay_file );
+	interface->Add("-rate", "Blocks per second for -replay (default as fast as possible)", &replay_rate );
+	interface->Add("-speed", "Replay at this multiple of real time, from the timestamps", &replay_speed );
 	interface->Add("-m", "Monitor input file every X seconds", &mon_time );
 	interface->Add("-p", "Port number for web server (default 8030)", &port_num );
 	interface->Add("-d", "Output directory for sorted files", &datadir_name );
+	interface->Add("-t", "Number of threads for the histogrammer (default 1)", &n_threads );
+	interface->Add("-nocache", "Flag to fill all histograms again without the cache of each events file", &flag_nocache );
 	interface->Add("-g", "Launch the GUI", &gui_flag );
 	interface->Add("-h", "Print this help", &help_flag );
 
@@ -604,8 +1134,16 @@ int main( int argc, char *argv[] ){
 
 	}
 
+	// The pacing only means something for a replay
+	if( ( replay_rate > 0 || replay_speed > 0 ) && !name_replay_file.length() ) {
+		
+		std::cout << "The -rate and -speed flags only apply to -replay" << std::endl;
+		return 1;
+		
+	}
+
 	// Check we have data files
-	if( !input_names.size() && !flag_spy ) {
+	if( !input_names.size() && !flag_spy && !name_replay_file.length() ) {
 			
 			std::cout << "You have to provide at least one input file (data or simulation) unless you are in DataSpy mode!" << std::endl;
 			return 1;
@@ -636,6 +1174,19 @@ int main( int argc, char *argv[] ){
 		std::cout << "Cannot monitor multiple input files, switching to normal mode" << std::endl;
 				
 	}
+
+	// The pipeline only works on the DataSpy, with events built in time windows
+	if( flag_pipeline && ( !flag_spy || flag_source ) ) {
+
+		std::cout << "The online pipeline needs the DataSpy and no source run, ";
+		std::cout << "running the monitor loop instead" << std::endl;
+		flag_pipeline = false;
+
+	}
+
+	// ROOT has to know before any thread is started. The monitor runs on its
+	// own thread next to the web server, and the pipeline stages on theirs
+	if( n_threads > 1 || flag_monitor ) ROOT::EnableThreadSafety();
 	
 	// Check the directory we are writing to
 	if( datadir_name.length() == 0 ) {
@@ -778,10 +1329,43 @@ int main( int argc, char *argv[] ){
 
 	}
 	
+	// Check for a histogram definition file, only used if given
+	if( name_hist_def_file.length() > 0 ) {
+		
+		// Test if the file exists
+		std::ifstream ftest;
+		ftest.open( name_hist_def_file.data() );
+		if( !ftest.is_open() ) {
+			
+			std::cout << name_hist_def_file << " does not exist.";
+			std::cout << " No user histograms" << std::endl;
+
+		}
+		
+		else {
+		
+			ftest.close();
+			std::cout << "Histogram definition file: " << name_hist_def_file << std::endl;
+			myuserhists = std::make_shared<GreatUserHists>( name_hist_def_file );
+
+		}
+		
+	}
+	
 	myset = std::make_shared<GreatSettings>( name_set_file );
 	mycal = std::make_shared<GreatCalibration>( name_cal_file, myset );
 	myreact = std::make_shared<GreatReaction>( name_react_file, myset, flag_source );
 
+	//--------------------------//
+	// Replay in to the DataSpy //
+	//--------------------------//
+	if( name_replay_file.length() ) {
+
+		do_replay();
+		return 0;
+
+	}
+
 	//-------------------//
 	// Online monitoring //
 	//-------------------//
@@ -797,17 +1381,26 @@ int main( int argc, char *argv[] ){
 		start_http();
 		gSystem->ProcessEvents();
 
+		// Ctrl-C or the Exit button end the monitor, which then writes its files
+		std::signal( SIGINT, end_monitor_signal );
+		std::signal( SIGTERM, end_monitor_signal );
+
 		// Thread for the monitor process
 		TThread *th = new TThread( "monitor", monitor_run, (void*) &data );
 		th->Run();
 		
 		// wait until we finish
-		while( true ){
+		while( !bEndMon ){
 			
 			gSystem->Sleep(10);
 			gSystem->ProcessEvents();
+			if( myset->GetHttpSnapshotPeriod() > 0 )
+				GreatHistSnapshot::ProcessRequests( serv );
 			
 		}
+		
+		// The monitor writes its files before it stops
+		th->Join();
 		std::cout << "Finished" << std::endl;
 		
 		return 0;
@@ -826,7 +1419,10 @@ int main( int argc, char *argv[] ){
 	if( !flag_source ) {
 		
 		// Build events and if successful, do histogramming
-		if( do_build() ) do_hist();
+		if( flag_chain ) {
+			if( do_build_chain() ) do_hist();
+		}
+		else if( do_build() ) do_hist();
 		
 	}
 	
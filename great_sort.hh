@@ -3,6 +3,7 @@
 #include <TTree.h>
 #include <TFile.h>
 #include <THttpServer.h>
+#include <TRootSniffer.h>
 #include <TThread.h>
 #include <TGClient.h>
 #include <TApplication.h>
@@ -12,6 +13,9 @@
 #include <string>
 #include <vector>
 #include <sstream>
+#include <chrono>
+#include <csignal>
+#include <atomic>
 
 
 // Some compiler things
@@ -23,6 +27,7 @@
 #endif
 
 Bool_t bRunMon = kTRUE;
+std::atomic<bool> bEndMon{false};	// set from the signal handler and read by the monitor thread
 Bool_t bFirstRun = kTRUE;
 std::string curFileMon;
 
@@ -31,3 +36,4 @@ void reset_evnt_hists();
 void reset_phys_hists();
 void stop_monitor();
 void start_monitor();
+void end_monitor();
@@ -0,0 +1,70 @@
+#ifndef __COINCIDENCEFINDER_HH
+#define __COINCIDENCEFINDER_HH
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+/*!
+* \brief Sliding-window coincidence engine for the hits inside a single event.
+*
+* \details Hits are added with their time, detector ID and their index in the
+* list kept by the caller (e.g. cebr3_en_list in the GreatEventBuilder). Once
+* all hits of an event are added, they are sorted by time and bucketed by
+* detector ID. Pair lists are then produced with a two-pointer window, so that
+* the cost scales with the number of pairs inside the window rather than with
+* the square of the multiplicity.
+*
+* Pairs are returned as indices into the caller's lists, with the first element
+* always being the earlier hit in time.
+*/
+
+class GreatCoincidenceFinder {
+
+public:
+
+	/// Which detector combinations to consider when forming pairs
+	enum pair_t {
+		kAnyID	= 0,	///< All pairs
+		kSameID	= 1,	///< Only pairs within the same detector
+		kDiffID	= 2		///< Only pairs between different detectors
+	};
+
+	GreatCoincidenceFinder(){};		///< Constructor
+	~GreatCoincidenceFinder(){};	///< Destructor
+
+	void Clear();	///< Called for every event
+	void AddHit( double t, short id, unsigned int idx );	///< Add a hit from the caller's list
+	void Sort();	///< Time order the hits and fill the detector buckets, called by FindPairs if needed
+
+	/// Find all pairs with |t_j - t_i| < window, negative window means no time condition
+	const std::vector<std::pair<unsigned int,unsigned int>>& FindPairs( double window, pair_t mode = kAnyID );
+
+	inline unsigned int GetMultiplicity() const { return hits.size(); };
+	inline const std::vector<std::pair<unsigned int,unsigned int>>& GetPairs() const { return pairs; };
+
+
+private:
+
+	/// Internal copy of the hit, small enough to sort cheaply
+	struct coinc_hit_t {
+		double			time;	///< time stamp of the hit
+		short			id;		///< detector ID used for bucketing
+		unsigned int	idx;	///< index in the caller's list
+	};
+
+	static bool TimeComparator( const coinc_hit_t &lhs, const coinc_hit_t &rhs );
+
+	void WindowPairs( const std::vector<coinc_hit_t> &list, double window, pair_t mode );
+
+	std::vector<coinc_hit_t> hits;					///< Time ordered hits in the event
+	std::vector<std::vector<coinc_hit_t>> buckets;	///< Time ordered hits split by detector ID
+	std::vector<unsigned int> used_buckets;			///< List of detector IDs with hits, for fast clean up
+	std::vector<std::pair<unsigned int,unsigned int>> pairs;	///< Result of the last call to FindPairs
+
+	bool flag_sorted = true;	///< False when hits have been added since the last sort
+
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef __COMPACTHIST_HH
+#define __COMPACTHIST_HH
+
+#include <iostream>
+#include <string>
+#include <memory>
+
+#include <TDirectory.h>
+#include <TH1.h>
+
+/*!
+* \brief Common interface of the histograms that keep their counts in their own storage.
+*
+* \details The compact spectra, matrices and cubes only make ROOT objects when
+* they are written or shown. This interface lets a GreatHistogramSet hold them
+* next to the ROOT histograms, so that the same reset, merge and write
+* of the set covers all of them.
+*
+* GreatCompactHist::Add is the merge of two copies that were filled apart, e.g.
+* by the workers of a parallel sort or from a histogram cache, and
+* GreatCompactHist::CloneEmpty makes the copy for a worker. One that can be
+* filled by several threads at once says so with GreatCompactHist::IsThreadSafe
+* and is shared by the workers instead.
+*/
+
+class GreatCompactHist {
+
+public:
+
+	GreatCompactHist(){};			///< Constructor
+	virtual ~GreatCompactHist(){};	///< Destructor
+
+	virtual std::string GetName() const = 0;	///< Name of the ROOT histogram that is written
+	virtual unsigned long long GetEntries() const = 0;	///< Number of fills
+
+	virtual void Reset() = 0;	///< Clears the counts in place, keeping the memory
+	virtual bool Add( const GreatCompactHist &other ) = 0;	///< Adds the counts of another one with the same type and binning
+	virtual std::unique_ptr<GreatCompactHist> CloneEmpty() const = 0;	///< Empty copy with the same binning
+	virtual bool IsThreadSafe() const { return false; };	///< True if several threads can fill it at once, so the workers can share it
+
+	virtual TH1* MakeHist() const = 0;	///< New ROOT histogram with the counts, in no directory and owned by the caller
+	virtual void CopyTo( TH1 *h ) const;	///< Replaces the contents of a histogram made by MakeHist with the counts
+	virtual void Write( TDirectory *dir );	///< Writes the counts in to a directory
+	virtual bool AddFrom( TDirectory *dir ) = 0;	///< Adds the counts that GreatCompactHist::Write put in a directory
+
+};
+
+#endif
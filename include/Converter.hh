@@ -10,6 +10,9 @@
 #include <string>
 #include <cstring>
 #include <memory>
+#include <atomic>
+#include <cfloat>
+#include <algorithm>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -36,6 +39,16 @@
 # include "DataPackets.hh"
 #endif
 
+// Spectrum header
+#ifndef __SPECTRUM_HH
+# include "Spectrum.hh"
+#endif
+
+// Histogram set header
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
 class GreatConverter {
 
 public:
@@ -50,10 +63,17 @@ public:
 	int ConvertBlock( char *input_block, int nblock );
 	void MakeHists();
 	void ResetHists();
+	void SyncHists();
 	void MakeTree();
 	void StartFile();
 	void SortDataMap();
 	unsigned long long int SortTree( bool do_sort = true );
+	unsigned long TakePackets( std::vector<std::shared_ptr<GreatDataPackets>> &packets );
+	unsigned long TakeOrdered( std::vector<std::shared_ptr<GreatDataPackets>> &packets );
+	inline unsigned long GetOnlineTail(){ return data_vector.size(); };
+	inline unsigned long GetOnlineLate(){ return ctr_online_late; };
+	inline unsigned long GetCAENHits( unsigned int mod ){ return mod < ctr_caen_hit.size() ? ctr_caen_hit[mod].load( std::memory_order_relaxed ) : 0; };
+	inline unsigned long GetDecodeErrors(){ return ctr_decode_err.load( std::memory_order_relaxed ); };
 	static bool MapComparator( const std::pair<unsigned long,double> &lhs,
 							  const std::pair<unsigned long,double> &rhs );
 
@@ -75,6 +95,7 @@ public:
 	
 	inline void CloseOutput(){
 		std::cout << "\n Writing data and closing the file" << std::endl;
+		hist_set.WriteCompact();
 		output_file->Write( 0, TObject::kWriteDelete );
 		PurgeOutput();
 		output_file->Close();
@@ -83,10 +104,26 @@ public:
 	inline TFile* GetFile(){ return output_file; };
 	inline TTree* GetTree(){ return sorted_tree; };
 	inline TTree* GetSortedTree(){ return sorted_tree; };
+	inline GreatHistogramSet& GetHistogramSet(){ return hist_set; };
+	inline std::shared_ptr<GreatSpectrum> GetCalSpectrum( unsigned int mod, unsigned int ch ){
+		if( mod < hcaen_cal.size() && ch < hcaen_cal[mod].size() ) return hcaen_cal[mod][ch];
+		return nullptr;
+	};	///< Calibrated energy spectrum of a CAEN channel
 
 	inline void AddCalibration( std::shared_ptr<GreatCalibration> mycal ){ cal = mycal; };
 	inline void SourceOnly(){ flag_source = true; };
 
+	/// In online mode, SortTree only writes the hits that are final and keeps the rest for the next call
+	/// \param[in] flag true for the DataSpy, where SortTree is called again for every new batch
+	inline void SetOnline( bool flag ){ flag_online = flag; };
+
+	void SetStream( unsigned int s );	///< Switches the timestamp state to another DataSpy stream
+	inline double GetStreamTime(){ return stream_time; };	///< Latest hit time of the current stream
+
+	/// Hits later than this are kept back in online mode, e.g. until all DataSpy streams have passed it
+	/// \param[in] t The time in ns up to which all streams have arrived, see GreatSpyStreams::GetWatermark
+	inline void SetWatermark( double t ){ online_watermark = t; };
+
 	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
 		prog = myprog;
 		_prog_ = true;
@@ -222,21 +259,41 @@ private:
 	std::vector<std::shared_ptr<GreatDataPackets>> data_vector;
 	std::vector<std::pair<unsigned long,double>> data_map;
 
+	// Online mode, only a tail of the latest hits is kept between batches
+	unsigned long long SortTreeOnline();
+	bool flag_online = false;			///< SortTree works on batches, see SetOnline
+	bool flag_online_out = false;		///< True once a hit has been written in online mode
+	double online_time_out = 0;			///< Time of the last hit written in online mode
+	double online_watermark = DBL_MAX;	///< Hits after this time are kept back in online mode
+	unsigned long ctr_online_late = 0;	///< Hits that came after a later hit had already been written
+
+	/// Decoding state that carries over between the blocks of one DataSpy stream
+	struct stream_state_t {
+		unsigned long	tm_stp_msb;	///< Middle bits of the timestamp, from the info data
+		unsigned long	tm_stp_hsb;	///< Highest bits of the timestamp, from the info data
+		double			time;		///< Latest hit time
+	};
+	std::vector<stream_state_t> stream_state;	///< Saved state of the streams that are not current
+	unsigned int cur_stream = 0;				///< Stream of the blocks being converted
+	double stream_time = 0;						///< Latest hit time of the current stream
+
 	// Output stuff
 	TFile *output_file;
 	TTree *sorted_tree;
 
 	// Counters
-	std::vector<unsigned long> ctr_caen_hit;		// hits on each CAEN module
+	std::vector<std::atomic<unsigned long>> ctr_caen_hit;	// hits on each CAEN module, read by the metrics while decoding
 	std::vector<unsigned long> ctr_caen_ext;		// external (pulser) CAEN timestamps
+	std::atomic<unsigned long> ctr_decode_err;		// data words of unknown type and incomplete blocks, read by the metrics too
 
 	// Histograms
+	GreatHistogramSet hist_set;
 	std::vector<TProfile*> hcaen_hit;
 	std::vector<TProfile*> hcaen_ext;
-	std::vector<std::vector<TH1F*>> hcaen_qlong;
-	std::vector<std::vector<TH1F*>> hcaen_qshort;
-	std::vector<std::vector<TH1F*>> hcaen_qdiff;
-	std::vector<std::vector<TH1F*>> hcaen_cal;
+	std::vector<std::vector<std::shared_ptr<GreatSpectrum>>> hcaen_qlong;
+	std::vector<std::vector<std::shared_ptr<GreatSpectrum>>> hcaen_qshort;
+	std::vector<std::vector<std::shared_ptr<GreatSpectrum>>> hcaen_qdiff;
+	std::vector<std::vector<std::shared_ptr<GreatSpectrum>>> hcaen_cal;
 
 	// 	Settings file
 	std::shared_ptr<GreatSettings> set;
@@ -0,0 +1,76 @@
+#ifndef __DATASPYPRODUCER_HH
+#define __DATASPYPRODUCER_HH
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+// DataSpy header
+#ifndef __DATASPY_HH
+# include "DataSpy.hh"
+#endif
+
+// Converter header
+#ifndef __CONVERTER_HH
+# include "Converter.hh"
+#endif
+
+/*!
+* \brief Writes data in to a DataSpy shared memory area, like the DAQ does.
+*
+* \details The shared memory is created with the same BUFFER_HEADER layout that
+* DataSpy::Open expects: the header in the first page, followed by NBLOCKS
+* buffers. Each buffer written goes in the next slot of the ring, with an age
+* that is one more than the last, so a reader that falls behind sees the gaps
+* in the ages as lost buffers, exactly as with the DAQ.
+*
+* GreatDataSpyProducer::Replay reads the blocks of a MIDAS file and writes them
+* at a fixed number of blocks per second, at a multiple of real time taken from
+* the timestamps, or as fast as possible. With a monitor reading the same ID in
+* another process, the online sort can be tested and its maximum throughput and
+* buffer loss measured without the DAQ.
+*/
+
+class GreatDataSpyProducer {
+
+public:
+
+	GreatDataSpyProducer( int id, unsigned int block_size );	///< Constructor
+	~GreatDataSpyProducer();	///< Destructor, removes the shared memory
+
+	bool Open();	///< Creates the shared memory area and its header
+	void Close();	///< Detaches and removes the shared memory area
+	void Write( const char *data, unsigned int length );	///< Writes one buffer in the next slot
+
+	unsigned long long Replay( std::string input_file_name, double rate, double speed,
+							   std::shared_ptr<GreatConverter> conv );
+
+	inline unsigned long long GetBuffersWritten() const { return n_written; };
+
+
+private:
+
+	static const unsigned int kHeaderSpace = 0x1000;	///< Bytes before the first buffer, the header fits in one page
+
+	int					id;				///< Shared memory ID, as for DataSpy::Open
+	unsigned int		block_size;		///< Length of each buffer
+	void				*area;			///< Start of the shared memory
+	BUFFER_HEADER		*header;		///< Header at the start of the shared memory
+#if( defined SOLARIS || defined POSIX )
+	char				object_name[16];	///< Name of the POSIX shared memory object
+#else
+	int					shmid;			///< System V shared memory ID
+#endif
+
+	unsigned long long	n_written;		///< Number of buffers written
+
+};
+
+#endif
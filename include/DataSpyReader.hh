@@ -0,0 +1,109 @@
+#ifndef __DATASPYREADER_HH
+#define __DATASPYREADER_HH
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+// DataSpy header
+#ifndef __DATASPY_HH
+# include "DataSpy.hh"
+#endif
+
+/*!
+* \brief Reads the DataSpy shared memory on its own thread, so that no buffer is missed.
+*
+* \details The thread reads every new buffer as soon as it is written and puts
+* a copy of it in a bounded queue. When there is nothing to read, it first
+* retries straight away for a few times and then sleeps for longer and longer,
+* up to a maximum, starting again from zero as soon as data arrives. Bursts are
+* therefore read without delay while an idle DAQ costs almost no CPU.
+*
+* Every buffer has an age that the DAQ increments by one, so a jump in the age
+* means that buffers were overwritten before they could be read. These are
+* counted as lost.
+*
+* The monitor takes all waiting blocks with GreatDataSpyReader::Drain, whenever
+* it is ready for them. If the queue is full, the reader waits for the monitor
+* and any buffers overwritten in the meantime show up as lost.
+*/
+
+class GreatDataSpyReader {
+
+public:
+
+	GreatDataSpyReader( int id, unsigned int block_size,
+						unsigned int queue_size, double max_backoff );	///< Constructor
+	~GreatDataSpyReader();	///< Destructor, stops the thread
+
+	static const unsigned int kSpinCount = 100;	///< Number of immediate retries before sleeping
+
+	bool Start();	///< Opens the shared memory and starts the thread
+	void Stop();	///< Stops the thread and closes the shared memory
+
+	/// Calls fn( data, length, read_time ) for every block in the queue, in the
+	/// order they were read, on the calling thread. The blocks are recycled afterwards.
+	/// \param[in] fn Any callable taking a char*, an int and the steady_clock time the block was read
+	/// \return The number of blocks
+	template<class F> unsigned int Drain( F fn ){
+		std::deque<std::vector<char>> todo;
+		std::deque<int> todo_length;
+		std::deque<std::chrono::steady_clock::time_point> todo_time;
+		{
+			std::lock_guard<std::mutex> lock( queue_mutex );
+			todo.swap( queue );
+			todo_length.swap( queue_length );
+			todo_time.swap( queue_time );
+		}
+		queue_space.notify_one();
+		for( unsigned int i = 0; i < todo.size(); ++i )
+			fn( todo[i].data(), todo_length[i], todo_time[i] );
+		std::lock_guard<std::mutex> lock( queue_mutex );
+		for( unsigned int i = 0; i < todo.size(); ++i )
+			if( pool.size() < queue_size ) pool.push_back( std::move( todo[i] ) );
+		return todo.size();
+	};
+
+	inline unsigned long long GetBlocksRead() const { return n_blocks; };
+	inline unsigned long long GetBytesRead() const { return n_bytes; };
+	inline unsigned long long GetLostBuffers() const { return n_lost; };
+	inline unsigned long long GetQueueWaits() const { return n_waits; };
+	inline unsigned int GetMaxQueueDepth() const { return max_depth; };
+	inline bool IsRunning() const { return running; };
+
+
+private:
+
+	void Run();	///< Reading loop on the reader thread
+
+	DataSpy						spy;			///< Access to the shared memory
+	int							id;				///< Shared memory ID
+	unsigned int				block_size;		///< Bytes to copy from each buffer
+	unsigned int				queue_size;		///< Maximum number of blocks waiting
+	double						max_backoff;	///< Longest sleep in ms when there is no data
+
+	std::thread					reader;			///< Reader thread
+	std::atomic<bool>			running;		///< True while the thread should keep reading
+
+	std::mutex					queue_mutex;	///< Protects the queue and the pool
+	std::condition_variable		queue_space;	///< Signalled when the queue is drained
+	std::deque<std::vector<char>>	queue;		///< Blocks waiting for the monitor
+	std::deque<int>				queue_length;	///< Length of each block in the queue
+	std::deque<std::chrono::steady_clock::time_point>	queue_time;	///< When each block in the queue was read
+	std::vector<std::vector<char>>	pool;		///< Used blocks that can be filled again
+
+	unsigned long long			last_age;		///< Age of the last buffer that was read
+	std::atomic<unsigned long long>	n_blocks;	///< Number of blocks read
+	std::atomic<unsigned long long>	n_bytes;	///< Number of bytes read
+	std::atomic<unsigned long long>	n_lost;		///< Number of buffers overwritten before they were read
+	std::atomic<unsigned long long>	n_waits;	///< Number of times the queue was full
+	std::atomic<unsigned int>	max_depth;		///< Largest number of blocks waiting at once
+
+};
+
+#endif
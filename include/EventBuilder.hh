@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <functional>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -43,6 +45,26 @@
 # include "GreatEvts.hh"
 #endif
 
+// Histogram set
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
+// Symmetric matrix
+#ifndef __SYMMATRIX_HH
+# include "SymMatrix.hh"
+#endif
+
+// Reorder buffer
+#ifndef __REORDERBUFFER_HH
+# include "ReorderBuffer.hh"
+#endif
+
+// Coincidence engine
+#ifndef __COINCIDENCEFINDER_HH
+# include "CoincidenceFinder.hh"
+#endif
+
 /*!
 * \brief Builds physics events after all hits have been time sorted.
 *
@@ -64,17 +86,33 @@ class GreatEventBuilder {
 public:
 	
 	GreatEventBuilder( std::shared_ptr<GreatSettings> myset ); ///< Constructor
-	virtual ~GreatEventBuilder(){}; /// Destructor (currently empty)
+	virtual ~GreatEventBuilder(){ delete in_data; }; /// Destructor, deletes the hit that the input branch reads in to
 
 	void	SetInputFile( std::string input_file_name ); ///< Function to set the input data file from which events are built
+	void	SetInputFile( std::vector<std::string> input_file_names ); ///< Chains several time-sorted files to build events across them
 	void	SetInputTree( TTree* user_tree ); ///< Grabs the input tree from the input file defined in GreatEventBuilder::SetInputFile
 
 	void	SetOutput( std::string output_file_name ); ///< Configures the output for the class
+	void	OpenOutput( std::string output_file_name ); ///< Creates the output file, tree and histograms
+	void	RollOver(); ///< Closes the current output file once it is too big and continues in a new one
+	void	SetOutputDirectory( TDirectory *dir, bool write_tree ); ///< Output in to a directory of another file, used by the window scan
+	void	StartScans(); ///< Creates an event builder for each setting of the window scan
+	void	OpenScans(); ///< Creates the output directories of the window scan in the current file
+	inline std::vector<std::string> GetOutputNames(){ return output_names; }; ///< List of all output files written, including those after a roll over
+	static std::vector<std::string> ReadOutputNames( std::string first_name ); ///< List of all output files of an earlier run, from the files themselves
 
 	void	StartFile();	///< Called for every file
 	void	Initialise();	///< Called for every event
 	void	MakeHists(); ///< Creates histograms for events that occur
 	void	ResetHists(); ///< Empties the histograms during the DataSpy
+	void	SyncHists(); ///< Expands the compact matrices in to ROOT histograms, only for a web server that scans the file
+	void	WriteHists(); ///< Writes the compact matrices, before the output file is written
+
+	/// Hands every event that is built to a function as well as the tree, used by the online pipeline
+	/// \param[in] sink Called with each event, nullptr to stop
+	inline void SetEventSink( std::function<void(const GreatEvts&)> sink ){
+		event_sink = sink;
+	};
 
 	/// Adds the calibration from the external calibration file to the class
 	/// \param[in] mycal The GreatCalibration object which is constructed by the GreatCalibration constructor used in iss_sort.cc
@@ -84,7 +122,19 @@ public:
 	};
 	
 	unsigned long	BuildEvents(); ///< The heart of this class
+	unsigned long	BuildEvents( const std::vector<std::shared_ptr<GreatDataPackets>> &packets ); ///< Builds events from time-ordered hits in memory, used online
 	unsigned long	BuildSimulatedEvents(); ///< The heart of this class
+	void			BuildTriggeredEvents(); ///< Builds events only around trigger hits, called by BuildEvents in the triggered modes
+	void			FinishEvents(); ///< Prints the counters and writes the output at the end of BuildEvents
+	void			StartReorder(); ///< Sets up the reorder buffer at the start of BuildEvents
+	void			ProcessData( GreatDataPackets *data ); ///< Adds a single hit, closing the open event first if the hit is outside its window
+	void			FlushEvent(); ///< Closes the last open event at the end of the input
+	bool			NextData(); ///< Moves cur_data to the next hit in time order, false at the end of the input
+
+	// Processing of single hits and events
+	void GetCaenHit(); ///< Unpacks the current CAEN data into the generic data variables
+	void AddCaenHit(); ///< Adds the current CAEN hit to the list for its detector type
+	void CloseEvent(); ///< Runs the finders and fills the tree for the current event
 
 	// Resolve multiplicities etc
 	void TACFinder(); ///< Processes all hits in the TAC  that fall within the build window
@@ -93,12 +143,17 @@ public:
 
 	inline TFile* GetFile(){ return output_file; }; ///< Getter for the output_file pointer
 	inline TTree* GetTree(){ return output_tree; }; ///< Getter for the output tree pointer
+	inline GreatHistogramSet& GetHistogramSet(){ return hist_set; }; ///< Getter for the set of all histograms
 	
 	inline void CloseOutput(){
 		output_tree->ResetBranchAddresses();
 		PurgeOutput();
 		output_file->Close();
-		input_file->Close();
+		if( input_file ) input_file->Close();
+		if( input_chain ) {
+			delete input_chain;
+			input_chain = nullptr;
+		}
 		log_file.close(); //?? to close or not to close?
 	}; ///< Closes the output files from this class
 	inline void PurgeOutput(){ output_file->Purge(2); }
@@ -114,9 +169,14 @@ public:
 private:
 	
 	/// Input treze
-	TFile *input_file; ///< Pointer to the time-sorted input ROOT file
+	TFile *input_file = nullptr; ///< Pointer to the time-sorted input ROOT file
+	TChain *input_chain = nullptr; ///< Chain of time-sorted input files, when building across files
 	TTree *input_tree; ///< Pointer to the TTree in the data input file
-	GreatDataPackets *in_data = nullptr; ///< Pointer to the TBranch containing the data in the time-sorted input ROOT file
+	GreatDataPackets *in_data = nullptr; ///< Pointer to the TBranch containing the data in the time-sorted input ROOT file, owned here and not by ROOT
+	GreatDataPackets *cur_data = nullptr; ///< Pointer to the current hit, either in_data or from the reorder buffer
+	std::shared_ptr<GreatDataPackets> reorder_data; ///< Holds the current hit when it comes from the reorder buffer
+	std::unique_ptr<GreatReorderBuffer> reorder; ///< Puts nearly time-ordered hits back in order, only if ReorderTolerance > 0 and the converter did not sort them fully
+	unsigned long read_entry; ///< Next entry to read from the input tree
 	std::shared_ptr<GreatCaenData> caen_data; ///< Pointer to a given entry in the tree of some data from the CAEN
 	std::shared_ptr<GreatInfoData> info_data; ///< Pointer to a given entry in the tree of the "info" datatype
 
@@ -128,7 +188,16 @@ private:
 	/// Outputs
 	TFile *output_file; ///< Pointer to the output ROOT file containing events
 	TTree *output_tree; ///< Pointer to the output ROOT tree containing events
+	std::string output_base; ///< Name of the first output file without the extension, used to name the next files after a roll over
+	std::vector<std::string> output_names; ///< All output files written so far
+	unsigned long long n_evts_closed; ///< Number of events written in output files that are already closed
+	TDirectory *output_dir; ///< Base directory for the histograms, the output file itself or a scan_N directory
+
+	// Window scan
+	std::vector<std::unique_ptr<GreatEventBuilder>> scan_eb; ///< Event builders with the other window settings, fed the same hits
+	bool flag_scan = false; ///< True for an event builder of the window scan, writing in to the main output file
 	std::unique_ptr<GreatEvts> write_evts; ///< Container for storing hits on all detectors in order to construct events
+	std::function<void(const GreatEvts&)> event_sink; ///< Receives each event that is built, if set
 	
 	// Do calibration
 	std::shared_ptr<GreatCalibration> cal; ///< Pointer to an GreatCalibration object, used for accessing gain-matching parameters and thresholds
@@ -197,6 +266,11 @@ private:
 	std::vector<short>			hpge_id_list;	///< list of HPGe detectors ids for HPGeFinder
 	std::vector<short>			hpge_seg_list;	///< list of HPGe segments ids for HPGeFinder
 
+	// Coincidence engines
+	GreatCoincidenceFinder		cebr3_coinc;		///< Pairs of CeBr3 hits for CeBr3Finder
+	GreatCoincidenceFinder		hpge_coinc;			///< Pairs of HPGe hits, cores and segments, for HPGeFinder
+	GreatCoincidenceFinder		hpge_core_coinc;	///< Pairs of HPGe cores for HPGeFinder
+
 	// Counters
 	unsigned int		hit_ctr;		///< Counts the number of hits that make up an event within a given file
 	unsigned int		tac_ctr;		///< Counts the number of TAC events within a given file
@@ -205,10 +279,18 @@ private:
 	unsigned long		n_caen_data;	///< Counter for number of caen data packets in a file
 	unsigned long		n_info_data; 	///< Counter for number of info data packets in a file
 	unsigned long long	n_entries; 		///< Number of entries in the time-sorted data input tree
+	unsigned long long	n_evts_built;	///< Counter for number of events with something to write
+	bool				flag_hit_prev;	///< True once a hit has been processed, so there is an event to compare with
+
+	// All histograms, for resetting and merging
+	GreatHistogramSet hist_set;		///< Every histogram of this class and its directory in the output
 
 	// Timing histograms
 	TH1F *tdiff;					///< Histogram containing the time difference between each real (not infodata) signal in the file
 	TH1F *tdiff_clean;				///< Histogram containing the time difference between the real signals *above threshold* (mythres)
+	TH1F *tdiff_trig;				///< Histogram containing the time difference of each hit to the trigger of its event, in the triggered modes
+	TH1F *tdiff_trig_clean;			///< Histogram containing the time difference of the hits *above threshold* to the trigger of their event
+	TH1F *hit_mult;					///< Histogram containing the number of hits in each event
 
 	// TAC histograms
 	std::vector<TH1F*> htac_id; ///< The TAC singles spectra in the MWPC
@@ -216,11 +298,11 @@ private:
 	// GammaRay histograms
 	TH1F *cebr3_E;						///< Sum gamma-ray energy histogram for CeBr3 detectors
 	TH2F *cebr3_E_vs_det;				///< Gamma-ray energy verus detector ID for CeBr3 detectors
-	TH2F *cebr3_cebr3_E;				///< Gamma-gamma matrix, no prompt time condition for CeBr3 detectors
+	std::shared_ptr<GreatSymMatrix> cebr3_cebr3_E;	///< Gamma-gamma matrix, prompt in the CeBr3HitWindow, for CeBr3 detectors
 	TH1F *cebr3_cebr3_td;				///< Gamma-gamma time difference for CeBr3 detectors
 	TH1F *hpge_E;						///< Sum gamma-ray energy histogram for HPGe detectors
 	TH2F *hpge_E_vs_det;				///< Gamma-ray energy verus detector ID for HPGe detectors
-	TH2F *hpge_hpge_E;					///< Gamma-gamma matrix, no prompt time condition for HPGe detectors
+	std::shared_ptr<GreatSymMatrix> hpge_hpge_E;	///< Gamma-gamma matrix, prompt in the HPGeHitWindow, for HPGe detectors
 	TH1F *hpge_hpge_td;					///< Gamma-gamma time difference for HPGe detectors
 	std::vector<TH1F*> hpge_seg_td;		///< Gamma-gamma time difference for HPGe core and segments
 
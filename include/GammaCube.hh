@@ -0,0 +1,143 @@
+#ifndef __GAMMACUBE_HH
+#define __GAMMACUBE_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include <TDirectory.h>
+#include <TTree.h>
+#include <TH1.h>
+#include <TH2.h>
+
+// Compact histogram interface
+#ifndef __COMPACTHIST_HH
+# include "CompactHist.hh"
+#endif
+
+/*!
+* \brief Symmetrised gamma-gamma-gamma coincidence cube with blocked, lazily allocated storage.
+*
+* \details Each triple of energies is sorted so that only one sixth of the cube
+* is stored. That part is split in blocks of kBlockSize^3 cells, indexed as a
+* packed tetrahedron, and a block is only allocated when the first count lands
+* in it. The energy compression is set by the number of bins up to the maximum
+* energy, i.e. the bin width.
+*
+* The cells are 16-bit counters, which is enough for almost all of them. When a
+* cell goes past 65535 it starts again from zero and the multiples of 65536 go
+* in to a second, 32-bit array for its block, which is only allocated when the
+* first cell of the block wraps. Counts and allocations are atomic, so several
+* threads can fill the same cube without locks. Since the counts are integers,
+* the result is the same whatever order the threads fill in. A reset only sets
+* the counts to zero, the memory stays with the cube until it is deleted.
+*
+* The projection, gated matrices and double-gated spectra are made directly
+* from the allocated blocks, without expanding the cube. The blocks are written
+* to a TTree, which ROOT compresses, and can be read back with
+* GreatGammaCube::Read in to a cube with the same binning.
+*/
+
+class GreatGammaCube : public GreatCompactHist {
+
+public:
+
+	GreatGammaCube( std::string name, std::string title,
+					unsigned int nbins, double max ); ///< Constructor
+	~GreatGammaCube(); ///< Destructor
+
+	static const unsigned int kBlockSize = 16; ///< Number of bins along each side of a block
+
+	/// Bin of an energy, or -1 if out of range
+	inline int GetBin( double e ) const {
+		if( e < 0 || e >= max ) return -1;
+		unsigned int bin = (unsigned int)( nbins * e / max );
+		return bin < nbins ? (int)bin : -1;
+	};
+
+	void Fill( double e1, double e2, double e3 ); ///< Adds one triple, safe to call from several threads
+	void FillEvent( const std::vector<float> &energies ); ///< Adds all triples of the energies in one event
+	bool Add( const GreatGammaCube &other ); ///< Adds the counts of another cube with the same binning
+	bool Add( const GreatCompactHist &other ) override; ///< Adds the counts of another cube, for the merge of a GreatHistogramSet
+	std::unique_ptr<GreatCompactHist> CloneEmpty() const override; ///< Empty cube with the same binning
+	inline bool IsThreadSafe() const override { return true; };
+	void Reset() override; ///< Clears all counts in place, keeping the blocks
+
+	TH1D* Projection( std::string hname ) const; ///< Total projection, each triple counted once for each of its energies
+	TH2D* Slice( std::string hname, double lo, double hi ) const; ///< Symmetric matrix of the pairs in coincidence with a gate
+	TH1D* DoubleGate( std::string hname, double lo1, double hi1, double lo2, double hi2 ) const; ///< Spectrum in coincidence with two gates
+
+	TH1* MakeHist() const override; ///< The total projection, owned by the caller
+	void Write( TDirectory *dir ) override; ///< Writes the blocks as a TTree and the projection in to a directory
+	unsigned long long Read( TTree *tree ); ///< Adds the blocks from a TTree made by GreatGammaCube::Write
+	bool AddFrom( TDirectory *dir ) override; ///< Adds the blocks written by GreatGammaCube::Write, if the binning matches
+
+	unsigned long GetNumberOfBlocks() const; ///< Number of blocks allocated so far
+	inline std::string GetName() const override { return name; };
+	inline unsigned long long GetEntries() const override { return entries; };
+	inline unsigned long long GetOutside() const { return outside; };
+	inline double GetBinWidth() const { return max / nbins; };
+
+
+private:
+
+	typedef std::atomic<unsigned short> count_t;	///< Counts of a cell modulo 65536
+	typedef std::atomic<unsigned int> carry_t;		///< Multiples of 65536 of a cell
+	static const unsigned int kCells = kBlockSize*kBlockSize*kBlockSize;	///< Number of cells in a block
+
+	/// Index of the block with block coordinates bi >= bj >= bk
+	inline unsigned long BlockIndex( unsigned long bi, unsigned long bj, unsigned long bk ) const {
+		return bi*(bi+1)*(bi+2)/6 + bj*(bj+1)/2 + bk;
+	};
+
+	count_t* GetBlock( unsigned long b ); ///< Returns the block, allocating it if needed
+	carry_t* GetCarry( unsigned long b ); ///< Returns the carry of a block, allocating it if needed
+	void AddCount( unsigned long b, unsigned int c, unsigned long long n ); ///< Adds n counts to a cell of a block
+
+	/// Counts of a cell, including the carry
+	inline unsigned long long GetCount( unsigned long b, const count_t *blk, unsigned int c ) const {
+		unsigned long long n = blk[c].load( std::memory_order_relaxed );
+		const carry_t *cr = carry[b].load( std::memory_order_acquire );
+		if( cr ) n += (unsigned long long)cr[c].load( std::memory_order_relaxed ) << 16;
+		return n;
+	};
+	bool InGate( unsigned int bin, double lo, double hi ) const; ///< True if the bin centre is inside the gate
+
+	/// Calls fn( i, j, k, counts ) for every cell with counts, with i >= j >= k
+	template<class F> void ForEachCell( F fn ) const {
+		for( unsigned long bi = 0; bi < nblocks; ++bi ) {
+			for( unsigned long bj = 0; bj <= bi; ++bj ) {
+				for( unsigned long bk = 0; bk <= bj; ++bk ) {
+					unsigned long b = BlockIndex( bi, bj, bk );
+					const count_t *blk = blocks[b].load( std::memory_order_acquire );
+					if( !blk ) continue;
+					for( unsigned int c = 0; c < kCells; ++c ) {
+						unsigned long long n = GetCount( b, blk, c );
+						if( !n ) continue;
+						fn( bi*kBlockSize + c/(kBlockSize*kBlockSize),
+						    bj*kBlockSize + (c/kBlockSize)%kBlockSize,
+						    bk*kBlockSize + c%kBlockSize, n );
+					}
+				}
+			}
+		}
+	};
+
+	std::string		name;		///< Name of the tree and base name of the exported histograms
+	std::string		title;		///< Title of the tree and exported histograms
+	unsigned int	nbins;		///< Number of bins along each axis
+	double			max;		///< Upper edge of the last bin, the lower edge of the first is zero
+	unsigned long	nblocks;	///< Number of blocks along each axis
+	unsigned long	nblocks_tot;///< Number of blocks in the packed tetrahedron
+
+	std::unique_ptr<std::atomic<count_t*>[]>	blocks;	///< Packed tetrahedron of blocks, nullptr until used
+	std::unique_ptr<std::atomic<carry_t*>[]>	carry;	///< Carry of each block, nullptr until one of its cells wraps
+	std::atomic<unsigned long long>	entries;	///< Number of triples filled
+	std::atomic<unsigned long long>	outside;	///< Number of triples with at least one energy out of range
+
+};
+
+#endif
@@ -33,7 +33,7 @@ public:
 	inline void SetTime( double t ){ time = t; };
 	inline void SetEnergy( float e ){ energy = e; };
 	inline void SetID( unsigned short i ){ id = i; };
-	inline void SetSegment( unsigned short t ){ type = t; };
+	inline void SetSegment( unsigned short s ){ seg = s; };
 	inline void SetType( unsigned char t ){ type = t; };
 
 	inline double			GetTime() const { return time; };
@@ -64,7 +64,7 @@ public:
 
 	// setup functions
 	inline void		SetTACTime( float t ){ energy = t; };
-	inline float	GetTACTime(){ return energy; };
+	inline float	GetTACTime() const { return energy; };
 
 
 protected:
@@ -115,19 +115,13 @@ public:
 	GreatEvts() {};
 	~GreatEvts() {};
 
-	// Adding different event types
-	void AddEvt( std::shared_ptr<GreatTACEvt> event ){
-		GreatTACEvt fill_evt( *(event.get()) );
-		tac_event.push_back( fill_evt );
-	};
-	void AddEvt( std::shared_ptr<GreatCeBr3Evt> event ){
-		GreatCeBr3Evt fill_evt( *(event.get()) );
-		cebr3_event.push_back( fill_evt );
-	};
-	void AddEvt( std::shared_ptr<GreatHPGeEvt> event ){
-		GreatHPGeEvt fill_evt( *(event.get()) );
-		hpge_event.push_back( fill_evt );
-	};
+	// Adding different event types, copied once in to the list
+	inline void AddEvt( const GreatTACEvt &event ){ tac_event.push_back( event ); };
+	inline void AddEvt( const GreatCeBr3Evt &event ){ cebr3_event.push_back( event ); };
+	inline void AddEvt( const GreatHPGeEvt &event ){ hpge_event.push_back( event ); };
+	inline void AddEvt( std::shared_ptr<GreatTACEvt> event ){ AddEvt( *event ); };
+	inline void AddEvt( std::shared_ptr<GreatCeBr3Evt> event ){ AddEvt( *event ); };
+	inline void AddEvt( std::shared_ptr<GreatHPGeEvt> event ){ AddEvt( *event ); };
 
 	inline unsigned int GetTACMultiplicity() const { return tac_event.size(); };
 	inline unsigned int GetGammaRayMultiplicity() const {
@@ -153,6 +147,15 @@ public:
 		else return nullptr;
 	};
 
+	// Access without copies, for loops over many events. Not range checked,
+	// so the index must be below the multiplicity
+	inline const GreatTACEvt& GetTACEvtRef( unsigned int i ) const { return tac_event[i]; };
+	inline const GreatCeBr3Evt& GetCeBr3EvtRef( unsigned int i ) const { return cebr3_event[i]; };
+	inline const GreatHPGeEvt& GetHPGeEvtRef( unsigned int i ) const { return hpge_event[i]; };
+	inline const std::vector<GreatTACEvt>& GetTACEvts() const { return tac_event; };
+	inline const std::vector<GreatCeBr3Evt>& GetCeBr3Evts() const { return cebr3_event; };
+	inline const std::vector<GreatHPGeEvt>& GetHPGeEvts() const { return hpge_event; };
+
 	void ClearEvt(){
 		std::vector<GreatTACEvt>().swap(tac_event);
 		std::vector<GreatCeBr3Evt>().swap(cebr3_event);
@@ -171,5 +174,24 @@ protected:
 
 };
 
+/// Calls fn( a, b ) for every pair of different events in a list, each pair once
+/// \param[in] list The events, e.g. GreatEvts::GetCeBr3Evts()
+/// \param[in] fn Called with const references, nothing is copied
+template<class T, class F> inline void ForEachPair( const std::vector<T> &list, F fn ){
+	for( auto a = list.begin(); a != list.end(); ++a )
+		for( auto b = a + 1; b != list.end(); ++b )
+			fn( *a, *b );
+};
+
+/// Calls fn( a, b ) for every combination of an event from each of two lists
+/// \param[in] first The events passed as a, e.g. GreatEvts::GetCeBr3Evts()
+/// \param[in] second The events passed as b, e.g. GreatEvts::GetTACEvts()
+/// \param[in] fn Called with const references, nothing is copied
+template<class T, class U, class F> inline void ForEachPair( const std::vector<T> &first, const std::vector<U> &second, F fn ){
+	for( auto a = first.begin(); a != first.end(); ++a )
+		for( auto b = second.begin(); b != second.end(); ++b )
+			fn( *a, *b );
+};
+
 #endif
 
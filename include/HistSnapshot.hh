@@ -0,0 +1,117 @@
+#ifndef __HISTSNAPSHOT_HH
+#define __HISTSNAPSHOT_HH
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+#include <TH1.h>
+#include <TDirectory.h>
+#include <THttpServer.h>
+
+// Histogram set header
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
+/*!
+* \brief Copies of the monitor histograms for the web server, so it never reads one that is being filled.
+*
+* \details The THttpServer used to scan the monitor files and serialise the
+* same histograms that the monitor thread fills. Here, the thread that fills
+* the histograms publishes a copy of them every so often instead, and only the
+* copies are registered in the server. Each histogram has two copies: the one
+* the server shows, and a spare one. A new snapshot is copied in to the spare
+* ones without any lock, then the two are swapped in the server under a short
+* lock, which is also held by GreatHistSnapshot::ProcessRequests while the
+* server answers its requests. The fill path therefore never waits for a
+* client, and a client only waits for the swap, never for the copy.
+*
+* The compact histograms of a set have no ROOT histogram of their own, so their
+* copies are made with GreatCompactHist::MakeHist and refilled with
+* GreatCompactHist::CopyTo. Those that were never filled are not shown.
+*
+* The time taken by each copy and each swap is kept, so the cost of the
+* snapshots can be checked against the period.
+*
+* A reset asked for from the web page is only done by the thread that fills
+* the histograms, the next time it publishes, see GreatHistSnapshot::TakeReset.
+*/
+
+class GreatHistSnapshot {
+
+public:
+
+	GreatHistSnapshot( THttpServer *myserv, double period ); ///< Constructor
+	~GreatHistSnapshot(); ///< Destructor, takes the copies out of the server
+
+	void Add( GreatHistogramSet *set, std::string folder );	///< Adds all histograms of a set, now and after it is booked again
+	void Add( TH1 *h, std::string folder );	///< Adds a single histogram
+
+	bool Publish( bool force = false );	///< Copies and swaps in a new snapshot if one is due, from the thread that fills the histograms
+	void PrintCost( std::string name );	///< Prints the time taken by the snapshots
+
+	/// Asks the thread that fills the histograms to reset them, e.g. from the web page
+	inline void RequestReset(){ flag_reset = true; };
+
+	/// \return true once after GreatHistSnapshot::RequestReset, for the thread that fills the histograms
+	inline bool TakeReset(){ return flag_reset.exchange( false ); };
+
+	inline unsigned long long GetNumberOfSnapshots() const { return n_publish; };
+	inline unsigned int GetNumberOfHists() const { return n_hists; };
+	inline double GetLastCopyTime() const { return copy_last; };	///< in ms
+	inline double GetMaxCopyTime() const { return copy_max; };		///< in ms
+	inline double GetMaxSwapTime() const { return swap_max; };		///< in ms
+
+	static void ProcessRequests( THttpServer *serv );	///< Answers the web requests, in between two swaps
+
+
+private:
+
+	/// The two copies of one histogram
+	struct copy_t {
+		TH1						*source = nullptr;	///< Histogram that was copied, to notice when it is booked again
+		const GreatCompactHist	*compact = nullptr;	///< Compact histogram that was copied, in the same way
+		std::string				folder;				///< Folder in the server
+		std::unique_ptr<TH1>	front;				///< Copy registered in the server
+		std::unique_ptr<TH1>	back;				///< Spare copy for the next snapshot
+		bool					flag_new = false;	///< True if back has been filled and should be swapped in
+	};
+
+	/// Something to publish, a histogram set or a histogram
+	struct source_t {
+		GreatHistogramSet				*set = nullptr;
+		TH1								*hist = nullptr;
+		std::string						folder;		///< Folder in the server, the set adds its directories
+		std::vector<copy_t>				copies;		///< One per histogram of the source, the compact ones last
+	};
+
+	void Copy( copy_t &c, TH1 *h, std::string folder );	///< Fills the spare copy
+	void Copy( copy_t &c, const GreatCompactHist *h, std::string folder );	///< Fills the spare copy of a compact histogram
+	void Swap( copy_t &c );	///< Registers the spare copy in place of the one shown, with the lock held
+	void Drop( copy_t &c );	///< Takes both copies out of the server, with the lock held
+
+	static std::mutex	serv_mutex;		///< Held while the server answers requests and during the swaps
+
+	THttpServer				*serv;
+	std::vector<source_t>	sources;
+	double					period;			///< Time in s between two snapshots
+	std::chrono::steady_clock::time_point	last;	///< Time of the last snapshot
+	std::atomic<bool>		flag_reset;		///< A reset was asked for
+
+	// Cost of the snapshots, written by the thread that publishes and printed by another
+	std::atomic<unsigned long long>	n_publish;	///< Number of snapshots
+	std::atomic<unsigned int>		n_hists;	///< Histograms in the last snapshot
+	std::atomic<double>				copy_last;	///< Time taken by the last copy in ms
+	std::atomic<double>				copy_max;	///< Longest copy in ms
+	std::atomic<double>				copy_sum;	///< Time taken by all copies in ms
+	std::atomic<double>				swap_max;	///< Longest time the server was locked in ms
+
+};
+
+#endif
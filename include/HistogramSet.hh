@@ -0,0 +1,99 @@
+#ifndef __HISTOGRAMSET_HH
+#define __HISTOGRAMSET_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <TDirectory.h>
+#include <TH1.h>
+
+// Compact histogram interface
+#ifndef __COMPACTHIST_HH
+# include "CompactHist.hh"
+#endif
+
+/*!
+* \brief A list of histograms of one stage of the sort that can be cloned, reset and merged.
+*
+* \details Each stage (GreatConverter, GreatEventBuilder, GreatHistogrammer)
+* books its histograms through a GreatHistogramSet, along with the name of the
+* directory they belong to in the output file. The set then provides the reset
+* for ResetHists, and the merge of the histograms filled by parallel workers.
+*
+* A set without a base directory is detached: its histograms do not belong to
+* any file and are owned by the set. This is what a worker uses, so that it can
+* fill its own copy without any locks. The main set then merges the workers in
+* a fixed order, histogram by histogram in the order they were booked, so the
+* result does not depend on how the threads were scheduled.
+*
+* The compact histograms (see GreatCompactHist) are booked in the same way and
+* kept in their own list. They are reset and merged with the others, but they
+* are only written when GreatHistogramSet::WriteCompact is called, since they
+* do not belong to a directory. Those that are safe to fill from several
+* threads can be shared by the workers instead of copied, see
+* GreatHistogramSet::Clone.
+*/
+
+class GreatHistogramSet {
+
+public:
+
+	GreatHistogramSet(){};	///< Constructor, detached until GreatHistogramSet::SetDirectory is called
+	~GreatHistogramSet(){};	///< Destructor, deletes the histograms only if detached
+
+	void SetDirectory( TDirectory *dir );	///< Base directory in the output file, nullptr for a detached set
+	TDirectory* MakeDirectory( std::string dirname );	///< Makes and moves in to a directory below the base
+	void Clear();	///< Forgets all histograms, before booking them again
+
+	/// Adds a histogram to the set and returns it, so it can wrap the new
+	/// \param[in] h The histogram, of any type derived from TH1
+	/// \param[in] dirname The directory of the histogram, relative to the base
+	template<class T> inline T* Book( T *h, std::string dirname ){
+		Register( h, dirname );
+		return h;
+	};
+	void Register( TH1 *h, std::string dirname );	///< Adds a histogram to the set
+
+	/// Adds a compact histogram to the set and returns it
+	/// \param[in] c The compact histogram, e.g. a GreatSpectrum
+	/// \param[in] dirname The directory it is written in to, relative to the base
+	template<class T> inline std::shared_ptr<T> Book( std::shared_ptr<T> c, std::string dirname ){
+		Register( std::static_pointer_cast<GreatCompactHist>( c ), dirname );
+		return c;
+	};
+	void Register( std::shared_ptr<GreatCompactHist> c, std::string dirname );	///< Adds a compact histogram to the set
+
+	void Reset();	///< Empties all histograms, used by ResetHists
+	bool Merge( const GreatHistogramSet &other );	///< Adds the histograms of another set with the same booking
+	std::unique_ptr<GreatHistogramSet> Clone( bool share = false ) const;	///< Detached copy with the same histograms, but empty
+	void WriteTo( TDirectory *dir ) const;	///< Writes all histograms in their directories below dir
+	bool AddFrom( TDirectory *dir );	///< Adds the histograms found below dir, as written by GreatHistogramSet::WriteTo
+	void WriteCompact();	///< Writes the compact histograms that were filled in to their directories below the base
+
+	inline unsigned int GetSize() const { return hists.size(); };
+	inline TH1* GetHist( unsigned int i ) const { return i < hists.size() ? hists[i] : nullptr; };
+	inline std::string GetDirName( unsigned int i ) const { return i < dirs.size() ? dirs[i] : ""; };
+	inline unsigned int GetNumberOfCompact() const { return compact.size(); };
+	inline std::shared_ptr<GreatCompactHist> GetCompact( unsigned int i ) const { return i < compact.size() ? compact[i] : nullptr; };
+	inline std::string GetCompactDirName( unsigned int i ) const { return i < compact_dirs.size() ? compact_dirs[i] : ""; };
+	inline bool IsDetached() const { return base == nullptr; };
+
+
+private:
+
+	static TDirectory* GetSubDirectory( TDirectory *dir, std::string dirname, bool create );	///< dir itself for an empty name
+
+	static bool SameBinning( TH1 *a, TH1 *b );	///< True if two histograms have the same axes
+
+	TDirectory					*base = nullptr;	///< Base directory, nullptr if detached
+	std::vector<TH1*>			hists;				///< All histograms in the order they were booked
+	std::vector<std::string>	dirs;				///< Directory of each histogram relative to the base
+	std::vector<std::unique_ptr<TH1>>	owned;		///< Histograms owned by a detached set
+	std::vector<std::shared_ptr<GreatCompactHist>>	compact;	///< Compact histograms in the order they were booked
+	std::vector<std::string>	compact_dirs;		///< Directory of each compact histogram relative to the base
+
+};
+
+#endif
@@ -8,6 +8,13 @@
 #include <vector>
 #include <memory>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <iterator>
 
 #include <TFile.h>
 #include <TTree.h>
@@ -20,6 +27,9 @@
 #include <TCutG.h>
 #include <TGProgressBar.h>
 #include <TSystem.h>
+#include <TROOT.h>
+#include <TEnv.h>
+#include <TTreeCache.h>
 
 
 // Reaction header
@@ -37,6 +47,21 @@
 # include "Settings.hh"
 #endif
 
+// Histogram set
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
+// Gamma-gamma-gamma cube
+#ifndef __GAMMACUBE_HH
+# include "GammaCube.hh"
+#endif
+
+// User histograms from a definition file
+#ifndef __USERHISTS_HH
+# include "UserHists.hh"
+#endif
+
 
 // Compiler switch for the pside only histogramming
 // uncomment the line below to ignore the p/n coincidences
@@ -53,16 +78,28 @@ public:
 	void MakeHists();
 	void ResetHists();
 	unsigned long FillHists();
+	unsigned long FillHistsCached( std::vector<std::string> input_file_names );
+	void FillOnline( const GreatEvts &evts );	///< Fills one event as it is built, from a single thread
 	
 	void SetInputFile( std::vector<std::string> input_file_names );
 	void SetInputFile( std::string input_file_name );
 	void SetInputTree( TTree* user_tree );
 
+	/// Number of threads used by FillHists, each with its own chain of the input files.
+	/// For more than one, ROOT::EnableThreadSafety() has to be called at start-up.
+	inline void SetThreads( unsigned int n ){
+		n_threads = n > 0 ? n : 1;
+	};
+	inline unsigned int GetThreads(){ return n_threads; };
+
+	static const unsigned long kChunkSize = 50000;	///< Number of events in each chunk, independent of the number of threads
+
 	inline void SetOutput( std::string output_file_name ){
 		output_file = new TFile( output_file_name.data(), "recreate" );
 		MakeHists();
 	};
 	inline void CloseOutput(){
+		hist_set.WriteCompact();
 		PurgeOutput();
 		output_file->Close();
 		//input_tree->ResetBranchAddresses();
@@ -70,6 +107,11 @@ public:
 	inline void PurgeOutput(){ output_file->Purge(2); }
 
 	inline TFile* GetFile(){ return output_file; };
+	inline GreatHistogramSet& GetHistogramSet(){ return hist_set; };
+	inline std::shared_ptr<GreatGammaCube> GetGammaCube(){ return gamma_cube; };
+
+	/// Histograms from a definition file, must be set before SetOutput
+	inline void SetUserHists( std::shared_ptr<GreatUserHists> myuser ){ user_hists = myuser; };
 	
 	inline void AddProgressBar( std::shared_ptr<TGProgressBar> myprog ){
 		prog = myprog;
@@ -84,16 +126,49 @@ private:
 	
 	// Settings file
 	std::shared_ptr<GreatSettings> set;
-	
+	/// Histograms filled by one thread, a worker with its chunk or the main thread with the whole input
+	struct hist_fill_t {
+		TH1F *gamma_gamma_td;				///< Time difference between gamma rays
+		TH1F *gamma_tac_td;					///< Time difference between gamma rays and TACs
+		GreatGammaCube *cube;				///< Gamma-gamma-gamma cube, shared by all workers
+		std::vector<float> cube_energies;	///< Energies of the cube detectors in the current event
+		std::vector<TH1*> user;				///< User histograms, one per kernel
+		GreatUserHists::scratch_t user_scratch;	///< Hit lists for the user kernels
+	};
+	hist_fill_t MakeFill( GreatHistogramSet &hs );
+	void FillEvent( const GreatEvts *evts, hist_fill_t &fill );
+	hist_fill_t online_fill;	///< Histograms of the main set, for FillOnline
+	std::unique_ptr<GreatHistogramSet> FillChunk( const GreatHistogramSet &target, TChain *chain, GreatEvts *&evts, unsigned long chunk );
+	void UpdateProgress( unsigned long n_done );
+	unsigned long FillSet( GreatHistogramSet &target );
+	void ConfigureInput( TChain *chain );
+	double CacheEfficiency( TChain *chain );
+	std::shared_ptr<GreatGammaCube> MakeCube();
+
+	// Histogram cache, one per events file
+	static const unsigned long long kFNVOffset = 14695981039346656037ULL;	///< Start value of the FNV-1a hash
+	static const unsigned int kCacheVersion = 2;	///< Format of the cache files and of the histograms in them, raise it when either changes
+	static unsigned long long HashBytes( unsigned long long h, const void *data, unsigned long len );
+	std::string CacheKey( std::string input_file_name );
+	std::string CacheName( std::string input_file_name );
+	bool LoadCache( std::string cache_name, std::string key );
+	void WriteCache( std::string cache_name, std::string key, const GreatHistogramSet &partial );
+
 	/// Input tree
-	TChain *input_tree;
+	TChain *input_tree = nullptr;
+	std::vector<std::string> input_names;	///< Input files, so that each worker can open its own chain
+	bool flag_own_input = false;			///< The input chain was made here and can be deleted
 	GreatEvts *read_evts = nullptr;
 	std::shared_ptr<GreatTACEvt> tac_evt;
 	std::shared_ptr<GreatGammaRayEvt> gamma_evt;
 	
 	/// Output file
-	TFile *output_file;
+	TFile *output_file = nullptr;
 	
+	// Threads
+	unsigned int n_threads = 1;
+	std::mutex clone_mutex;	///< Cloning histograms is not thread safe
+
 	// Progress bar
 	bool _prog_;
 	std::shared_ptr<TGProgressBar> prog;
@@ -104,9 +179,18 @@ private:
 	//------------//
 	// Histograms //
 	//------------//
+	GreatHistogramSet hist_set;
 	
-	// Timing
-	TH1F *gamma_gamma_td, *gamma_tac_td;
+	// Timing, position in the set
+	unsigned int idx_gamma_gamma_td, idx_gamma_tac_td;
+
+	// Gamma-gamma-gamma cube, part of the set but shared by the workers since it is safe to fill from all threads
+	std::shared_ptr<GreatGammaCube> gamma_cube;
+	unsigned int idx_gamma_cube;	///< Position in the compact histograms of the set
+	bool flag_cube_cebr3 = false;	///< CeBr3 detectors in the cube, otherwise HPGe
+
+	// User histograms, part of the set
+	std::shared_ptr<GreatUserHists> user_hists;
 
 	
 };
@@ -0,0 +1,153 @@
+#ifndef __METRICS_HH
+#define __METRICS_HH
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+
+#include <TH1.h>
+#include <TH1F.h>
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Converter header
+#ifndef __CONVERTER_HH
+# include "Converter.hh"
+#endif
+
+// DataSpy streams
+#ifndef __SPYSTREAMS_HH
+# include "SpyStreams.hh"
+#endif
+
+// Online pipeline header
+#ifndef __ONLINEPIPELINE_HH
+# include "OnlinePipeline.hh"
+#endif
+
+// Histogram set header
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
+/*!
+* \brief Live throughput and latency of the online sort, as histograms and as a plain text page.
+*
+* \details The monitor calls GreatMetrics::Sample once per update. It takes
+* the counters of the DataSpy streams, the converter and the online pipeline,
+* if there are any, works out the rates since the last sample and keeps:
+* - the data rate in blocks/s and MB/s, the hit rate of each CAEN module and
+*   the event rate, with a history of the last MetricsHistory samples
+* - the depth of the queue in front of each pipeline stage, or the hits held
+*   back for time ordering in the classic monitor loop
+* - the lost DataSpy buffers and the decode errors
+* - the latency from reading a block to filling the histograms with its events
+*
+* The histograms belong to a detached GreatHistogramSet, so they can be shown
+* through a GreatHistSnapshot like the other monitor histograms. The same
+* numbers are written as a plain text page in the Prometheus format, which a
+* scraper or a browser can read, together with the stage that holds up the
+* others.
+*
+* The monitor loop counts the blocks and events itself when there is no
+* DataSpy or no pipeline. GreatMetrics::AddLatency can be called from any
+* thread, the rest only from the thread that calls GreatMetrics::Sample.
+*/
+
+class GreatMetrics {
+
+public:
+
+	GreatMetrics( std::shared_ptr<GreatSettings> myset );	///< Constructor
+	~GreatMetrics(){};	///< Destructor
+
+	// Where the counters come from
+	inline void SetConverter( std::shared_ptr<GreatConverter> myconv ){ conv = myconv; };
+	inline void SetSpyStreams( GreatSpyStreams *myspy ){ spy = myspy; };
+	inline void SetPipeline( GreatOnlinePipeline *mypipe ){ pipe = mypipe; };
+
+	void AddBlocks( unsigned long n, unsigned long long bytes );	///< Blocks read, if there is no DataSpy
+	void AddEvents( unsigned long n );	///< Events built, if there is no pipeline
+	void AddLatency( double ms );	///< Time from reading a block to filling its events, from any thread
+
+	void Sample();	///< Takes the counters and works out the rates since the last sample
+	std::string GetText();	///< The last sample as a plain text page
+	bool WriteText( std::string filename );	///< Replaces the text page in one go
+
+	inline GreatHistogramSet& GetHistogramSet(){ return hist_set; };
+	inline std::string GetBottleneck() const { return bottleneck; };
+
+
+private:
+
+	void Shift( TH1 *h, double value );	///< Adds the latest value at the end of a history
+
+	static constexpr unsigned int kLatencyBins = 50;	///< Bins of the latency from 1 ms to 100 s
+	static constexpr double kLatencyMin = 1.0;		///< in ms
+	static constexpr double kLatencyMax = 1.0e5;	///< in ms
+
+	std::shared_ptr<GreatSettings>	set;
+	std::shared_ptr<GreatConverter>	conv;
+	GreatSpyStreams					*spy = nullptr;
+	GreatOnlinePipeline				*pipe = nullptr;
+
+	// Counted by the monitor loop
+	unsigned long long	n_blocks = 0;	///< Blocks read without a DataSpy
+	unsigned long long	n_bytes = 0;	///< Bytes read without a DataSpy
+	unsigned long long	n_events = 0;	///< Events built without a pipeline
+
+	// Latency, from any thread
+	std::atomic<unsigned long long>	lat_counts[kLatencyBins+2];	///< Blocks in each latency bin, with under and overflow
+	std::atomic<unsigned long long>	lat_n{0};		///< Latencies measured
+	std::atomic<unsigned long long>	lat_sum{0};		///< Sum of the latencies in µs
+	std::atomic<unsigned long long>	lat_max{0};		///< Longest latency in µs since the last sample
+
+	// Counters at the last sample
+	std::chrono::steady_clock::time_point	last;
+	unsigned long long	last_blocks = 0;
+	unsigned long long	last_bytes = 0;
+	unsigned long long	last_events = 0;
+	unsigned long long	last_lost = 0;
+	unsigned long long	last_lat_n = 0;
+	unsigned long long	last_lat_sum = 0;
+	std::vector<unsigned long long>	last_hits;
+
+	// Values of the last sample
+	double				blocks_rate = 0;	///< Blocks/s
+	double				bytes_rate = 0;		///< Bytes/s
+	double				events_rate = 0;	///< Events/s
+	std::vector<double>	hits_rate;			///< Hits/s on each CAEN module
+	unsigned long long	lost = 0;			///< Lost DataSpy buffers in total
+	double				lost_rate = 0;		///< Lost DataSpy buffers/s
+	unsigned long long	errors = 0;			///< Decode errors in total
+	double				lat_mean = 0;		///< Mean latency in ms
+	double				lat_last_max = 0;	///< Longest latency in ms
+	std::vector<unsigned int>	depth;		///< Depth of the queue in front of each stage
+	unsigned long		tail = 0;			///< Hits held back for time ordering
+	std::string			bottleneck;			///< Stage that the others wait for, if any
+
+	// Histograms
+	GreatHistogramSet	hist_set;
+	TH1F				*h_blocks;
+	TH1F				*h_bytes;
+	TH1F				*h_events;
+	TH1F				*h_lat_mean;
+	TH1F				*h_hits;
+	TH1F				*h_depth;
+	TH1F				*h_latency;
+	TH1F				*h_counters;
+
+};
+
+#endif
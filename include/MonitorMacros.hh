@@ -31,3 +31,9 @@ int StartMonitor(){
 	return 0;
 }
 
+int EndMonitor(){
+	end_monitor();
+	std::cout << "End monitoring, writing the histograms" << std::endl;
+	return 0;
+}
+
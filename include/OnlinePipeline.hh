@@ -0,0 +1,225 @@
+#ifndef __ONLINEPIPELINE_HH
+#define __ONLINEPIPELINE_HH
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <deque>
+#include <limits>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Converter header
+#ifndef __CONVERTER_HH
+# include "Converter.hh"
+#endif
+
+// EventBuilder header
+#ifndef __EVENTBUILDER_HH
+# include "EventBuilder.hh"
+#endif
+
+// Histogrammer header
+#ifndef __HISTOGRAMMER_HH
+# include "Histogrammer.hh"
+#endif
+
+// DataSpy streams
+#ifndef __SPYSTREAMS_HH
+# include "SpyStreams.hh"
+#endif
+
+// Ring buffer
+#ifndef __RINGBUFFER_HH
+# include "RingBuffer.hh"
+#endif
+
+// Rolling spectra
+#ifndef __ROLLINGSPECTRA_HH
+# include "RollingSpectra.hh"
+#endif
+
+// Snapshots for the web server
+#ifndef __HISTSNAPSHOT_HH
+# include "HistSnapshot.hh"
+#endif
+
+/*!
+* \brief Online sort with every step on its own thread, for low latency monitoring.
+*
+* \details The classic monitor converts, sorts, builds and histograms the data
+* one step after the other and then sleeps. The pipeline runs the same steps
+* at the same time instead, each stage on its own thread:
+* - decode: takes the blocks of all GreatSpyStreams and converts them
+* - order: merges the streams and puts the hits back in time order with a
+*   GreatReorderBuffer, up to the watermark of the slowest stream
+* - build: streams the hits through GreatEventBuilder::ProcessData
+* - histogram: fills the physics histograms with GreatHistogrammer::FillOnline
+*
+* The stages pass batches of hits or events to each other through bounded
+* GreatRingBuffer queues. A stage that finds the next queue full waits for it,
+* so a slow stage holds back the ones before it down to the DataSpy reader,
+* which counts any buffers lost as a result. The depth of each queue and the
+* number of waits are kept for every stage.
+*
+* Each stage is the only thread that fills its own histograms, and it syncs
+* the compact spectra and matrices regularly so the web server sees them.
+*/
+
+class GreatOnlinePipeline {
+
+public:
+
+	GreatOnlinePipeline( std::shared_ptr<GreatSettings> myset,
+						 std::shared_ptr<GreatConverter> myconv,
+						 std::shared_ptr<GreatEventBuilder> myeb,
+						 std::shared_ptr<GreatHistogrammer> myhist,
+						 GreatSpyStreams *myspy ); ///< Constructor
+	~GreatOnlinePipeline(); ///< Destructor, stops the stages
+
+	void Start();	///< Starts all stages
+	void Stop();	///< Stops reading and waits until all data has gone through every stage
+	void PrintMetrics();	///< Prints the counters of each stage
+
+	/// Stages, in the order the data goes through them
+	enum stage_t {
+		kDecode = 0,
+		kOrder = 1,
+		kBuild = 2,
+		kHist = 3,
+		kNumberOfStages = 4
+	};
+
+	/// Counters of one stage, updated by its thread and safe to read from any other
+	struct stage_metrics_t {
+		std::atomic<unsigned long long> n_in{0};		///< Items taken from the input (blocks, hits or events)
+		std::atomic<unsigned long long> n_out{0};		///< Items passed to the next stage
+		std::atomic<unsigned long long> n_full{0};		///< Waits because the next queue was full
+		std::atomic<unsigned long long> n_empty{0};		///< Waits because the input was empty
+		std::atomic<unsigned int> depth{0};				///< Depth of the input queue at the last read
+		std::atomic<unsigned int> max_depth{0};			///< Largest depth of the input queue
+	};
+	inline const stage_metrics_t& GetMetrics( stage_t s ) const { return metrics[s]; };
+	static std::string GetStageName( stage_t s );
+	inline bool IsRunning() const { return running; };
+
+	/// Rolling views of the spectra filled by a stage, updated by its thread
+	/// \param[in] s The stage filling the spectra, only kDecode and kHist fill any
+	/// \param[in] r The rolling spectra, or nullptr for none
+	inline void SetRolling( stage_t s, GreatRollingSpectra *r ){ rolling[s] = r; };
+
+	/// Snapshots of the histograms of a stage, published and reset by its thread
+	/// \param[in] s The stage filling the histograms, kDecode, kBuild or kHist
+	/// \param[in] snap The snapshots, or nullptr for none
+	inline void SetSnapshot( stage_t s, GreatHistSnapshot *snap ){ snapshot[s] = snap; };
+
+	/// Called by the histogram stage after each batch of events
+	/// \param[in] sink Takes the time in ms from reading the block to filling its events, or nullptr for none
+	inline void SetLatencySink( std::function<void(double)> sink ){ latency_sink = sink; };
+
+
+private:
+
+	typedef std::vector<std::shared_ptr<GreatDataPackets>> packet_batch_t;
+
+	/// Hits of one block, with the time up to which all streams had arrived after it
+	struct decoded_batch_t {
+		packet_batch_t	packets;	///< Hits in the order of the DAQ
+		double			watermark;	///< See GreatSpyStreams::GetWatermark
+		std::chrono::steady_clock::time_point	read_time;	///< When the block was read from the shared memory
+	};
+
+	/// Hits in time order, with about the oldest block they came from
+	struct ordered_batch_t {
+		packet_batch_t	packets;	///< Hits in time order
+		std::chrono::steady_clock::time_point	read_time;	///< When the oldest block still being ordered was read
+	};
+
+	/// Block that may still have hits waiting to be put in order
+	struct held_block_t {
+		double									time_max;	///< Time of its latest hit that went in to the buffer
+		std::chrono::steady_clock::time_point	read_time;	///< When the block was read from the shared memory
+	};
+
+	/// Events, with about the oldest block they came from
+	struct event_batch_t {
+		std::vector<GreatEvts>	events;	///< Events in the order they were closed
+		std::chrono::steady_clock::time_point	read_time;	///< When the block of the first hits was read
+	};
+
+	void RunDecode();	///< Decode stage
+	void RunOrder();	///< Order stage
+	void RunBuild();	///< Build stage
+	void RunHist();		///< Histogram stage
+
+	static void Backoff( unsigned int &n_idle );	///< Spins and then sleeps for longer and longer
+	bool IsSyncDue( std::chrono::steady_clock::time_point &last );	///< True once every sync period
+
+	/// Waits for space in the next queue
+	/// \param[in] ring The queue to the next stage
+	/// \param[in] item The item, moved in to the queue
+	/// \param[in] s The stage that is pushing
+	template<class T> void Push( GreatRingBuffer<T> &ring, T &item, stage_t s ){
+		unsigned int n_idle = 0;
+		while( !ring.TryPush( item ) ) {
+			metrics[s].n_full++;
+			Backoff( n_idle );
+		}
+	};
+
+	/// Waits for the next item from the previous stage
+	/// \param[in] ring The queue from the previous stage
+	/// \param[out] item The next item
+	/// \param[in] s The stage that is reading
+	/// \return false once the previous stage has finished and its queue is empty
+	template<class T> bool Pop( GreatRingBuffer<T> &ring, T &item, stage_t s ){
+		unsigned int n_idle = 0;
+		while( true ) {
+			unsigned int depth = ring.GetDepth();
+			if( ring.TryPop( item ) ) {
+				metrics[s].depth = depth;
+				if( depth > metrics[s].max_depth ) metrics[s].max_depth = depth;
+				return true;
+			}
+			if( done[s-1] ) return ring.TryPop( item );
+			metrics[s].n_empty++;
+			Backoff( n_idle );
+		}
+	};
+
+	// Steps of the sort and the data source
+	std::shared_ptr<GreatSettings>		set;
+	std::shared_ptr<GreatConverter>		conv;
+	std::shared_ptr<GreatEventBuilder>	eb;
+	std::shared_ptr<GreatHistogrammer>	hist;
+	GreatSpyStreams						*spy;
+
+	// Queues between the stages
+	GreatRingBuffer<decoded_batch_t>	decoded;	///< decode to order
+	GreatRingBuffer<ordered_batch_t>	ordered;	///< order to build
+	GreatRingBuffer<event_batch_t>	built;		///< build to histogram
+	event_batch_t					event_out;	///< Events of the current batch, only used by the build stage
+	std::function<void(double)>		latency_sink;	///< See GreatOnlinePipeline::SetLatencySink
+
+	// Threads
+	std::vector<std::thread>	threads;					///< One per stage
+	std::atomic<bool>			running;					///< False when the decode stage should stop reading
+	std::atomic<bool>			done[kNumberOfStages];		///< True once a stage has passed on all its data
+	stage_metrics_t				metrics[kNumberOfStages];	///< Counters of each stage
+	GreatRollingSpectra			*rolling[kNumberOfStages];	///< Rolling views of the spectra of each stage, if any
+	GreatHistSnapshot			*snapshot[kNumberOfStages];	///< Snapshots of the histograms of each stage, if any
+	double						sync_period;				///< Time in s between syncs of the histograms
+
+};
+
+#endif
@@ -0,0 +1,94 @@
+#ifndef __REORDERBUFFER_HH
+#define __REORDERBUFFER_HH
+
+#include <iostream>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <cfloat>
+#include <algorithm>
+
+// Data packets header
+#ifndef __DATAPACKETS_HH
+# include "DataPackets.hh"
+#endif
+
+/*!
+* \brief Bounded buffer that puts nearly time-ordered data packets back in order.
+*
+* \details Data packets are added as they come and held in a time-ordered heap.
+* The earliest packet is only released once a packet later than it by more
+* than the tolerance has been seen, or when the buffer is full. Packets that
+* arrive later than the tolerance, i.e. earlier in time than a packet that was
+* already released, cannot be put back in order and are dropped.
+*
+* A tolerance of zero still passes everything through in the order it came,
+* except for dropping packets that went back in time.
+*/
+
+class GreatReorderBuffer {
+
+public:
+
+	GreatReorderBuffer( double tolerance, unsigned int max_size ); ///< Constructor
+	~GreatReorderBuffer(){}; ///< Destructor
+
+	bool Add( std::shared_ptr<GreatDataPackets> packet ); ///< Add a packet, returns false if it had to be dropped
+	std::shared_ptr<GreatDataPackets> Next(); ///< Release the earliest packet
+
+	/// True when the earliest packet can be released safely
+	inline bool IsReady() const {
+		if( heap.empty() ) return false;
+		if( heap.size() >= max_size ) return true;
+		return heap.top().time < std::min( time_max, watermark ) - tolerance;
+	};
+
+	/// Holds back packets later than this as well, e.g. while other streams have not caught up
+	/// \param[in] t The time in ns up to which all the input has arrived
+	inline void SetWatermark( double t ){ watermark = t; };
+	inline bool IsEmpty() const { return heap.empty(); };
+	inline unsigned int GetSize() const { return heap.size(); };
+
+	void Clear(); ///< Empty the buffer and reset the counters
+
+	inline unsigned long GetReordered() const { return ctr_reordered; };
+	inline unsigned long GetDropped() const { return ctr_dropped; };
+	inline unsigned int GetMaxDepth() const { return max_depth; };
+	inline double GetTolerance() const { return tolerance; };
+
+
+private:
+
+	/// Packet with its time cached for the heap
+	struct reorder_item_t {
+		double								time;	///< time of the packet
+		unsigned long						seq;	///< arrival order to keep ties stable
+		std::shared_ptr<GreatDataPackets>	packet;	///< the data itself
+	};
+
+	/// Puts the earliest item at the top of the heap
+	struct reorder_compare_t {
+		bool operator()( const reorder_item_t &lhs, const reorder_item_t &rhs ) const {
+			if( lhs.time == rhs.time ) return lhs.seq > rhs.seq;
+			return lhs.time > rhs.time;
+		};
+	};
+
+	std::priority_queue<reorder_item_t,std::vector<reorder_item_t>,reorder_compare_t> heap; ///< Time-ordered packets waiting to be released
+
+	double			tolerance;		///< How late a packet can be, in ns
+	unsigned int	max_size;		///< Maximum number of packets held before they are released anyway
+	double			time_max;		///< Latest time seen at the input
+	double			watermark;		///< Time up to which all the input has arrived, see SetWatermark
+	double			time_out;		///< Time of the last packet released
+	bool			flag_out;		///< True once a packet has been released
+	unsigned long	seq;			///< Arrival counter
+
+	// Counters
+	unsigned long	ctr_reordered;	///< Packets that arrived out of order and were put back in order
+	unsigned long	ctr_dropped;	///< Packets that arrived too late and were dropped
+	unsigned int	max_depth;		///< Largest number of packets held at once
+
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __RINGBUFFER_HH
+#define __RINGBUFFER_HH
+
+#include <vector>
+#include <atomic>
+#include <utility>
+
+/*!
+* \brief Bounded lock-free queue between exactly one producer and one consumer thread.
+*
+* \details The capacity is rounded up to a power of two. The producer only
+* writes the head and the consumer only writes the tail, so neither needs a
+* lock: the release/acquire pairs make the item visible before the index.
+* The two indices are on separate cache lines so that the threads do not slow
+* each other down.
+*
+* A full queue is not an error. GreatRingBuffer::TryPush returns false and the
+* producer decides how to wait, which is how the stages of the online pipeline
+* apply backpressure to each other.
+*/
+
+template<class T> class GreatRingBuffer {
+
+public:
+
+	/// \param[in] capacity Maximum number of items, rounded up to a power of two
+	GreatRingBuffer( unsigned int capacity ){
+		unsigned int n = 2;
+		while( n < capacity ) n <<= 1;
+		slots.resize( n );
+		mask = n - 1;
+		head = 0;
+		tail = 0;
+	};
+	~GreatRingBuffer(){};
+
+	/// Producer only. The item is moved in, or left alone if the queue is full
+	/// \param[in] item The item to add
+	/// \return false if the queue is full
+	inline bool TryPush( T &item ){
+		unsigned long h = head.load( std::memory_order_relaxed );
+		if( h - tail.load( std::memory_order_acquire ) > mask ) return false;
+		slots[ h & mask ] = std::move( item );
+		head.store( h + 1, std::memory_order_release );
+		return true;
+	};
+
+	/// Consumer only
+	/// \param[out] item The oldest item, moved out of the queue
+	/// \return false if the queue is empty
+	inline bool TryPop( T &item ){
+		unsigned long t = tail.load( std::memory_order_relaxed );
+		if( t == head.load( std::memory_order_acquire ) ) return false;
+		item = std::move( slots[ t & mask ] );
+		tail.store( t + 1, std::memory_order_release );
+		return true;
+	};
+
+	/// Approximate when called while the other thread is busy
+	inline unsigned int GetDepth() const {
+		return head.load( std::memory_order_acquire ) - tail.load( std::memory_order_acquire );
+	};
+	inline bool IsEmpty() const { return GetDepth() == 0; };
+	inline unsigned int GetCapacity() const { return mask + 1; };
+
+
+private:
+
+	std::vector<T>	slots;	///< Storage, the index is taken modulo the capacity
+	unsigned long	mask;	///< Capacity minus one
+
+	alignas(64) std::atomic<unsigned long>	head;	///< Next slot to write, only changed by the producer
+	alignas(64) std::atomic<unsigned long>	tail;	///< Next slot to read, only changed by the consumer
+
+};
+
+#endif
@@ -0,0 +1,90 @@
+#ifndef __ROLLINGSPECTRA_HH
+#define __ROLLINGSPECTRA_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <chrono>
+
+#include <TH1.h>
+#include <THttpServer.h>
+
+// Spectrum header
+#ifndef __SPECTRUM_HH
+# include "Spectrum.hh"
+#endif
+
+/*!
+* \brief Views of the monitor spectra over the last few minutes only.
+*
+* \details The monitor spectra add up everything since the start or the last
+* reset. Here, the counts of each spectrum are also kept in slices of a fixed
+* time, e.g. 10 s, in a ring that covers the longest window. Every time a
+* slice is closed, its counts are added to each view and the slice that has
+* just gone out of the window of that view is subtracted again, so a view of
+* the last minute or the last 10 minutes costs two additions per slice and
+* nothing is filled twice or read back from disk.
+*
+* The slices are taken as the difference of each spectrum to its copy at the
+* end of the last slice, so the spectra are filled as before. When the spectra
+* are reset, GreatRollingSpectra::Reset has to be called as well, or
+* GreatRollingSpectra::RequestReset from another thread, so that the views
+* start again from the reset. A spectrum that has fewer entries than at the
+* last slice is taken as reset anyway.
+*
+* GreatRollingSpectra::Update has to be called by the thread that fills the
+* spectra, as often as it likes; a new slice is only closed when it is due.
+* The views are registered in the THttpServer in one folder per window.
+*/
+
+class GreatRollingSpectra {
+
+public:
+
+	GreatRollingSpectra( double slice_time, std::vector<double> windows ); ///< Constructor
+	~GreatRollingSpectra(){}; ///< Destructor
+
+	void Add( TH1 *h );	///< Adds a one-dimensional histogram
+	void Add( std::shared_ptr<GreatSpectrum> spec );	///< Adds a compact spectrum, using its ROOT histogram once it exists
+	void Register( THttpServer *serv, std::string folder );	///< Shows the views in the web server, below folder
+	void Update();	///< Closes a slice if it is due, from the thread that fills the spectra
+	void Reset();	///< Empties all slices and views, from the thread that fills the spectra
+
+	/// Asks for GreatRollingSpectra::Reset at the next update, e.g. from the web page
+	inline void RequestReset(){ flag_reset = true; };
+
+	inline unsigned int GetNumberOfSpectra() const { return spectra.size(); };
+	inline unsigned int GetNumberOfWindows() const { return window_slices.size(); };
+	inline std::string GetWindowLabel( unsigned int w ) const { return labels[w]; };
+	inline TH1* GetView( unsigned int i, unsigned int w ) const { return spectra[i].views[w].get(); };
+
+
+private:
+
+	/// A spectrum with its slices and views
+	struct rolling_t {
+		TH1									*source;	///< The spectrum itself, if it is a ROOT histogram
+		std::shared_ptr<GreatSpectrum>		spec;		///< The spectrum itself, if it is a compact one
+		std::unique_ptr<TH1>				current;	///< Copy of the compact spectrum, once it has been filled
+		std::unique_ptr<TH1>				last;		///< Copy of the spectrum when the last slice was closed
+		std::deque<std::unique_ptr<TH1>>	slices;		///< Counts in each slice, oldest first, nullptr if empty
+		std::vector<std::unique_ptr<TH1>>	views;		///< Sum of the slices in each window
+	};
+
+	void MakeViews( rolling_t &r, TH1 *tmpl, std::string name, std::string title );
+	void UpdateSpectrum( rolling_t &r, unsigned int n_new );
+
+	std::vector<rolling_t>		spectra;		///< All spectra with their slices
+	std::vector<unsigned int>	window_slices;	///< Length of each window in slices
+	std::vector<std::string>	labels;			///< Name of each window, e.g. 1min
+	unsigned int				n_slices_max;	///< Slices kept, enough for the longest window
+	double						slice_time;		///< Length of a slice in s
+	std::chrono::steady_clock::time_point	slice_start;	///< Start of the current slice
+	std::atomic<bool>			flag_reset;		///< A reset was asked for
+
+};
+
+#endif
@@ -63,11 +63,68 @@ public:
 	inline double GetEventWindow(){ return event_window; };
 	inline double GetCeBr3HitWindow(){ return cebr3_hit_window; }
 	inline double GetHPGeHitWindow(){ return hpge_hit_window; }
+	inline void SetEventWindow( double w ){ event_window = w; };
+	inline void SetCeBr3HitWindow( double w ){ cebr3_hit_window = w; };
+	inline void SetHPGeHitWindow( double w ){ hpge_hit_window = w; };
+	inline double GetReorderTolerance(){ return reorder_tolerance; };
+	inline unsigned int GetReorderBufferSize(){ return reorder_size; };
+	inline double GetEventsFileMaxSize(){ return events_max_size; };
+
+	// Event trigger
+	inline std::string GetEventTrigger(){ return event_trigger; };
+	inline bool IsTriggerMode(){ return event_trigger != "Free"; };
+	inline double GetTriggerPreWindow(){ return trigger_pre_window; };
+	inline double GetTriggerPostWindow(){ return trigger_post_window; };
+	bool IsEventTrigger( unsigned char mod, unsigned char ch );
+
+	// Window scan
+	inline unsigned short GetNumberOfWindowScans(){ return n_window_scans; };
+	inline double GetWindowScanEventWindow( unsigned short i ){
+		if( i < n_window_scans ) return scan_event_window[i];
+		else return event_window;
+	};
+	inline double GetWindowScanCeBr3HitWindow( unsigned short i ){
+		if( i < n_window_scans ) return scan_cebr3_hit_window[i];
+		else return cebr3_hit_window;
+	};
+	inline double GetWindowScanHPGeHitWindow( unsigned short i ){
+		if( i < n_window_scans ) return scan_hpge_hit_window[i];
+		else return hpge_hit_window;
+	};
+	inline bool IsWindowScanTrees(){ return flag_scan_trees; };
+
+	// Histogrammer
+	inline bool IsGammaCube(){ return flag_gamma_cube; };
+	inline std::string GetGammaCubeDetector(){ return gamma_cube_det; };
+	inline double GetGammaCubeBinWidth(){ return gamma_cube_width; };
+	inline double GetGammaCubeMaxEnergy(){ return gamma_cube_max; };
+	inline bool IsHistSelectBranches(){ return flag_hist_select; };
+	inline double GetHistCacheSize(){ return hist_cache_size; };
+	inline int GetHistCacheLearnEntries(){ return hist_cache_learn; };
+	inline bool IsHistAsyncPrefetch(){ return flag_hist_prefetch; };
 
 	
 	// Data settings
 	inline unsigned int GetBlockSize(){ return block_size; };
 	inline bool IsCAENOnly(){ return flag_caen_only; };
+	inline bool IsFullTimeSort(){ return flag_full_sort; };
+	inline unsigned int GetSpyQueueSize(){ return spy_queue_size; };
+	inline double GetSpyMaxBackoff(){ return spy_max_backoff; };
+	inline unsigned int GetNumberOfSpyStreams(){ return n_spy_streams; };
+	inline int GetSpyStreamID( unsigned int i ){
+		if( i < n_spy_streams ) return spy_stream_id[i];
+		else return 0;
+	};
+	inline double GetSpyStreamIdle(){ return spy_stream_idle; };
+	inline unsigned int GetPipelineQueueSize(){ return pipeline_queue_size; };
+	inline double GetPipelineSyncPeriod(){ return pipeline_sync_period; };
+	inline double GetMonitorSnapshotPeriod(){ return mon_snapshot_period; };
+	inline double GetTailFollowInterval(){ return tail_interval; };
+	inline bool IsRollingSpectra(){ return flag_rolling; };
+	inline double GetRollingSliceTime(){ return rolling_slice; };
+	inline std::vector<double> GetRollingWindows(){ return rolling_windows; };
+	inline double GetHttpSnapshotPeriod(){ return http_snapshot_period; };
+	inline unsigned int GetMetricsHistory(){ return metrics_history; };
 
 
 	// TACs
@@ -104,13 +161,55 @@ private:
 	
 	// Event builder
 	double event_window;			///< Event builder time window in ns
+	double reorder_tolerance;		///< Maximum lateness in ns of a hit that the event builder can put back in order (default 1 ms), 0 to switch off
+	unsigned int reorder_size;		///< Maximum number of hits held in the event builder reorder buffer
+	double events_max_size;			///< Size in MB after which the event builder continues in a new file, 0 for no limit
 	double cebr3_hit_window;		///< Time window in ns for correlating CeBr3 (addback?)
 	double hpge_hit_window;			///< Time window in ns for correlating HPGe hits (addback?)
 
+	// Event trigger
+	std::string event_trigger;				///< Free, TAC, CeBr3, HPGe or Channel
+	double trigger_pre_window;				///< Time window in ns before the trigger hit in triggered modes
+	double trigger_post_window;				///< Time window in ns after the trigger hit in triggered modes
+	unsigned short n_trigger_ch;			///< Number of trigger channels when EventTrigger is Channel
+	std::vector<std::vector<bool>> trigger_ch;	///< A channel map of hits that can open an event in triggered modes
+
+	// Window scan
+	unsigned short n_window_scans;				///< Number of extra window settings evaluated by the event builder
+	std::vector<double> scan_event_window;		///< Event window in ns for each scan setting
+	std::vector<double> scan_cebr3_hit_window;	///< CeBr3 hit window in ns for each scan setting
+	std::vector<double> scan_hpge_hit_window;	///< HPGe hit window in ns for each scan setting
+	bool flag_scan_trees;						///< Write an event tree for each scan setting, not just histograms
+
+	// Histogrammer
+	bool flag_gamma_cube;			///< Fill the gamma-gamma-gamma cube
+	std::string gamma_cube_det;		///< HPGe or CeBr3, the detectors used for the cube
+	double gamma_cube_width;		///< Bin width of the cube in keV
+	double gamma_cube_max;			///< Upper energy limit of the cube in keV
+	bool flag_hist_select;			///< Only read the branches of the events that the histograms need
+	double hist_cache_size;			///< Size of the TTreeCache for the histogrammer input in MB, 0 to switch off
+	int hist_cache_learn;			///< Number of entries in the learning phase of the TTreeCache
+	bool flag_hist_prefetch;		///< Asynchronous prefetching of the histogrammer input
+
 	
 	// Data format
 	unsigned int block_size;		///< not yet implemented, needs C++ style reading of data files
 	bool flag_caen_only;			///< when there is only CAEN data in the file
+	bool flag_full_sort;			///< time sort all data in the converter, otherwise keep the DAQ order
+	unsigned int spy_queue_size;	///< Maximum number of DataSpy blocks waiting for the monitor
+	double spy_max_backoff;			///< Longest sleep in ms of the DataSpy reader when there is no data
+	unsigned int n_spy_streams;		///< Number of DataSpy shared memory areas read at the same time
+	std::vector<int> spy_stream_id;	///< Shared memory ID of each DataSpy stream
+	double spy_stream_idle;			///< Time in s without data after which a stream no longer holds back the others
+	unsigned int pipeline_queue_size;	///< Batches that can wait between two stages of the online pipeline
+	double pipeline_sync_period;		///< Time in s between updates of the histograms by the online pipeline
+	double mon_snapshot_period;			///< Time in s between writing the monitor files, 0 is never
+	double tail_interval;				///< Shortest time in s between two updates when following a run file
+	bool flag_rolling;					///< Keep views of the monitor spectra over the last few minutes
+	double rolling_slice;				///< Time in s between two updates of the rolling views
+	std::vector<double> rolling_windows;	///< Length in s of each rolling view
+	double http_snapshot_period;		///< Time in s between two copies of the histograms for the web server, 0 shows them directly
+	int metrics_history;				///< Number of updates shown in the history of the rates
 
 	
 	// TACs
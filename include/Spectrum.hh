@@ -0,0 +1,134 @@
+#ifndef __SPECTRUM_HH
+#define __SPECTRUM_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cmath>
+
+#include <TDirectory.h>
+#include <TH1.h>
+
+// Compact histogram interface
+#ifndef __COMPACTHIST_HH
+# include "CompactHist.hh"
+#endif
+
+/*!
+* \brief Compact one-dimensional spectrum that is only allocated once it is filled.
+*
+* \details The counts are kept as 16-bit integers and the memory for the bins is
+* only allocated on the first fill inside the range, so that channels that are
+* not plugged in cost almost nothing. A bin that goes past 65535 starts again
+* from zero and the multiples of 65536 are kept in a map, which stays empty for
+* almost all spectra. There is no ROOT histogram while the spectrum is filled:
+* a TH1F is only made for GreatSpectrum::Write, or by GreatSpectrum::MakeHist
+* for whoever wants to show it. Only a web server that scans the directories
+* itself needs a TH1F in the directory, which GreatSpectrum::Sync keeps up to
+* date. Binning follows the same convention as TAxis::FindBin so the ROOT
+* histogram is identical to one filled directly.
+*
+* Raw ADC spectra have one bin per integer value, which are filled with
+* GreatSpectrum::FillRaw as a plain array increment without any floating point
+* bin search. Spectra with the same binning can be added together, so that each
+* thread can fill its own copy and merge them at the end. This is done by the
+* GreatHistogramSet that the spectrum is booked in, through GreatSpectrum::Add.
+*/
+
+class GreatSpectrum : public GreatCompactHist {
+
+public:
+
+	GreatSpectrum( std::string name, std::string title,
+				   unsigned int nbins, double xmin, double xmax,
+				   TDirectory *dir = nullptr ); ///< Constructor
+	~GreatSpectrum(){}; ///< Destructor, the TH1F belongs to its directory
+
+	/// Adds one count at x, in the underflow or overflow if out of range
+	inline void Fill( double x ){
+		entries++;
+		if( x < xmin ) underflow++;
+		else if( x >= xmax ) overflow++;
+		else {
+			if( counts.empty() ) counts.resize( nbins, 0 );
+			unsigned int bin = (unsigned int)( nbins * ( x - xmin ) / ( xmax - xmin ) );
+			if( bin >= nbins ) overflow++;
+			else if( ++counts[bin] == 0 ) carry[bin]++;
+		}
+	};
+
+	/// Adds one count at the integer value x, only for bins of unit width centred on integers
+	inline void FillRaw( long x ){
+		if( !flag_unit ) {
+			Fill( x );
+			return;
+		}
+		entries++;
+		long bin = x - first;
+		if( bin < 0 ) underflow++;
+		else if( bin >= (long)nbins ) overflow++;
+		else {
+			if( counts.empty() ) counts.resize( nbins, 0 );
+			if( ++counts[bin] == 0 ) carry[bin]++;
+		}
+	};
+
+	bool Add( const GreatSpectrum &other ); ///< Adds the counts of another spectrum with the same binning
+	bool Add( const GreatCompactHist &other ) override; ///< Adds the counts of another spectrum, for the merge of a GreatHistogramSet
+	std::unique_ptr<GreatCompactHist> CloneEmpty() const override; ///< Empty spectrum with the same binning
+	TH1F* Sync(); ///< Keeps a TH1F in the directory up to date, only for a web server that scans it
+	void Reset() override; ///< Clears the counts and the ROOT histogram if there is one
+
+	TH1* MakeHist() const override; ///< New TH1F with the counts, owned by the caller
+	void CopyTo( TH1 *h ) const override; ///< Replaces the contents of a TH1F with the same binning
+	void Write( TDirectory *dir ) override; ///< Writes a TH1F with the counts
+	bool AddFrom( TDirectory *dir ) override; ///< Adds the counts of a histogram with the same name and binning
+
+	/// \return The counts in a bin, starting from 0 and without the underflow
+	inline unsigned long long GetCount( unsigned int bin ) const {
+		if( bin >= counts.size() ) return 0;
+		unsigned long long n = counts[bin];
+		if( !carry.empty() ) {
+			auto it = carry.find( bin );
+			if( it != carry.end() ) n += it->second << 16;
+		}
+		return n;
+	};
+
+	inline unsigned long long GetEntries() const override { return entries; };
+	inline bool IsAllocated() const { return !counts.empty(); };
+	inline TH1F* GetHist(){ return hist; };
+	inline std::string GetName() const override { return name; };
+	inline TDirectory* GetDirectory(){ return dir; };
+	inline std::string GetTitle() const { return title; };
+	inline unsigned int GetNbins() const { return nbins; };
+	inline double GetXmin() const { return xmin; };
+	inline double GetXmax() const { return xmax; };
+
+
+private:
+
+	std::string		name;		///< Name of the ROOT histogram
+	std::string		title;		///< Title of the ROOT histogram
+	unsigned int	nbins;		///< Number of bins
+	double			xmin;		///< Lower edge of the first bin
+	double			xmax;		///< Upper edge of the last bin
+	bool			flag_unit;	///< True if each bin holds exactly one integer value
+	long			first;		///< Integer value of the first bin when flag_unit is true
+
+	void AddCount( unsigned int bin, unsigned long long n );	///< Adds n counts to a bin, carrying in to the map
+
+	std::vector<unsigned short>	counts;		///< Counts in each bin modulo 65536, empty until the first fill in range
+	std::map<unsigned int,unsigned long long>	carry;	///< Multiples of 65536 of the bins that went past it
+	unsigned long long			underflow;	///< Counts below xmin
+	unsigned long long			overflow;	///< Counts at or above xmax
+	unsigned long long			entries;	///< Total number of fills
+
+	TDirectory		*dir;		///< Directory for the ROOT histogram
+	TH1F			*hist;		///< The ROOT histogram in the directory, only made by GreatSpectrum::Sync
+
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __SPYSTREAMS_HH
+#define __SPYSTREAMS_HH
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cfloat>
+
+// Settings header
+#ifndef __SETTINGS_HH
+# include "Settings.hh"
+#endif
+
+// Converter header
+#ifndef __CONVERTER_HH
+# include "Converter.hh"
+#endif
+
+// DataSpy reader thread
+#ifndef __DATASPYREADER_HH
+# include "DataSpyReader.hh"
+#endif
+
+/*!
+* \brief All DataSpy streams of the DAQ, read in parallel and merged in time.
+*
+* \details Each stream, e.g. one for each crate, has its own shared memory ID
+* and is read by its own GreatDataSpyReader thread. The blocks of all streams
+* are converted in turn by the same GreatConverter, which keeps the timestamp
+* state of each stream apart (GreatConverter::SetStream).
+*
+* The streams do not arrive in step, so a hit can only be put in order once
+* every stream has passed its time. The watermark is the latest hit time of
+* the stream that is furthest behind, and the ordering holds back everything
+* after it. A stream that has sent nothing for SpyStreamIdle seconds no longer
+* holds back the others, so a crate that stops does not stop the monitor.
+*
+* For each stream, the blocks, bytes and lost buffers of its reader are kept,
+* together with its lag behind the stream that is furthest ahead.
+*/
+
+class GreatSpyStreams {
+
+public:
+
+	GreatSpyStreams( std::shared_ptr<GreatSettings> myset );	///< Constructor
+	~GreatSpyStreams();		///< Destructor, stops all readers
+
+	unsigned int Start();	///< Starts the reader of every stream
+	void Stop();			///< Stops all readers
+
+	/// Converts the waiting blocks of every stream, on the calling thread
+	/// \param[in] conv The converter, its stream is set before each block
+	/// \param[in] fn Any callable without arguments, called after each block
+	/// \return The number of blocks
+	template<class F> unsigned int Drain( GreatConverter &conv, F fn ){
+		unsigned int n_blocks = 0;
+		for( unsigned int s = 0; s < readers.size(); ++s ) {
+			conv.SetStream( s );
+			n_blocks += readers[s]->Drain( [&]( char *data, int length,
+												std::chrono::steady_clock::time_point read_time ){
+				(void)length;
+				block_time = read_time;
+				conv.ConvertBlock( data, 0 );
+				Update( s, conv.GetStreamTime() );
+				fn();
+			} );
+		}
+		return n_blocks;
+	};
+
+	double GetWatermark() const;	///< Time up to which all streams that are not idle have arrived
+	double GetLag( unsigned int s ) const;	///< Time in ns that a stream is behind the one furthest ahead
+	bool IsIdle( unsigned int s ) const;	///< True if the stream has sent nothing for a while
+
+	inline unsigned int GetNumberOfStreams() const { return readers.size(); };
+
+	/// When the block being converted was read, for the callable passed to GreatSpyStreams::Drain
+	inline std::chrono::steady_clock::time_point GetBlockTime() const { return block_time; };
+	inline const GreatDataSpyReader& GetReader( unsigned int s ) const { return *readers[s]; };
+	unsigned long long GetBlocksRead() const;	///< Sum over all streams
+	unsigned long long GetBytesRead() const;	///< Sum over all streams
+	unsigned long long GetLostBuffers() const;	///< Sum over all streams
+
+	void PrintCounters();	///< Prints the counters of each stream
+
+
+private:
+
+	void Update( unsigned int s, double t );	///< Called after each block of a stream
+
+	std::vector<std::unique_ptr<GreatDataSpyReader>>	readers;	///< One per stream
+	std::vector<int>									ids;		///< Shared memory ID of each stream
+
+	mutable std::mutex	state_mutex;	///< Protects the times, read by other threads for printing
+	std::vector<double>	stream_time;	///< Latest hit time of each stream
+	std::vector<std::chrono::steady_clock::time_point>	last_data;	///< When each stream last sent a block
+	double				idle_time;		///< Time in s after which a stream is idle
+	std::chrono::steady_clock::time_point	block_time;	///< When the block being converted was read, only for the draining thread
+
+};
+
+#endif
@@ -0,0 +1,106 @@
+#ifndef __SYMMATRIX_HH
+#define __SYMMATRIX_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <utility>
+#include <algorithm>
+
+#include <TDirectory.h>
+#include <TH2.h>
+
+// Compact histogram interface
+#ifndef __COMPACTHIST_HH
+# include "CompactHist.hh"
+#endif
+
+/*!
+* \brief Symmetric coincidence matrix with packed, blocked and lazily allocated storage.
+*
+* \details A gamma-gamma matrix is symmetric, so only the lower triangle is
+* stored and each pair is filled in one cell instead of two. The triangle is
+* split in blocks of kBlockSize x kBlockSize bins with integer counts, and a
+* block is only allocated when the first count lands in it. Most of a matrix
+* is empty at high energy, so the memory is usually much less than half of a
+* TH2F with the same binning.
+*
+* The matrix is only expanded in to a normal TH2F while it is written, see
+* GreatSymMatrix::Write, or by GreatSymMatrix::MakeHist for whoever wants to
+* show it. Only a web server that scans the directories itself needs a TH2F in
+* the directory, which GreatSymMatrix::Sync keeps up to date. The expanded
+* histogram is identical to filling a TH2F with (x,y) and (y,x) for each pair,
+* except that pairs with one energy out of range are counted separately and not
+* put in the overflow bins.
+*/
+
+class GreatSymMatrix : public GreatCompactHist {
+
+public:
+
+	GreatSymMatrix( std::string name, std::string title,
+					unsigned int nbins, double min, double max,
+					TDirectory *dir = nullptr ); ///< Constructor
+	~GreatSymMatrix(){}; ///< Destructor, the TH2F belongs to its directory
+
+	static const unsigned int kBlockSize = 64; ///< Number of bins along each side of a block
+
+	/// Adds one pair, in one cell of the lower triangle
+	inline void Fill( double x, double y ){
+		entries++;
+		if( x < min || x >= max || y < min || y >= max ) {
+			outside++;
+			return;
+		}
+		unsigned int i = (unsigned int)( nbins * ( x - min ) / ( max - min ) );
+		unsigned int j = (unsigned int)( nbins * ( y - min ) / ( max - min ) );
+		if( i >= nbins || j >= nbins ) {
+			outside++;
+			return;
+		}
+		if( i < j ) std::swap( i, j );
+		unsigned int bi = i / kBlockSize;
+		unsigned int bj = j / kBlockSize;
+		std::unique_ptr<unsigned int[]> &blk = blocks[ bi*(bi+1)/2 + bj ];
+		if( !blk ) blk.reset( new unsigned int[kBlockSize*kBlockSize]() );
+		blk[ (i%kBlockSize)*kBlockSize + (j%kBlockSize) ]++;
+	};
+
+	bool Add( const GreatSymMatrix &other ); ///< Adds the counts of another matrix with the same binning
+	bool Add( const GreatCompactHist &other ) override; ///< Adds the counts of another matrix, for the merge of a GreatHistogramSet
+	std::unique_ptr<GreatCompactHist> CloneEmpty() const override; ///< Empty matrix with the same binning
+	TH2F* Sync(); ///< Keeps a TH2F in the directory up to date, only for a web server that scans it
+	void Reset() override; ///< Clears the counts in place and the ROOT histogram if there is one
+
+	TH1* MakeHist() const override; ///< New TH2F with the expanded matrix, owned by the caller
+	void CopyTo( TH1 *h ) const override; ///< Replaces the contents of a TH2F with the same binning
+	void Write( TDirectory *dir ) override; ///< Writes the expanded matrix
+	bool AddFrom( TDirectory *dir ) override; ///< Adds the counts of a symmetric TH2 with the same name and binning
+
+	unsigned int GetNumberOfBlocks() const; ///< Number of blocks allocated so far
+	inline std::string GetName() const override { return name; };
+	inline unsigned long long GetEntries() const override { return entries; };
+	inline unsigned long long GetOutside() const { return outside; };
+	inline TH2F* GetHist(){ return hist; };
+
+
+private:
+
+	std::string		name;		///< Name of the ROOT histogram
+	std::string		title;		///< Title of the ROOT histogram
+	unsigned int	nbins;		///< Number of bins along each axis
+	double			min;		///< Lower edge of the first bin on both axes
+	double			max;		///< Upper edge of the last bin on both axes
+	unsigned int	nblocks;	///< Number of blocks along each axis
+
+	std::vector<std::unique_ptr<unsigned int[]>>	blocks;	///< Lower triangle of blocks, packed row by row
+	unsigned long long	entries;	///< Number of pairs filled
+	unsigned long long	outside;	///< Number of pairs with at least one value out of range
+
+	TDirectory		*dir;		///< Directory for the ROOT histogram
+	TH2F			*hist;		///< The ROOT histogram in the directory, only made by GreatSymMatrix::Sync
+
+};
+
+#endif
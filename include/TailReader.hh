@@ -0,0 +1,82 @@
+#ifndef __TAILREADER_HH
+#define __TAILREADER_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef LINUX
+# include <sys/inotify.h>
+# include <poll.h>
+#endif
+
+/*!
+* \brief Follows a run file while the DAQ is still writing it.
+*
+* \details The file stays open and only the blocks that have been completed
+* since the last call are read, so nothing is read twice and a block that is
+* half written is left for the next time. On Linux, inotify wakes the monitor
+* as soon as the file is written to, instead of sleeping for a fixed time.
+* Elsewhere the file is checked again after the wait.
+*
+* If the file gets shorter, e.g. because the DAQ started a new run with the
+* same name, it is read again from the start.
+*/
+
+class GreatTailReader {
+
+public:
+
+	GreatTailReader( std::string filename, unsigned int block_size );	///< Constructor
+	~GreatTailReader();	///< Destructor, closes the file
+
+	bool Open();	///< Opens the file and starts watching it
+	void Close();	///< Stops watching and closes the file
+
+	/// Calls fn( data, nblock ) for every complete block that was not read yet
+	/// \param[in] fn Any callable taking a char* and the number of the block in the file
+	/// \return The number of blocks read
+	template<class F> unsigned int ReadBlocks( F fn ){
+		if( fd < 0 && !Open() ) return 0;
+		CheckTruncated();
+		unsigned int n_read = 0;
+		while( pread( fd, block.data(), block_size, offset ) == (ssize_t)block_size ) {
+			fn( block.data(), n_blocks );
+			offset += block_size;
+			n_blocks++;
+			n_read++;
+		}
+		return n_read;
+	};
+
+	bool Wait( double min_wait, double max_wait );	///< Waits for a new complete block
+	bool HasBlock();	///< True if a complete block is waiting
+
+	inline unsigned long GetBlocksRead() const { return n_blocks; };
+	inline bool IsWatching() const { return watch >= 0; };
+
+
+private:
+
+	void CheckTruncated();	///< Starts again from the top if the file got shorter
+
+	std::string			filename;		///< The file being followed
+	unsigned int		block_size;		///< Size of each block in bytes
+	std::vector<char>	block;			///< Space for one block
+
+	int					fd;				///< File descriptor of the run file
+	int					notify_fd;		///< File descriptor of the inotify instance
+	int					watch;			///< Watch on the run file
+	off_t				offset;			///< Position of the first block not read yet
+	unsigned long		n_blocks;		///< Blocks read so far
+
+};
+
+#endif
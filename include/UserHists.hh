@@ -0,0 +1,123 @@
+#ifndef __USERHISTS_HH
+#define __USERHISTS_HH
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <TEnv.h>
+#include <TH1.h>
+#include <TH2.h>
+
+// Event structure
+#ifndef __GREATEVTS_HH
+# include "GreatEvts.hh"
+#endif
+
+// Histogram set
+#ifndef __HISTOGRAMSET_HH
+# include "HistogramSet.hh"
+#endif
+
+/*!
+* \brief Histograms defined in a text file, filled without changing the code.
+*
+* \details The file is read with TEnv, in the same way as the settings file.
+* Each histogram has a type, one or two detector types and optional gates on
+* the energy, the detector ID and the time difference. When the file is read,
+* every definition is compiled in to a fill kernel, which is a flat structure
+* with the gates and the position of its histogram in the GreatHistogramSet.
+*
+* For each event, the hits of each detector type are collected once, and then
+* all kernels are run on them one after the other. Many user histograms
+* therefore cost one pass over the event, not one loop each.
+*
+* The types are:
+* - Energy: energy of every hit (the TAC time for TACs)
+* - Multiplicity: number of hits in the event that pass the gates
+* - TimeDiff: t2 - t1 for all pairs of hits of Detector and Detector2
+* - EnergyEnergy: E1 against E2 for all pairs of hits
+* - EnergyTimeDiff: E1 against t2 - t1 for all pairs of hits
+*/
+
+class GreatUserHists {
+
+public:
+
+	GreatUserHists( std::string filename );	///< Constructor, reads and compiles the file
+	~GreatUserHists(){};	///< Destructor
+
+	/// Detector types, the same numbering as the lists of hits
+	enum det_t {
+		kCeBr3	= 0,
+		kHPGe	= 1,
+		kTAC	= 2,
+		kNumberOfDetectors = 3
+	};
+
+	/// What is filled for each histogram
+	enum kernel_type_t {
+		kEnergy,
+		kMultiplicity,
+		kTimeDiff,
+		kEnergyEnergy,
+		kEnergyTimeDiff
+	};
+
+	/// Fields of the hits that have to be read from the input
+	enum read_t {
+		kReadTime	= 1,
+		kReadEnergy	= 2,
+		kReadID		= 4
+	};
+
+	/// Hits of the current event, one list per detector type. Owned by the
+	/// caller, e.g. for each thread, and reused so that filling does not allocate
+	struct scratch_t {
+		std::vector<const GreatDetectorEvt*> hits[kNumberOfDetectors];
+	};
+
+	void Book( GreatHistogramSet &hs );	///< Books all histograms in the UserHists directory
+	std::vector<TH1*> GetHists( const GreatHistogramSet &hs ) const;	///< Histograms of the kernels in a set or a clone of it
+	void Fill( const GreatEvts &evts, const std::vector<TH1*> &hists, scratch_t &scratch ) const;	///< Runs all kernels on one event
+	unsigned int GetReadMask( det_t det ) const;	///< Fields of a detector type used by the kernels, see read_t
+
+	inline unsigned int GetNumberOfHists() const { return kernels.size(); };
+	inline std::string GetFileName() const { return fInputFile; };
+
+
+private:
+
+	/// One compiled histogram definition
+	struct kernel_t {
+		kernel_type_t	type;			///< What to fill
+		det_t			det1;			///< First detector type
+		det_t			det2;			///< Second detector type, for pairs
+		int				id1;			///< Only this detector ID for the first hit, -1 for all
+		int				id2;			///< Only this detector ID for the second hit, -1 for all
+		double			emin1, emax1;	///< Energy gate of the first hit
+		double			emin2, emax2;	///< Energy gate of the second hit
+		double			tmin, tmax;		///< Gate on t2 - t1 for pairs
+		std::string		name;			///< Histogram name
+		std::string		title;			///< Histogram title including the axes
+		unsigned int	nbins, nbinsy;	///< Number of bins
+		double			min, max;		///< Range of the x axis
+		double			miny, maxy;		///< Range of the y axis for 2D histograms
+		unsigned int	idx;			///< Position of the histogram in the set
+	};
+
+	bool ReadDetector( std::string name, det_t &det );
+	bool ReadType( std::string name, kernel_type_t &type );
+
+	/// True if the hit passes the ID and energy gates of the first or second hit
+	inline bool Pass( const GreatDetectorEvt *hit, int id, double emin, double emax ) const {
+		return ( id < 0 || hit->GetID() == id ) &&
+			   hit->GetEnergy() >= emin && hit->GetEnergy() <= emax;
+	};
+
+	std::string fInputFile;			///< Histogram definition file
+	std::vector<kernel_t> kernels;	///< All compiled definitions, in the order of the file
+
+};
+
+#endif
@@ -0,0 +1,134 @@
+#include "CoincidenceFinder.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Empties the hit list and the detector buckets, but keeps their memory so
+/// that there are no allocations in the event loop after the first few events
+void GreatCoincidenceFinder::Clear(){
+
+	hits.clear();
+	pairs.clear();
+
+	for( unsigned int i = 0; i < used_buckets.size(); ++i )
+		buckets[ used_buckets[i] ].clear();
+	used_buckets.clear();
+
+	flag_sorted = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] t The time stamp of the hit in ns
+/// \param[in] id The detector ID, which is used to separate same- and different-detector pairs
+/// \param[in] idx The index of this hit in the caller's list, which is returned in the pairs
+void GreatCoincidenceFinder::AddHit( double t, short id, unsigned int idx ){
+
+	coinc_hit_t hit;
+	hit.time = t;
+	hit.id = id;
+	hit.idx = idx;
+	hits.push_back( hit );
+
+	flag_sorted = false;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Ties in time are resolved by the index in the caller's list, so the pair
+/// lists are reproducible regardless of the sorting algorithm
+bool GreatCoincidenceFinder::TimeComparator( const coinc_hit_t &lhs, const coinc_hit_t &rhs ){
+
+	if( lhs.time == rhs.time ) return lhs.idx < rhs.idx;
+	return lhs.time < rhs.time;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hits come from a time-sorted tree, so this is usually already in order and
+/// the sort is cheap. The buckets inherit the time ordering of the hit list.
+void GreatCoincidenceFinder::Sort(){
+
+	if( !std::is_sorted( hits.begin(), hits.end(), TimeComparator ) )
+		std::sort( hits.begin(), hits.end(), TimeComparator );
+
+	// Bucket the hits by detector ID
+	for( unsigned int i = 0; i < used_buckets.size(); ++i )
+		buckets[ used_buckets[i] ].clear();
+	used_buckets.clear();
+
+	for( unsigned int i = 0; i < hits.size(); ++i ) {
+
+		// Hits without a valid ID cannot be bucketed
+		if( hits[i].id < 0 ) continue;
+
+		unsigned int id = hits[i].id;
+		if( id >= buckets.size() ) buckets.resize( id+1 );
+		if( buckets[id].empty() ) used_buckets.push_back( id );
+		buckets[id].push_back( hits[i] );
+
+	}
+
+	flag_sorted = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Two-pointer window over a time-ordered list. For each hit, the partner
+/// pointer only moves forward in time until it leaves the window, so hits
+/// outside the window are never compared.
+/// \param[in] list The time-ordered hits to pair up
+/// \param[in] window The coincidence window in ns, negative for no condition
+/// \param[in] mode Skip same or different detector pairs (kAnyID to keep all)
+void GreatCoincidenceFinder::WindowPairs( const std::vector<coinc_hit_t> &list,
+										  double window, pair_t mode ){
+
+	for( unsigned int i = 0; i < list.size(); ++i ) {
+
+		for( unsigned int j = i+1; j < list.size(); ++j ) {
+
+			// Leave the window, everything after is later still
+			if( window >= 0 && list[j].time - list[i].time >= window )
+				break;
+
+			if( mode == kDiffID && list[i].id == list[j].id ) continue;
+
+			pairs.push_back( std::make_pair( list[i].idx, list[j].idx ) );
+
+		} // j
+
+	} // i
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] window The coincidence window in ns, i.e. |t_j - t_i| < window.
+/// A negative window returns all pairs in the event.
+/// \param[in] mode Choose all pairs, only pairs in the same detector, or only pairs in different detectors
+/// \return A list of index pairs into the caller's list, earliest hit first
+const std::vector<std::pair<unsigned int,unsigned int>>& GreatCoincidenceFinder::FindPairs( double window, pair_t mode ){
+
+	if( !flag_sorted ) Sort();
+
+	pairs.clear();
+
+	// Same detector pairs only need to look inside each bucket
+	if( mode == kSameID ) {
+
+		for( unsigned int i = 0; i < used_buckets.size(); ++i )
+			WindowPairs( buckets[ used_buckets[i] ], window, kAnyID );
+
+	}
+
+	// Otherwise slide over the full time-ordered list
+	else WindowPairs( hits, window, mode );
+
+	return pairs;
+
+}
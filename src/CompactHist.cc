@@ -0,0 +1,41 @@
+#include "CompactHist.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Goes through a new histogram, so the derived classes should do better
+/// \param[in] h A histogram with the same binning, e.g. made by MakeHist before
+void GreatCompactHist::CopyTo( TH1 *h ) const {
+
+	if( !h ) return;
+
+	h->Reset( "ICESM" );
+
+	TH1 *tmp = MakeHist();
+	if( !tmp ) return;
+	h->Add( tmp );
+	h->SetEntries( tmp->GetEntries() );
+	delete tmp;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The ROOT histogram only exists while it is written
+/// \param[in] dir The directory to write in to
+void GreatCompactHist::Write( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	TH1 *h = MakeHist();
+	if( !h ) return;
+
+	TDirectory *olddir = gDirectory;
+	dir->cd();
+	h->Write( h->GetName(), TObject::kOverwrite );
+	olddir->cd();
+
+	delete h;
+
+	return;
+
+}
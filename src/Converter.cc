@@ -9,7 +9,7 @@ GreatConverter::GreatConverter( std::shared_ptr<GreatSettings> myset ) {
 	my_tm_stp_hsb = 0;
 	
 	// Resize counters
-	ctr_caen_hit.resize( set->GetNumberOfCAENModules() );
+	ctr_caen_hit = std::vector<std::atomic<unsigned long>>( set->GetNumberOfCAENModules() );
 	ctr_caen_ext.resize( set->GetNumberOfCAENModules() );
 
 	// Start counters at zero
@@ -32,6 +32,7 @@ void GreatConverter::StartFile(){
 		ctr_caen_ext[i] = 0;	// external timestamps
 
 	}
+	ctr_decode_err = 0;
 	
 	return;
 	
@@ -73,6 +74,10 @@ void GreatConverter::MakeHists() {
 	std::string hname, htitle;
 	std::string dirname, maindirname, subdirname;
 	
+	// ROOT histograms are booked in the set, the spectra are separate
+	hist_set.Clear();
+	hist_set.SetDirectory( output_file );
+
 	// Make directories
 	maindirname = "caen_hists";
 	
@@ -94,8 +99,11 @@ void GreatConverter::MakeHists() {
 		if( !output_file->GetDirectory( dirname.data() ) )
 			output_file->mkdir( dirname.data() );
 		output_file->cd( dirname.data() );
+		TDirectory *dir = output_file->GetDirectory( dirname.data() );
 
 		// Loop over channels of each CAEN module
+		// The spectra are only allocated when they are filled
+		// Those already in the file are carried on
 		for( unsigned int j = 0; j < set->GetNumberOfCAENChannels(); ++j ) {
 			
 			// Uncalibrated - Qlong
@@ -108,18 +116,11 @@ void GreatConverter::MakeHists() {
 			
 			htitle += ";Qlong;Counts";
 			
-			if( output_file->GetListOfKeys()->Contains( hname.data() ) )
-				hcaen_qlong[i][j] = (TH1F*)output_file->Get( hname.data() );
-			
-			else {
-				
-				hcaen_qlong[i][j] = new TH1F( hname.data(), htitle.data(),
-										   65536, -0.5, 65535.5 );
+			hcaen_qlong[i][j] = hist_set.Book( std::make_shared<GreatSpectrum>( hname, htitle,
+										65536, -0.5, 65535.5, dir ), dirname );
 			
-				hcaen_qlong[i][j]->SetDirectory(
-						output_file->GetDirectory( dirname.data() ) );
-				
-			}
+			if( dir->GetListOfKeys()->Contains( hname.data() ) )
+				hcaen_qlong[i][j]->AddFrom( dir );
 			
 			// Uncalibrated - Qshort
 			hname = "caen_" + std::to_string(i);
@@ -131,20 +132,13 @@ void GreatConverter::MakeHists() {
 			
 			htitle += ";Qshort;Counts";
 			
-			if( output_file->GetListOfKeys()->Contains( hname.data() ) )
-				hcaen_qshort[i][j] = (TH1F*)output_file->Get( hname.data() );
+			hcaen_qshort[i][j] = hist_set.Book( std::make_shared<GreatSpectrum>( hname, htitle,
+										32768, -0.5, 32767.5, dir ), dirname );
 			
-			else {
-				
-				hcaen_qshort[i][j] = new TH1F( hname.data(), htitle.data(),
-										   32768, -0.5, 32767.5 );
+			if( dir->GetListOfKeys()->Contains( hname.data() ) )
+				hcaen_qshort[i][j]->AddFrom( dir );
 			
-				hcaen_qshort[i][j]->SetDirectory(
-						output_file->GetDirectory( dirname.data() ) );
-				
-			}
-			
-			// Uncalibrated - Qshort
+			// Uncalibrated - Qdiff
 			hname = "caen_" + std::to_string(i);
 			hname += "_" + std::to_string(j);
 			hname += "_qdiff";
@@ -154,18 +148,11 @@ void GreatConverter::MakeHists() {
 			
 			htitle += ";Qdiff;Counts";
 			
-			if( output_file->GetListOfKeys()->Contains( hname.data() ) )
-				hcaen_qdiff[i][j] = (TH1F*)output_file->Get( hname.data() );
-			
-			else {
-				
-				hcaen_qdiff[i][j] = new TH1F( hname.data(), htitle.data(),
-										   65536, -0.5, 65535.5 );
+			hcaen_qdiff[i][j] = hist_set.Book( std::make_shared<GreatSpectrum>( hname, htitle,
+										65536, -0.5, 65535.5, dir ), dirname );
 			
-				hcaen_qdiff[i][j]->SetDirectory(
-						output_file->GetDirectory( dirname.data() ) );
-				
-			}
+			if( dir->GetListOfKeys()->Contains( hname.data() ) )
+				hcaen_qdiff[i][j]->AddFrom( dir );
 			
 			// Calibrated
 			hname = "caen_" + std::to_string(i);
@@ -177,19 +164,11 @@ void GreatConverter::MakeHists() {
 			
 			htitle += ";Energy (keV);Counts per 10 keV";
 			
-			if( output_file->GetListOfKeys()->Contains( hname.data() ) )
-				hcaen_cal[i][j] = (TH1F*)output_file->Get( hname.data() );
+			hcaen_cal[i][j] = hist_set.Book( std::make_shared<GreatSpectrum>( hname, htitle,
+										4000, -5, 39995, dir ), dirname );
 			
-			else {
-				
-				hcaen_cal[i][j] = new TH1F( hname.data(), htitle.data(),
-										   4000, -5, 39995 );
-			
-				hcaen_cal[i][j]->SetDirectory(
-						output_file->GetDirectory( dirname.data() ) );
-				
-			}
-
+			if( dir->GetListOfKeys()->Contains( hname.data() ) )
+				hcaen_cal[i][j]->AddFrom( dir );
 			
 		}
 					
@@ -197,9 +176,7 @@ void GreatConverter::MakeHists() {
 	
 	// Make directories
 	dirname = "timing_hists";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	hist_set.MakeDirectory( dirname );
 	
 	// Resize vectors
 	hcaen_hit.resize( set->GetNumberOfCAENModules() );
@@ -222,6 +199,8 @@ void GreatConverter::MakeHists() {
 
 		}
 
+		hist_set.Register( hcaen_hit[i], dirname );
+
 	
 		hname = "hcaen_ext" + std::to_string(i);
 		htitle = "Profile of external trigger ts versus hit_id in CAEN module " + std::to_string(i);
@@ -237,6 +216,8 @@ void GreatConverter::MakeHists() {
 
 		}
 
+		hist_set.Register( hcaen_ext[i], dirname );
+
 	}
 	
 	return;
@@ -247,27 +228,31 @@ void GreatConverter::ResetHists() {
 	
 	std::cout << "in GreatConverter::ResetHist()" << std::endl;
 	
-	for( unsigned int i = 0; i < hcaen_hit.size(); ++i )
-		hcaen_hit[i]->Reset("ICESM");
-
-	for( unsigned int i = 0; i < hcaen_ext.size(); ++i )
-		hcaen_ext[i]->Reset("ICESM");
-	
-	for( unsigned int i = 0; i < hcaen_qlong.size(); ++i )
-		for( unsigned int j = 0; j < hcaen_qlong[i].size(); ++j )
-			hcaen_qlong[i][j]->Reset("ICESM");
+	// The compact spectra are in the set as well
+	hist_set.Reset();
 	
-	for( unsigned int i = 0; i < hcaen_qshort.size(); ++i )
-		for( unsigned int j = 0; j < hcaen_qshort[i].size(); ++j )
-			hcaen_qshort[i][j]->Reset("ICESM");
+	return;
 	
-	for( unsigned int i = 0; i < hcaen_qdiff.size(); ++i )
-		for( unsigned int j = 0; j < hcaen_qdiff[i].size(); ++j )
-			hcaen_qdiff[i][j]->Reset("ICESM");
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Makes the ROOT histograms of all spectra that have been filled up to date.
+/// Only needed when the web server scans the output file itself, the output
+/// is written with GreatHistogramSet::WriteCompact instead.
+void GreatConverter::SyncHists() {
 	
-	for( unsigned int i = 0; i < hcaen_cal.size(); ++i )
-		for( unsigned int j = 0; j < hcaen_cal[i].size(); ++j )
-			hcaen_cal[i][j]->Reset("ICESM");
+	for( unsigned int i = 0; i < hcaen_qlong.size(); ++i ) {
+		
+		for( unsigned int j = 0; j < hcaen_qlong[i].size(); ++j ) {
+			
+			hcaen_qlong[i][j]->Sync();
+			hcaen_qshort[i][j]->Sync();
+			hcaen_qdiff[i][j]->Sync();
+			hcaen_cal[i][j]->Sync();
+			
+		}
+		
+	}
 	
 	return;
 	
@@ -451,6 +436,7 @@ void GreatConverter::ProcessBlockData( unsigned long nblock ){
 		else {
 			
 			// output error message!
+			ctr_decode_err.fetch_add( 1, std::memory_order_relaxed );
 			std::cerr << "WARNING: WRONG TYPE! word 0: " << std::hex << " 0x";
 			std::cerr << word_0 << std::dec << ", my_type: " << my_type << std::endl;
 		
@@ -564,7 +550,7 @@ void GreatConverter::ProcessCAENData(){
 		}
 		
 		// Fill histograms
-		hcaen_qlong[my_mod_id][my_ch_id]->Fill( my_adc_data );
+		hcaen_qlong[my_mod_id][my_ch_id]->FillRaw( my_adc_data );
 		if( my_adc_data == 0xFFFF ) caen_data->SetQlong( 0 );
 		else caen_data->SetQlong( my_adc_data );
 		flag_caen_data0 = true;
@@ -581,7 +567,7 @@ void GreatConverter::ProcessCAENData(){
 		}
 		
 		my_adc_data = my_adc_data & 0x7FFF; // 15 bits from 0
-		hcaen_qshort[my_mod_id][my_ch_id]->Fill( my_adc_data );
+		hcaen_qshort[my_mod_id][my_ch_id]->FillRaw( my_adc_data );
 		if( my_adc_data == 0x7FFF ) caen_data->SetQshort( 0 );
 		else caen_data->SetQshort( my_adc_data );
 		flag_caen_data1 = true;
@@ -702,11 +688,11 @@ void GreatConverter::FinishCAENData(){
 	if( caen_data_check ){
 
 		// Fill histograms
-		hcaen_hit[caen_data->GetModule()]->Fill( ctr_caen_hit[caen_data->GetModule()], caen_data->GetTime(), 1 );
+		hcaen_hit[caen_data->GetModule()]->Fill( ctr_caen_hit[caen_data->GetModule()].load( std::memory_order_relaxed ), caen_data->GetTime(), 1 );
 
 		// Difference between Qlong and Qshort
 		int qdiff = (int)caen_data->GetQlong() - (int)caen_data->GetQshort();
-		hcaen_qdiff[caen_data->GetModule()][caen_data->GetChannel()]->Fill( qdiff );
+		hcaen_qdiff[caen_data->GetModule()][caen_data->GetChannel()]->FillRaw( qdiff );
 
 		// Choose the energy we want to use
 		unsigned short adc_value = 0;
@@ -737,6 +723,7 @@ void GreatConverter::FinishCAENData(){
 			data_vector.emplace_back( data_packet );
 			data_map.push_back( std::make_pair<unsigned long,double>(
 				data_vector.size()-1, data_packet->GetTime() ) );
+			if( data_packet->GetTime() > stream_time ) stream_time = data_packet->GetTime();
 		}
 
 	}
@@ -759,7 +746,7 @@ void GreatConverter::FinishCAENData(){
 	else return;
 
 	// Count the hit, even if it's bad
-	ctr_caen_hit[caen_data->GetModule()]++;
+	ctr_caen_hit[caen_data->GetModule()].fetch_add( 1, std::memory_order_relaxed );
 	
 	// Assuming it did finish, in a good way or bad, clean up.
 	flag_caen_data0 = false;
@@ -813,6 +800,7 @@ void GreatConverter::ProcessInfoData(){
 			data_vector.emplace_back( data_packet );
 			data_map.push_back( std::make_pair<unsigned long,double>(
 				data_vector.size()-1, data_packet->GetTime() ) );
+			if( data_packet->GetTime() > stream_time ) stream_time = data_packet->GetTime();
 		}
 
 	}
@@ -834,6 +822,7 @@ bool GreatConverter::ProcessCurrentBlock( int nblock ) {
 	// Check once more after going over left overs....
 	if( !flag_terminator ){
 
+		ctr_decode_err.fetch_add( 1, std::memory_order_relaxed );
 		std::cerr << std::endl << __PRETTY_FUNCTION__ << std::endl;
 		std::cerr << "\tERROR - Didn't complete block data correctly.\n";
 		return false;
@@ -983,18 +972,25 @@ void GreatConverter::SortDataMap() {
 
 unsigned long long GreatConverter::SortTree( bool do_sort ){
 
+	// Batches of the DataSpy
+	if( flag_online ) return SortTreeOnline();
+
 	// Reset the sorted tree so it's empty before we start
 	sorted_tree->Reset();
 	
 	// Get number of data packets
 	long long int n_ents = data_vector.size();	// std::vector method
 
-	// Check we have entries and build time-ordered index
-	if( n_ents && do_sort ) {
+	// Check we have entries
+	if( !n_ents ) return 0;
+
+	// Build time-ordered index, otherwise the data stay in the DAQ order
+	// and the event builder has to put them in order with its reorder buffer
+	if( do_sort && set->IsFullTimeSort() ) {
 		std::cout << "Time ordering " << n_ents << " data items..." << std::endl;
 		SortDataMap();
 	}
-	else return 0;
+	else std::cout << "Skipping the time ordering of " << n_ents << " data items" << std::endl;
 
 	// Loop on t_raw entries and fill t
 	std::cout << "Writing time-ordered data items to the output tree..." << std::endl;
@@ -1039,3 +1035,151 @@ unsigned long long GreatConverter::SortTree( bool do_sort ){
 	return n_ents;
 
 }
+
+////////////////////////////////////////////////////////////////////////////////
+/// Writes the hits of the latest batch in time order, see GreatConverter::TakeOrdered
+/// \return The number of data items written to the sorted tree
+unsigned long long GreatConverter::SortTreeOnline(){
+
+	// Reset the sorted tree so it's empty before we start
+	sorted_tree->Reset();
+
+	std::vector<std::shared_ptr<GreatDataPackets>> packets;
+	TakeOrdered( packets );
+	for( unsigned long i = 0; i < packets.size(); ++i ) {
+
+		write_packet->SetData( packets[i] );
+		sorted_tree->Fill();
+
+	}
+
+	return packets.size();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hands over the hits of the latest batch in time order, together with those
+/// kept from the batch before. Hits within the ReorderTolerance of the latest
+/// one, or later than the watermark of the DataSpy streams, may still have
+/// earlier hits coming in the next batch. They are kept back, up to
+/// ReorderBufferSize of them. Nothing else stays in memory, so
+/// that the memory is flat during a long run.
+/// \param[out] packets The hits that are final, in time order
+/// \return The number of hits handed over
+unsigned long GreatConverter::TakeOrdered( std::vector<std::shared_ptr<GreatDataPackets>> &packets ){
+
+	packets.clear();
+
+	// Check we have entries
+	unsigned long n_ents = data_map.size();
+	if( !n_ents ) return 0;
+
+	// Time order the batch and the tail of the last one
+	SortDataMap();
+
+	// Nothing can be kept for late hits
+	if( !flag_online_out && set->GetReorderTolerance() <= 0 ) {
+
+		std::cerr << "ReorderTolerance is 0, no hits are kept for the next batch ";
+		std::cerr << "and late hits will be out of order" << std::endl;
+
+	}
+
+	// Keep back everything close to the latest hit or the slowest stream, but not too much
+	double time_cut = std::min( data_map.back().second, online_watermark ) - set->GetReorderTolerance();
+	unsigned long n_write = 0;
+	while( n_write < n_ents && data_map[n_write].second <= time_cut )
+		n_write++;
+	if( n_ents - n_write > set->GetReorderBufferSize() )
+		n_write = n_ents - set->GetReorderBufferSize();
+
+	// Hand over the final part
+	unsigned long late_before = ctr_online_late;
+	packets.reserve( n_write );
+	for( unsigned long i = 0; i < n_write; ++i ) {
+
+		// Too late to be put in order, it still goes in
+		if( flag_online_out && data_map[i].second < online_time_out )
+			ctr_online_late++;
+		online_time_out = data_map[i].second;
+		flag_online_out = true;
+
+		packets.push_back( std::move( data_vector[ data_map[i].first ] ) );
+
+	}
+
+	// Move the tail to the front, it is in time order already
+	std::vector<std::shared_ptr<GreatDataPackets>> tail;
+	std::vector<std::pair<unsigned long,double>> tail_map;
+	tail.reserve( n_ents - n_write );
+	tail_map.reserve( n_ents - n_write );
+	for( unsigned long i = n_write; i < n_ents; ++i ) {
+
+		tail_map.push_back( std::make_pair( (unsigned long)tail.size(), data_map[i].second ) );
+		tail.push_back( std::move( data_vector[ data_map[i].first ] ) );
+
+	}
+	data_vector.swap( tail );
+	data_map.swap( tail_map );
+
+	std::cout << "Taking " << n_write << " time-ordered data items, keeping ";
+	std::cout << data_vector.size() << " for the next batch" << std::endl;
+	if( ctr_online_late > late_before ) {
+
+		std::cout << ctr_online_late - late_before << " data items came too late to be ordered (";
+		std::cout << ctr_online_late << " in total)" << std::endl;
+
+	}
+
+	return n_write;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hands the converted data over without going through the sorted tree, used
+/// by the online pipeline after every block
+/// \param[out] packets The data items converted since the last call, in the order of the DAQ
+/// \return The number of data items
+unsigned long GreatConverter::TakePackets( std::vector<std::shared_ptr<GreatDataPackets>> &packets ){
+
+	packets.swap( data_vector );
+	data_vector.clear();
+	data_map.clear();
+
+	return packets.size();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Blocks from different DataSpy streams can be converted in turn, as long as
+/// the stream is set before each of them. The upper bits of the timestamps
+/// from the info data are then kept for each stream separately.
+/// \param[in] s The number of the stream of the next blocks
+void GreatConverter::SetStream( unsigned int s ){
+
+	if( s == cur_stream ) return;
+
+	if( stream_state.size() <= std::max( s, cur_stream ) ) {
+
+		stream_state_t empty;
+		empty.tm_stp_msb = 0;
+		empty.tm_stp_hsb = 0;
+		empty.time = 0;
+		stream_state.resize( std::max( s, cur_stream ) + 1, empty );
+
+	}
+
+	// Keep the state of the old stream
+	stream_state[cur_stream].tm_stp_msb = my_tm_stp_msb;
+	stream_state[cur_stream].tm_stp_hsb = my_tm_stp_hsb;
+	stream_state[cur_stream].time = stream_time;
+
+	// And carry on where the new one was
+	cur_stream = s;
+	my_tm_stp_msb = stream_state[s].tm_stp_msb;
+	my_tm_stp_hsb = stream_state[s].tm_stp_hsb;
+	stream_time = stream_state[s].time;
+
+	return;
+
+}
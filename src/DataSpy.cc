@@ -121,11 +121,13 @@ int DataSpy::ReadWithSeq( int id, char *data, unsigned int length, int *seq ) {
 		return -1;
 	}
 	
-	len = 0;
 	baseaddress = (BUFFER_HEADER *) shm_bufferarea[id];
 	
 retry:
 	
+	// an age of zero is a buffer that is being written, so nothing is read yet
+	len = 0;
+	
 	if( baseaddress->buffer_age[next_index[id]] != 0 ) {
 		
 		if( baseaddress->buffer_age[next_index[id]] >= current_age[id] ) {
@@ -0,0 +1,249 @@
+#include "DataSpyProducer.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is created until GreatDataSpyProducer::Open
+/// \param[in] id The shared memory ID, as for DataSpy::Open
+/// \param[in] block_size The length of each buffer, at most MAX_BUFFER_SIZE
+GreatDataSpyProducer::GreatDataSpyProducer( int id, unsigned int block_size ){
+
+	this->id = id;
+	this->block_size = block_size;
+
+	area = nullptr;
+	header = nullptr;
+	n_written = 0;
+
+}
+
+GreatDataSpyProducer::~GreatDataSpyProducer(){
+
+	Close();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// An area left over from an earlier run with the same ID is used again
+/// \return false if the shared memory could not be created
+bool GreatDataSpyProducer::Open(){
+
+	if( area ) return true;
+
+	if( id < 0 || id >= MAX_ID ) {
+
+		std::cerr << "DataSpy producer: ID " << id << " out of range" << std::endl;
+		return false;
+
+	}
+
+	if( block_size == 0 || block_size > MAX_BUFFER_SIZE ||
+	    kHeaderSpace + NBLOCKS * block_size > SHMSIZE ) {
+
+		std::cerr << "DataSpy producer: block size " << block_size << " does not fit" << std::endl;
+		return false;
+
+	}
+
+#if( defined SOLARIS || defined POSIX )
+
+	snprintf( object_name, sizeof(object_name), "SHM_%d", SHM_KEY+id );
+
+	int fd = shm_open( object_name, O_CREAT | O_RDWR, (mode_t)0644 );
+	if( fd == -1 ) {
+		perror( "shm_open" );
+		return false;
+	}
+
+	if( ftruncate( fd, (off_t)SHMSIZE ) == -1 ) {
+		perror( "ftruncate" );
+		close( fd );
+		return false;
+	}
+
+	area = mmap( (void *) NULL, (size_t) SHMSIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t) 0 );
+	close( fd );
+	if( area == (void *) MAP_FAILED ) {
+		perror( "mmap" );
+		area = nullptr;
+		return false;
+	}
+
+#else
+
+	shmid = shmget( SHM_KEY+id, SHMSIZE, IPC_CREAT | 0644 );
+	if( shmid == -1 ) {
+		perror( "shmget" );
+		return false;
+	}
+
+	area = shmat( shmid, (void *) 0, 0 );
+	if( area == (void *) -1 ) {
+		perror( "shmat" );
+		area = nullptr;
+		return false;
+	}
+
+#endif
+
+	// Empty ring, the readers wait for the first age that is not zero
+	header = (BUFFER_HEADER *) area;
+	memset( area, 0, kHeaderSpace );
+	header->buffer_offset = kHeaderSpace;
+	header->buffer_number = NBLOCKS;
+	header->buffer_length = block_size;
+	header->buffer_next = 0;
+	header->buffer_max = MAX_BUFFERS;
+	header->buffer_currentage = 0;
+
+	std::cout << "DataSpy producer: shared buffer area " << id << " (/SHM_" << SHM_KEY+id;
+	std::cout << ") with " << NBLOCKS << " buffers of " << block_size << " bytes" << std::endl;
+
+	return true;
+
+}
+
+void GreatDataSpyProducer::Close(){
+
+	if( !area ) return;
+
+#if( defined SOLARIS || defined POSIX )
+
+	munmap( area, (size_t) SHMSIZE );
+	shm_unlink( object_name );
+
+#else
+
+	shmdt( area );
+	shmctl( shmid, IPC_RMID, (struct shmid_ds *) NULL );
+
+#endif
+
+	area = nullptr;
+	header = nullptr;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The age of the slot is cleared while it is written, so that a reader that
+/// is copying it at the same time sees the change and tries again, and one
+/// that comes to it in the meantime finds no data and waits
+/// \param[in] data The buffer
+/// \param[in] length Its length in bytes, anything beyond the block size is cut
+void GreatDataSpyProducer::Write( const char *data, unsigned int length ){
+
+	if( !area ) return;
+
+	int idx = header->buffer_next;
+	char *buffer = (char *)area + header->buffer_offset + (size_t)idx * block_size;
+	unsigned long long age = header->buffer_currentage + 1;
+
+	header->buffer_age[idx] = 0;
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+
+	memcpy( buffer, data, std::min( length, block_size ) );
+	if( length < block_size ) memset( buffer + length, 0, block_size - length );
+
+	std::atomic_thread_fence( std::memory_order_seq_cst );
+	header->buffer_age[idx] = age;
+	header->buffer_currentage = age;
+	header->buffer_next = ( idx + 1 ) & ( NBLOCKS - 1 );
+
+	n_written++;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Writes every block of a file in to the ring, paced in one of three ways
+/// \param[in] input_file_name The MIDAS file
+/// \param[in] rate Blocks per second, used if larger than zero
+/// \param[in] speed Multiple of real time from the timestamps, used if larger than zero and there is no rate
+/// \param[in] conv Converter for the timestamps, only needed for the speed
+/// \return The number of blocks written
+unsigned long long GreatDataSpyProducer::Replay( std::string input_file_name, double rate, double speed,
+												 std::shared_ptr<GreatConverter> conv ){
+
+	if( !Open() ) return 0;
+
+	std::ifstream input_file( input_file_name, std::ios::in|std::ios::binary );
+	if( !input_file.is_open() ) {
+
+		std::cout << "Cannot open " << input_file_name << std::endl;
+		return 0;
+
+	}
+
+	std::cout << "Replaying " << input_file_name << " in to DataSpy ID " << id;
+	if( rate > 0 ) std::cout << " at " << rate << " blocks/s" << std::endl;
+	else if( speed > 0 && conv ) std::cout << " at " << speed << " times real time" << std::endl;
+	else std::cout << " as fast as possible" << std::endl;
+
+	std::vector<char> block( block_size );
+	std::vector<std::shared_ptr<GreatDataPackets>> packets;
+	auto start = std::chrono::steady_clock::now();
+	auto last_print = start;
+	unsigned long long n_blocks = 0, n_print = 0;
+	double time_first = -1, time_data = 0;
+
+	while( input_file.read( block.data(), block_size ) ) {
+
+		// Wait until it is time for this block
+		auto target = start;
+		if( rate > 0 ) {
+
+			target += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+						std::chrono::duration<double>( n_blocks / rate ) );
+
+		}
+
+		else if( speed > 0 && conv ) {
+
+			// Timestamps of the hits in this block, the hits are not needed
+			conv->ConvertBlock( block.data(), n_blocks );
+			conv->TakePackets( packets );
+			packets.clear();
+
+			time_data = conv->GetStreamTime();
+			if( time_first < 0 && time_data > 0 ) time_first = time_data;
+			if( time_first >= 0 ) {
+
+				target += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+							std::chrono::duration<double>( ( time_data - time_first ) * 1e-9 / speed ) );
+
+			}
+
+		}
+
+		std::this_thread::sleep_until( target );
+		Write( block.data(), block_size );
+		n_blocks++;
+
+		// Progress once a second
+		auto now = std::chrono::steady_clock::now();
+		double dt = std::chrono::duration<double>( now - last_print ).count();
+		if( dt > 1.0 ) {
+
+			double mb = ( n_blocks - n_print ) * (double)block_size / 1024. / 1024.;
+			std::cout << " " << n_blocks << " blocks, " << std::fixed << std::setprecision(1);
+			std::cout << mb / dt << " MB/s, " << ( n_blocks - n_print ) / dt << " blocks/s";
+			if( time_first >= 0 ) std::cout << ", " << ( time_data - time_first ) * 1e-9 << " s of data";
+			std::cout << std::defaultfloat << "    \r";
+			std::cout.flush();
+
+			last_print = now;
+			n_print = n_blocks;
+
+		}
+
+	}
+
+	double total = std::chrono::duration<double>( std::chrono::steady_clock::now() - start ).count();
+	std::cout << "\nReplayed " << n_blocks << " blocks in " << total << " s";
+	if( total > 0 ) std::cout << " (" << n_blocks * (double)block_size / 1024. / 1024. / total << " MB/s)";
+	std::cout << std::endl;
+
+	return n_blocks;
+
+}
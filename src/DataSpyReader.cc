@@ -0,0 +1,144 @@
+#include "DataSpyReader.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is opened until GreatDataSpyReader::Start
+/// \param[in] id The shared memory ID, as for DataSpy::Open
+/// \param[in] block_size The number of bytes to copy from each buffer
+/// \param[in] queue_size The maximum number of blocks waiting for the monitor
+/// \param[in] max_backoff The longest sleep in ms when there is no data
+GreatDataSpyReader::GreatDataSpyReader( int id, unsigned int block_size,
+									   unsigned int queue_size, double max_backoff ){
+
+	this->id = id;
+	this->block_size = block_size;
+	this->queue_size = queue_size > 0 ? queue_size : 1;
+	this->max_backoff = max_backoff;
+
+	running = false;
+	last_age = 0;
+	n_blocks = 0;
+	n_bytes = 0;
+	n_lost = 0;
+	n_waits = 0;
+	max_depth = 0;
+
+}
+
+GreatDataSpyReader::~GreatDataSpyReader(){
+
+	Stop();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return false if the reader was already running or the shared memory could not be opened
+bool GreatDataSpyReader::Start(){
+
+	if( running ) return false;
+
+	spy.Verbose( 0 );
+	if( spy.Open( id ) != 0 ) return false;
+
+	// Buffers older than this were there before we started
+	last_age = spy.current_age[id];
+
+	running = true;
+	reader = std::thread( &GreatDataSpyReader::Run, this );
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Blocks still in the queue can be drained afterwards
+void GreatDataSpyReader::Stop(){
+
+	if( !running ) return;
+
+	running = false;
+	queue_space.notify_all();
+	if( reader.joinable() ) reader.join();
+
+	spy.Close( id );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Spins for kSpinCount empty reads, then sleeps with an exponential backoff
+/// from 50 µs up to max_backoff. Any data resets the backoff.
+void GreatDataSpyReader::Run(){
+
+	const double min_backoff = 0.05;	// ms
+	unsigned int n_empty = 0;
+	double backoff = min_backoff;
+
+	std::vector<char> block;
+
+	while( running ) {
+
+		// Get an empty block from the pool if there is one
+		if( block.size() != block_size ) {
+
+			std::lock_guard<std::mutex> lock( queue_mutex );
+			if( pool.size() ) {
+
+				block = std::move( pool.back() );
+				pool.pop_back();
+
+			}
+			block.resize( block_size );
+
+		}
+
+		int length = spy.Read( id, block.data(), block_size );
+
+		// Nothing new, spin then back off
+		if( length <= 0 ) {
+
+			if( ++n_empty > kSpinCount ) {
+
+				std::this_thread::sleep_for( std::chrono::microseconds( (long)( backoff * 1e3 ) ) );
+				backoff = std::min( backoff * 2.0, max_backoff );
+
+			}
+			else std::this_thread::yield();
+
+			continue;
+
+		}
+
+		n_empty = 0;
+		backoff = min_backoff;
+		auto read_time = std::chrono::steady_clock::now();
+
+		// The ages increase by one for each buffer, a jump means we missed some
+		unsigned long long age = spy.current_age[id];
+		if( last_age > 0 && age > last_age + 1 )
+			n_lost += age - last_age - 1;
+		last_age = age;
+
+		n_blocks++;
+		n_bytes += length;
+
+		// Queue it, waiting for the monitor if there is no space
+		std::unique_lock<std::mutex> lock( queue_mutex );
+		if( queue.size() >= queue_size ) {
+
+			n_waits++;
+			queue_space.wait( lock, [this]{ return queue.size() < queue_size || !running; } );
+
+		}
+
+		queue.push_back( std::move( block ) );
+		queue_length.push_back( length );
+		queue_time.push_back( read_time );
+		if( queue.size() > max_depth ) max_depth = queue.size();
+		block.clear();
+
+	}
+
+	return;
+
+}
@@ -49,6 +49,9 @@ void GreatEventBuilder::StartFile(){
 	cebr3_ctr	= 0;
 	hpge_ctr	= 0;
 
+	n_evts_built	= 0;
+	flag_hit_prev	= false;
+
 	for( unsigned int i = 0; i < set->GetNumberOfCAENModules(); ++i ) {
 
 		caen_time_start[i] = 0;
@@ -86,6 +89,29 @@ void GreatEventBuilder::SetInputFile( std::string input_file_name ) {
 	
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// All files are added to a single TChain and read as one continuous stream of
+/// hits, so that events are not cut at the boundaries between files. This is
+/// meant for runs split in to several subruns, given in their time order.
+/// \param [in] input_file_names The list of time-sorted ROOT files (typical suffix is "_sort.root")
+void GreatEventBuilder::SetInputFile( std::vector<std::string> input_file_names ) {
+
+	// Chain the files together
+	input_file = nullptr;
+	input_chain = new TChain( "great_sort" );
+	for( unsigned int i = 0; i < input_file_names.size(); ++i )
+		input_chain->Add( input_file_names[i].data() );
+
+	flag_input_file = true;
+
+	// Set the input tree
+	SetInputTree( input_chain );
+	StartFile();
+
+	return;
+
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// Sets the private member input_tree to the parameter user_tree, sets the branch address and calls the GreatEventBuilder::StartFile function
 /// \param [in] user_tree The name of the tree in the ROOT file containing the time-sorted events
@@ -93,6 +119,7 @@ void GreatEventBuilder::SetInputTree( TTree *user_tree ){
 	
 	// Find the tree and set branch addresses
 	input_tree = user_tree;
+	if( !in_data ) in_data = new GreatDataPackets();
 	input_tree->SetBranchAddress( "data", &in_data );
 
 	return;
@@ -111,6 +138,29 @@ void GreatEventBuilder::SetOutput( std::string output_file_name ) {
 	cebr3_evt	= std::make_shared<GreatCeBr3Evt>();
 	hpge_evt	= std::make_shared<GreatHPGeEvt>();
 
+	// Keep track of the files in case we roll over
+	output_base = output_file_name.substr( 0, output_file_name.find_last_of(".") );
+	output_names.clear();
+	output_names.push_back( output_file_name );
+	n_evts_closed = 0;
+
+	// Window scans are made again in the new file
+	scan_eb.clear();
+
+	// Create log file.
+	std::string log_file_name = output_base + ".log";
+	log_file.open( log_file_name.data(), std::ios::app );
+	
+	// Output file, tree and histograms
+	OpenOutput( output_file_name );
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Creates the output file and the events tree, and calls the GreatEventBuilder::MakeHists function
+/// \param [in] output_file_name The ROOT file for storing the events
+void GreatEventBuilder::OpenOutput( std::string output_file_name ) {
+
 	// ------------------------------------------------------------------------ //
 	// Create output file and create events tree
 	// ------------------------------------------------------------------------ //
@@ -118,15 +168,88 @@ void GreatEventBuilder::SetOutput( std::string output_file_name ) {
 	output_tree = new TTree( "evt_tree", "evt_tree" );
 	output_tree->Branch( "GreatEvts", "GreatEvts", write_evts.get() );
 	output_tree->SetAutoFlush();
+	output_dir = output_file;
 
-	// Create log file.
-	std::string log_file_name = output_file_name.substr( 0, output_file_name.find_last_of(".") );
-	log_file_name += ".log";
-	log_file.open( log_file_name.data(), std::ios::app );
-	
 	// Hisograms in separate function
 	MakeHists();
-	
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Called when the output file has grown beyond the EventsFileMaxSize setting.
+/// The tree and histograms are written and the file is closed, then a new file
+/// is opened with the same name plus a counter, e.g. "_events_1.root". Each file
+/// has its own histograms for the events it contains, and the name of the file
+/// that follows it, which GreatEventBuilder::ReadOutputNames uses later on.
+void GreatEventBuilder::RollOver() {
+
+	// The name of the next file
+	std::string output_file_name = output_base + "_";
+	output_file_name += std::to_string( output_names.size() ) + ".root";
+	output_names.push_back( output_file_name );
+
+	// Finish the current file
+	n_evts_closed += output_tree->GetEntries();
+	output_tree->FlushBaskets();
+	WriteHists();
+	output_file->cd();
+	TNamed next_file( "next_file", output_file_name.substr( output_file_name.find_last_of("/")+1 ).data() );
+	next_file.Write();
+	output_file->Write( 0, TObject::kWriteDelete );
+	output_tree->ResetBranchAddresses();
+	output_file->Close();
+
+	// Continue in the next one
+
+	std::cout << " Event Building: continuing in " << output_file_name << std::endl;
+	OpenOutput( output_file_name );
+	OpenScans();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Finds all the files of an events output that was written before, by
+/// following the name of the next file that GreatEventBuilder::RollOver leaves
+/// in each one. The files are expected in the same directory as the first.
+/// \param[in] first_name The events file that the output started with
+/// \return The first file and all files after a roll over, in order
+std::vector<std::string> GreatEventBuilder::ReadOutputNames( std::string first_name ) {
+
+	std::vector<std::string> names;
+	std::string dir_name;
+	if( first_name.find_last_of("/") != std::string::npos )
+		dir_name = first_name.substr( 0, first_name.find_last_of("/")+1 );
+
+	std::string name = first_name;
+	while( name.length() ) {
+
+		TFile *f = new TFile( name.data(), "read" );
+		if( f->IsZombie() ) {
+
+			std::cerr << name << " is missing from the events output" << std::endl;
+			delete f;
+			break;
+
+		}
+
+		names.push_back( name );
+
+		// Is there another file after this one?
+		// The TNamed is not owned by the file, so it is deleted here
+		TNamed *next_file = (TNamed*)f->Get( "next_file" );
+		if( next_file ) name = dir_name + next_file->GetTitle();
+		else name.clear();
+		delete next_file;
+
+		f->Close();
+		delete f;
+
+	}
+
+	return names;
+
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -160,6 +283,366 @@ void GreatEventBuilder::Initialise(){
 	
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// Unpacks the CAEN data in caen_data into the generic data variables:
+/// mymod, mych, mytime, myenergy and mythres. The energy and threshold are
+/// taken from the calibration if a new one was given.
+void GreatEventBuilder::GetCaenHit() {
+
+	mymod = caen_data->GetModule();
+	mych = caen_data->GetChannel();
+	mytime = caen_data->GetTime();
+
+	// assume this is above threshold initially
+	mythres = true;
+
+	//std::cout << i << "\t" << caen_data->GetTimeStamp() << "\t" << caen_data->GetFineTime() << std::endl;
+	
+	if( overwrite_cal ) {
+		
+		std::string entype = cal->CaenType( mymod, mych );
+		unsigned short adc_value = 0;
+		if( entype == "Qlong" ) adc_value = caen_data->GetQlong();
+		else if( entype == "Qshort" ) adc_value = caen_data->GetQshort();
+		else if( entype == "Qdiff" ) adc_value = caen_data->GetQdiff();
+		else {
+			std::cerr << "Incorrect CAEN energy type must be Qlong, Qshort or Qdiff" << std::endl;
+			adc_value = caen_data->GetQlong();
+		}
+		myenergy = cal->CaenEnergy( mymod, mych, adc_value );
+		
+		if( adc_value < cal->CaenThreshold( mymod, mych ) )
+			mythres = false;
+
+	}
+	
+	else {
+		
+		myenergy = caen_data->GetEnergy();
+		mythres = caen_data->IsOverThreshold();
+
+	}
+	
+	// Is it the start event?
+	if( caen_time_start.at( mymod ) == 0 )
+		caen_time_start.at( mymod ) = mytime;
+	
+	// or is it the end event (we don't know so keep updating)
+	if( mytime > caen_time_stop.at( mymod ) )
+		caen_time_stop.at( mymod ) = mytime;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Adds the current CAEN hit, unpacked by GreatEventBuilder::GetCaenHit, to
+/// the list of the detector type that it belongs to. Hits below threshold are
+/// ignored.
+void GreatEventBuilder::AddCaenHit() {
+
+	// Is it a TAC?
+	if( set->IsTAC( mymod, mych ) && mythres ) {
+		
+		myid = set->GetTACID( mymod, mych );
+
+		tac_td_list.push_back( myenergy );
+		tac_ts_list.push_back( mytime );
+		tac_id_list.push_back( myid );
+
+		hit_ctr++; // increase counter for bits of data included in this event
+
+	}
+	
+	// Is it a CeBr3?
+	else if( set->IsCeBr3( mymod, mych ) && mythres ) {
+
+		myid = set->GetCeBr3Detector( mymod, mych );
+
+		cebr3_en_list.push_back( myenergy );
+		cebr3_ts_list.push_back( mytime );
+		cebr3_id_list.push_back( myid );
+
+		hit_ctr++; // increase counter for bits of data included in this event
+
+	}
+
+	// Is it a HPGe?
+	else if( set->IsHPGe( mymod, mych ) && mythres ) {
+
+		myid = set->GetHPGeDetector( mymod, mych );
+		myseg = set->GetHPGeSegment( mymod, mych );
+
+		hpge_en_list.push_back( myenergy );
+		hpge_ts_list.push_back( mytime );
+		hpge_id_list.push_back( myid );
+		hpge_seg_list.push_back( myseg );
+
+		hit_ctr++; // increase counter for bits of data included in this event
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Runs the finders on the hits collected in the current event and fills the
+/// output tree if there is anything to write. The lists are not cleared here,
+/// that is done by GreatEventBuilder::Initialise.
+void GreatEventBuilder::CloseEvent() {
+
+	//----------------------------------
+	// Build array events, recoils, etc
+	//----------------------------------
+	TACFinder();		// add an TACEvt for pair of TAC events
+	CeBr3Finder();		// add a gamma-ray event for CeBr detectors
+	HPGeFinder();		// add a gamma-ray event for HPGe detectors
+
+	// Number of hits in the event
+	hit_mult->Fill( hit_ctr );
+
+	// Fill only if we have some physics events
+	if( write_evts->GetTACMultiplicity() ||
+	    write_evts->GetCeBr3Multiplicity() ||
+		write_evts->GetHPGeMultiplicity() ) {
+
+		n_evts_built++;
+		if( output_tree ) output_tree->Fill();
+		if( event_sink ) event_sink( *write_evts );
+
+	}
+
+	// Start a new file if this one is too big, the window scans follow the main file
+	if( !flag_scan && set->GetEventsFileMaxSize() > 0 &&
+	    output_file->GetEND() > set->GetEventsFileMaxSize() * 1024. * 1024. )
+		RollOver();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Adds a single hit to the event building. If the hit is outside the window
+/// of the open event, that event is closed first. The hits have to be given in
+/// time order, which is how GreatEventBuilder::BuildEvents feeds them to this
+/// event builder and to the event builders of the window scan.
+/// \param[in] data The next hit in time order
+void GreatEventBuilder::ProcessData( GreatDataPackets *data ) {
+
+	//------------------------------
+	//  check if this hit is still part of the open event
+	//------------------------------
+	if( flag_hit_prev ) {
+
+		// Time difference to the first hit of the event
+		time_diff = data->GetTime() - time_first; // no correction
+
+		// window = time_stamp_first + time_window
+		if( time_diff > build_window )
+			flag_close_event = true; // set flag to close this event
+
+		// we've gone on to the next file in the chain
+		else if( time_diff < 0 )
+			flag_close_event = true; // set flag to close this event
+
+		// Fill tdiff hist only for real data
+		if( !data->IsInfo() ) {
+
+			tdiff->Fill( time_diff );
+			if( mythres )
+				tdiff_clean->Fill( time_diff );
+
+		}
+
+	}
+
+	flag_hit_prev = true;
+
+	//----------------------------
+	// close the event before adding this hit
+	//----------------------------
+	if( flag_close_event ) {
+
+		// If we opened the event, then sort it out
+		if( event_open ) CloseEvent();
+
+		//--------------------------------------------------
+		// clear values of arrays to store intermediate info
+		//--------------------------------------------------
+		Initialise();
+
+	}
+
+	// Get the time of the event
+	mytime = data->GetTime();
+
+	// record time of this event
+	time_prev = mytime;
+
+	// assume this is above threshold initially
+	mythres = true;
+
+
+	// ------------------------------------------ //
+	// Find CAEN ADC data
+	// ------------------------------------------ //
+	if( data->IsCaen() ) {
+
+		// Increment event counter
+		n_caen_data++;
+
+		// Unpack the hit and add it to the lists
+		caen_data = data->GetCaenData();
+		GetCaenHit();
+
+		// If it's below threshold do not use as window opener
+		if( mythres ) event_open = true;
+
+		// DETERMINE WHICH TYPE OF CAEN EVENT THIS IS
+		AddCaenHit();
+
+	}
+
+
+	// ------------------------------------------ //
+	// Find info events, like timestamps etc
+	// ------------------------------------------ //
+	else if( data->IsInfo() ) {
+
+		// Increment event counter
+		n_info_data++;
+		info_data = data->GetInfoData();
+
+		// if there are no data so far, set this as time_first - multiple info events will just update this so won't be a problem
+		if( hit_ctr == 0 )
+			time_first = mytime;
+
+
+	}
+
+	// Sort out the timing for the event window
+	// but only if it isn't an info event, i.e only for real data
+	if ( !data->IsInfo() ){
+
+		// if this is first datum included in Event
+		if( hit_ctr == 1 && mythres ) {
+
+			time_min	= mytime;
+			time_max	= mytime;
+			time_first	= mytime;
+
+		}
+
+		// Update max time
+		if( mytime > time_max ) time_max = mytime;
+		else if( mytime < time_min ) time_min = mytime;
+
+	} // not info data
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Closes the open event at the end of the input
+void GreatEventBuilder::FlushEvent() {
+
+	if( event_open ) CloseEvent();
+	Initialise();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Creates one event builder for each setting of the window scan, with a copy
+/// of the settings that only differs in the EventWindow, CeBr3HitWindow and
+/// HPGeHitWindow. Their histograms, and trees if WindowScanTrees is set, go in
+/// to scan_N directories of the main output file.
+void GreatEventBuilder::StartScans() {
+
+	scan_eb.clear();
+
+	for( unsigned int i = 0; i < set->GetNumberOfWindowScans(); ++i ) {
+
+		std::shared_ptr<GreatSettings> scan_set = std::make_shared<GreatSettings>( *set );
+		scan_set->SetEventWindow( set->GetWindowScanEventWindow(i) );
+		scan_set->SetCeBr3HitWindow( set->GetWindowScanCeBr3HitWindow(i) );
+		scan_set->SetHPGeHitWindow( set->GetWindowScanHPGeHitWindow(i) );
+
+		std::unique_ptr<GreatEventBuilder> scan = std::make_unique<GreatEventBuilder>( scan_set );
+		if( overwrite_cal ) scan->AddCalibration( cal );
+		scan_eb.push_back( std::move( scan ) );
+
+	}
+
+	OpenScans();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Gives each event builder of the window scan its directory in the current
+/// output file. Also called after a roll over to a new file.
+void GreatEventBuilder::OpenScans() {
+
+	for( unsigned int i = 0; i < scan_eb.size(); ++i ) {
+
+		std::string dirname = "scan_" + std::to_string(i);
+		if( !output_file->GetDirectory( dirname.data() ) )
+			output_file->mkdir( dirname.data() );
+
+		scan_eb[i]->SetOutputDirectory( output_file->GetDirectory( dirname.data() ),
+										set->IsWindowScanTrees() );
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used for the event builders of the window scan, which write in to a
+/// directory of the main output file rather than a file of their own. The
+/// state of the open event is kept, so this can be called at any time.
+/// \param [in] dir The directory for the histograms and tree
+/// \param [in] write_tree Also write the built events to a tree
+void GreatEventBuilder::SetOutputDirectory( TDirectory *dir, bool write_tree ) {
+
+	// These are the branches we need
+	if( !write_evts ) {
+
+		write_evts	= std::make_unique<GreatEvts>();
+		tac_evt		= std::make_shared<GreatTACEvt>();
+		cebr3_evt	= std::make_shared<GreatCeBr3Evt>();
+		hpge_evt	= std::make_shared<GreatHPGeEvt>();
+
+	}
+
+	flag_scan = true;
+	output_file = dir->GetFile();
+	output_dir = dir;
+
+	// Only a tree if asked for
+	output_tree = nullptr;
+	if( write_tree ) {
+
+		output_dir->cd();
+		output_tree = new TTree( "evt_tree", "evt_tree" );
+		output_tree->Branch( "GreatEvts", "GreatEvts", write_evts.get() );
+		output_tree->SetAutoFlush();
+
+	}
+
+	// Hisograms in separate function
+	MakeHists();
+
+	return;
+
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// This loops over all events found in the input file and wraps them up and stores them in the output file
 /// \return The number of entries in the tree that have been sorted (=0 if there is an error)
@@ -186,243 +669,334 @@ unsigned long GreatEventBuilder::BuildEvents() {
 	std::cout << " Event Building: number of entries in input tree = ";
 	std::cout << n_entries << std::endl;
 
+	// Events only open around trigger hits
+	if( set->IsTriggerMode() ) {
+
+		if( set->GetNumberOfWindowScans() )
+			std::cout << " Event Building: window scans are only done without an EventTrigger" << std::endl;
+
+		BuildTriggeredEvents();
+		FinishEvents();
+		return n_entries;
+
+	}
+
+	// Hits go through the reorder buffer if a tolerance is given
+	StartReorder();
+
+	// Event builders of the window scan see the same hits
+	if( scan_eb.size() != set->GetNumberOfWindowScans() ) StartScans();
+	for( unsigned int j = 0; j < scan_eb.size(); ++j ) {
+
+		scan_eb[j]->StartFile();
+		scan_eb[j]->Initialise();
+
+	}
+
 	// ------------------------------------------------------------------------ //
 	// Main loop over TTree to find events
 	// ------------------------------------------------------------------------ //
-	for( unsigned long i = 0; i < n_entries; ++i ) {
+	unsigned long prog_entry = 0;
+	while( NextData() ) {
 		
-		// Get time-ordered event index (with or without walk correction)
-		unsigned long long idx = i; // no correction
-
-		// Current event data
-		if( i == 0 ) input_tree->GetEntry(idx);
-		
-		// Get the time of the event
-		mytime = in_data->GetTime();
-
 		// check time stamp monotonically increases!
 		// but allow for the fine time of the CAEN system
-		if( (unsigned long long)time_prev > in_data->GetTimeStamp() + 5.0 ) {
+		if( (unsigned long long)time_prev > cur_data->GetTimeStamp() + 5.0 ) {
 			
 			std::cout << "Out of order event in file ";
 			std::cout << input_tree->GetName() << std::endl;
 			
 		}
+
+		// Add the hit with the main windows and all of the scan windows
+		ProcessData( cur_data );
+		for( unsigned int j = 0; j < scan_eb.size(); ++j )
+			scan_eb[j]->ProcessData( cur_data );
+
+		// Progress bar, counted on the entries read from the input
+		bool update_progress = false;
+		if( read_entry != prog_entry ) {
+
+			prog_entry = read_entry;
+			if( n_entries < 200 )
+				update_progress = true;
+			else if( read_entry % (n_entries/100) == 0 || read_entry == n_entries )
+				update_progress = true;
+
+		}
 		
-		// record time of this event
-		time_prev = mytime;
-		
-		// assume this is above threshold initially
-		mythres = true;
+		if( update_progress ) {
+
+			// Percent complete
+			float percent = (float)read_entry*100.0/(float)n_entries;
+
+			// Progress bar in GUI
+			if( _prog_ ) {
+				
+				prog->SetPosition( percent );
+				gSystem->ProcessEvents();
+				
+			}
+
+			// Progress bar in terminal
+			std::cout << " " << std::setw(6) << std::setprecision(4);
+			std::cout << percent << "%    \r";
+			std::cout.flush();
+
+		}
 		
 		
-		// ------------------------------------------ //
-		// Find CAEN ADC data
-		// ------------------------------------------ //
+	} // End of main loop over TTree to process raw MIDAS data entries (for n_entries)
+
+	// Close the last events
+	FlushEvent();
+	for( unsigned int j = 0; j < scan_eb.size(); ++j )
+		scan_eb[j]->FlushEvent();
+	
+	// TODO -> if we end on a pause with no resume, add any remaining time to the dead time
+	
+	FinishEvents();
+
+	return n_entries;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Streams a batch of hits through GreatEventBuilder::ProcessData without an
+/// input tree. The last event stays open, so that it can take hits from the
+/// next batch. GreatEventBuilder::StartFile and GreatEventBuilder::Initialise
+/// have to be called once before the first batch.
+/// \param[in] packets Hits in time order, e.g. from GreatConverter::TakeOrdered
+/// \return The number of events built from this batch
+unsigned long GreatEventBuilder::BuildEvents( const std::vector<std::shared_ptr<GreatDataPackets>> &packets ) {
+
+	unsigned long n_before = n_evts_built;
+	for( unsigned long i = 0; i < packets.size(); ++i )
+		ProcessData( packets[i].get() );
+
+	return n_evts_built - n_before;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Creates the reorder buffer if ReorderTolerance is set and rewinds the input.
+/// Hits that arrive within the tolerance of their correct place in time are put
+/// back in order before they reach the event building, which means that the
+/// input does not need to be fully time sorted by the converter. With
+/// FullTimeSort the input is in order already, so the hits are read straight.
+void GreatEventBuilder::StartReorder() {
+
+	read_entry = 0;
+
+	if( set->GetReorderTolerance() > 0 && !set->IsFullTimeSort() ) {
+
+		reorder = std::make_unique<GreatReorderBuffer>(
+						set->GetReorderTolerance(), set->GetReorderBufferSize() );
+
+	}
+
+	else reorder.reset();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Reads the next hit from the input tree, through the reorder buffer if there
+/// is one. The hit is then available from the cur_data pointer.
+/// \return false when there are no more hits in the input
+bool GreatEventBuilder::NextData() {
+
+	// Straight from the tree
+	if( !reorder ) {
+
+		if( read_entry >= n_entries ) return false;
+		input_tree->GetEntry( read_entry++ );
+		cur_data = in_data;
+		return true;
+
+	}
+
+	// Keep reading until the earliest hit cannot be overtaken anymore
+	while( read_entry < n_entries && !reorder->IsReady() ) {
+
+		// The buffer keeps the hit that was read and the branch gets a new one
+		input_tree->GetEntry( read_entry++ );
+		reorder->Add( std::shared_ptr<GreatDataPackets>( in_data ) );
+		in_data = new GreatDataPackets();
+
+	}
+
+	// Then flush the remaining hits at the end of the input
+	if( reorder->IsEmpty() ) return false;
+	reorder_data = reorder->Next();
+	cur_data = reorder_data.get();
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Builds events only around hits on the trigger channels defined by the
+/// EventTrigger setting. A first pass over the input reads only the time, the
+/// channel and the charge of every entry and records which of them are
+/// triggers. If the input is not in time order, the entries are sorted by
+/// their time in memory. Each trigger then opens an event from
+/// TriggerPreWindow before to TriggerPostWindow after its time, and the hits
+/// in that range are found by binary search in the sorted times. Triggers
+/// that fall inside the window of the previous event do not open a new one and
+/// hits are never shared between two events.
+void GreatEventBuilder::BuildTriggeredEvents() {
+
+	std::vector<double> entry_time;			// time of every entry in time order
+	std::vector<unsigned long> entry_list;	// entry numbers in time order
+	std::vector<bool> entry_trig;			// is the entry a trigger?
+	std::vector<unsigned long> trig_list;	// triggers as indices of entry_list
+	entry_time.reserve( n_entries );
+	entry_trig.reserve( n_entries );
+
+	std::cout << " Event Building: finding " << set->GetEventTrigger();
+	std::cout << " triggers" << std::endl;
+
+	// ------------------------------------------------------------------------ //
+	// First pass to find the time of each entry and the triggers
+	// ------------------------------------------------------------------------ //
+	// Only read what is needed for the time and the trigger, not the traces
+	input_tree->SetBranchStatus( "*", false );
+	input_tree->SetBranchStatus( "data", true );
+	const char *time_br[] = { "*caen_packets", "*caen_packets.timestamp",
+		"*caen_packets.finetime", "*caen_packets.mod", "*caen_packets.ch",
+		"*caen_packets.Qlong", "*caen_packets.Qshort", "*caen_packets.thres",
+		"*info_packets", "*info_packets.timestamp" };
+	for( unsigned int j = 0; j < sizeof(time_br)/sizeof(time_br[0]); ++j )
+		input_tree->SetBranchStatus( time_br[j], true );
+
+	bool flag_sorted = true;
+	for( unsigned long i = 0; i < n_entries; ++i ) {
+
+		input_tree->GetEntry(i);
+		mytime = in_data->GetTime();
+
+		// check time stamp monotonically increases!
+		if( mytime < time_prev ) flag_sorted = false;
+		time_prev = mytime;
+		entry_time.push_back( mytime );
+		entry_trig.push_back( false );
+
 		if( in_data->IsCaen() ) {
-			
-			// Increment event counter
+
 			n_caen_data++;
-			
 			caen_data = in_data->GetCaenData();
-			mymod = caen_data->GetModule();
-			mych = caen_data->GetChannel();
+			GetCaenHit();
 
-			//std::cout << i << "\t" << caen_data->GetTimeStamp() << "\t" << caen_data->GetFineTime() << std::endl;
-			
-			if( overwrite_cal ) {
-				
-				std::string entype = cal->CaenType( mymod, mych );
-				unsigned short adc_value = 0;
-				if( entype == "Qlong" ) adc_value = caen_data->GetQlong();
-				else if( entype == "Qshort" ) adc_value = caen_data->GetQshort();
-				else if( entype == "Qdiff" ) adc_value = caen_data->GetQdiff();
-				else {
-					std::cerr << "Incorrect CAEN energy type must be Qlong, Qshort or Qdiff" << std::endl;
-					adc_value = caen_data->GetQlong();
-				}
-				myenergy = cal->CaenEnergy( mymod, mych, adc_value );
-				
-				if( adc_value < cal->CaenThreshold( mymod, mych ) )
-					mythres = false;
+			if( mythres && set->IsEventTrigger( mymod, mych ) )
+				entry_trig.back() = true;
 
-			}
-			
-			else {
-				
-				myenergy = caen_data->GetEnergy();
-				mythres = caen_data->IsOverThreshold();
+		}
 
-			}
-			
-			// If it's below threshold do not use as window opener
-			if( mythres ) event_open = true;
+		else if( in_data->IsInfo() ) n_info_data++;
 
-			// DETERMINE WHICH TYPE OF CAEN EVENT THIS IS
-			// Is it a TAC?
-			if( set->IsTAC( mymod, mych ) && mythres ) {
-				
-				myid = set->GetTACID( mymod, mych );
+	}
 
-				tac_td_list.push_back( myenergy );
-				tac_ts_list.push_back( mytime );
-				tac_id_list.push_back( myid );
+	// Everything is needed to build the events
+	input_tree->SetBranchStatus( "*", true );
 
-				hit_ctr++; // increase counter for bits of data included in this event
+	// The binary search needs the entries in time order
+	entry_list.resize( n_entries );
+	for( unsigned long i = 0; i < n_entries; ++i )
+		entry_list[i] = i;
 
-			}
-			
-			// Is it a CeBr3?
-			else if( set->IsCeBr3( mymod, mych ) && mythres ) {
+	if( !flag_sorted ) {
 
-				myid = set->GetCeBr3Detector( mymod, mych );
+		std::cout << " Event Building: input of " << input_tree->GetName();
+		std::cout << " is not in time order, sorting " << n_entries;
+		std::cout << " entries by time" << std::endl;
 
-				cebr3_en_list.push_back( myenergy );
-				cebr3_ts_list.push_back( mytime );
-				cebr3_id_list.push_back( myid );
+		std::stable_sort( entry_list.begin(), entry_list.end(),
+			[&entry_time]( unsigned long a, unsigned long b ) {
+				return entry_time[a] < entry_time[b];
+			} );
 
-				hit_ctr++; // increase counter for bits of data included in this event
+		std::vector<double> sorted_time( n_entries );
+		for( unsigned long i = 0; i < n_entries; ++i )
+			sorted_time[i] = entry_time[ entry_list[i] ];
+		entry_time.swap( sorted_time );
 
-			}
+	}
 
-			// Is it a HPGe?
-			else if( set->IsHPGe( mymod, mych ) && mythres ) {
+	for( unsigned long i = 0; i < n_entries; ++i )
+		if( entry_trig[ entry_list[i] ] ) trig_list.push_back( i );
 
-				myid = set->GetHPGeDetector( mymod, mych );
-				myseg = set->GetHPGeSegment( mymod, mych );
+	std::cout << " Event Building: " << trig_list.size() << " triggers found" << std::endl;
 
-				hpge_en_list.push_back( myenergy );
-				hpge_ts_list.push_back( mytime );
-				hpge_id_list.push_back( myid );
-				hpge_seg_list.push_back( myseg );
+	// ------------------------------------------------------------------------ //
+	// Second pass to build events around each trigger
+	// ------------------------------------------------------------------------ //
+	unsigned long next_entry = 0;	// first entry that is not used by an event yet
+	double window_end = -1;			// end of the last event window
+	for( unsigned long k = 0; k < trig_list.size(); ++k ) {
 
-				hit_ctr++; // increase counter for bits of data included in this event
+		double trig_time = entry_time[ trig_list[k] ];
 
-			}
+		// This trigger was already part of the last event
+		if( trig_time <= window_end ) continue;
+		window_end = trig_time + set->GetTriggerPostWindow();
 
+		// Binary search for the window edges
+		auto first = std::lower_bound( entry_time.begin() + next_entry, entry_time.end(),
+									   trig_time - set->GetTriggerPreWindow() );
+		auto last = std::upper_bound( first, entry_time.end(), window_end );
 
-			// Is it the start event?
-			if( caen_time_start.at( mymod ) == 0 )
-				caen_time_start.at( mymod ) = mytime;
-			
-			// or is it the end event (we don't know so keep updating)
-			caen_time_stop.at( mymod ) = mytime;
+		// Collect all hits in the window
+		bool flag_first = true;
+		for( unsigned long i = first - entry_time.begin(); i < (unsigned long)(last - entry_time.begin()); ++i ) {
 
-		}
-		
-		
-		// ------------------------------------------ //
-		// Find info events, like timestamps etc
-		// ------------------------------------------ //
-		else if( in_data->IsInfo() ) {
-			
-			// Increment event counter
-			n_info_data++;
-			info_data = in_data->GetInfoData();
-			
-			// if there are no data so far, set this as time_first - multiple info events will just update this so won't be a problem
-			if( hit_ctr == 0 )
-				time_first = mytime;
-			
-			
-		}
-		
-		// Sort out the timing for the event window
-		// but only if it isn't an info event, i.e only for real data
-		if ( !in_data->IsInfo() ){
-			
-			// if this is first datum included in Event
-			if( hit_ctr == 1 && mythres ) {
-				
-				time_min	= mytime;
-				time_max	= mytime;
-				time_first	= mytime;
-				
-			}
-			
-			// Update max time
-			if( mytime > time_max ) time_max = mytime;
-			else if( mytime < time_min ) time_min = mytime;
-			
-		} // not info data
+			input_tree->GetEntry( entry_list[i] );
+			if( !in_data->IsCaen() ) continue;
+
+			caen_data = in_data->GetCaenData();
+			GetCaenHit();
+			AddCaenHit();
+
+			// Time with respect to the first hit of the event
+			if( flag_first ) time_first = mytime;
+			else {
+
+				tdiff->Fill( mytime - time_first );
+				if( mythres ) tdiff_clean->Fill( mytime - time_first );
 
-		//------------------------------
-		//  check if last datum from this event and do some cleanup
-		//------------------------------
-		unsigned long long idx_next = i+1;
-		
-		if( input_tree->GetEntry(idx_next) ) {
-					
-			// Time difference to next event
-			time_diff = in_data->GetTime() - time_first; // no correction
-
-			// window = time_stamp_first + time_window
-			if( time_diff > build_window )
-				flag_close_event = true; // set flag to close this event
-
-			// we've gone on to the next file in the chain
-			else if( time_diff < 0 )
-				flag_close_event = true; // set flag to close this event
-				
-			// Fill tdiff hist only for real data
-			if( !in_data->IsInfo() ) {
-				
-				tdiff->Fill( time_diff );
-				if( mythres )
-					tdiff_clean->Fill( time_diff );
-			
 			}
+			flag_first = false;
+
+			// Time with respect to the trigger
+			tdiff_trig->Fill( mytime - trig_time );
+			if( mythres ) tdiff_trig_clean->Fill( mytime - trig_time );
 
 		}
-		
-		//----------------------------
-		// if close this event or last entry
-		//----------------------------
-		if( flag_close_event || (i+1) == n_entries ) {
-			
-			// If we opened the event, then sort it out
-			if( event_open ) {
-			
-				//----------------------------------
-				// Build array events, recoils, etc
-				//----------------------------------
-				TACFinder();		// add an TACEvt for pair of TAC events
-				CeBr3Finder();		// add a gamma-ray event for CeBr detectors
-				HPGeFinder();		// add a gamma-ray event for HPGe detectors
-
-				// Fill only if we have some physics events
-				if( write_evts->GetTACMultiplicity() ||
-				    write_evts->GetCeBr3Multiplicity() ||
-					write_evts->GetHPGeMultiplicity() )
-					output_tree->Fill();
+		next_entry = last - entry_time.begin();
+
+		// Build and write the event
+		CloseEvent();
+		Initialise();
 
-			}
-			
-			//--------------------------------------------------
-			// clear values of arrays to store intermediate info
-			//--------------------------------------------------
-			Initialise();
-			
-		} // if close event
-				
 		// Progress bar
 		bool update_progress = false;
-		if( n_entries < 200 )
+		if( trig_list.size() < 200 )
 			update_progress = true;
-		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
+		else if( k % (trig_list.size()/100) == 0 || k+1 == trig_list.size() )
 			update_progress = true;
-		
+
 		if( update_progress ) {
 
 			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)n_entries;
+			float percent = (float)(k+1)*100.0/(float)trig_list.size();
 
 			// Progress bar in GUI
 			if( _prog_ ) {
-				
+
 				prog->SetPosition( percent );
 				gSystem->ProcessEvents();
-				
+
 			}
 
 			// Progress bar in terminal
@@ -431,12 +1005,18 @@ unsigned long GreatEventBuilder::BuildEvents() {
 			std::cout.flush();
 
 		}
-		
-		
-	} // End of main loop over TTree to process raw MIDAS data entries (for n_entries)
-	
-	// TODO -> if we end on a pause with no resume, add any remaining time to the dead time
-	
+
+	} // k
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Prints and logs the counters at the end of the event building and writes
+/// the output tree and histograms to disk
+void GreatEventBuilder::FinishEvents() {
+
 	//--------------------------
 	// Clean up
 	//--------------------------
@@ -452,7 +1032,23 @@ unsigned long GreatEventBuilder::BuildEvents() {
 	ss_log << "   TAC events = " << tac_ctr << std::endl;
 	ss_log << "   CeBr3 events = " << cebr3_ctr << std::endl;
 	ss_log << "   HPGe events = " << hpge_ctr << std::endl;
-	ss_log << "  Tree entries = " << output_tree->GetEntries() << std::endl;
+	ss_log << "  Tree entries = " << n_evts_closed + output_tree->GetEntries() << std::endl;
+	if( output_names.size() > 1 )
+		ss_log << "  Output files = " << output_names.size() << std::endl;
+	if( reorder ) {
+		ss_log << "  Reorder buffer: tolerance = " << reorder->GetTolerance();
+		ss_log << " ns, maximum depth = " << reorder->GetMaxDepth() << std::endl;
+		ss_log << "   Reordered hits = " << reorder->GetReordered() << std::endl;
+		ss_log << "   Dropped late hits = " << reorder->GetDropped() << std::endl;
+	}
+	for( unsigned int j = 0; j < scan_eb.size(); ++j ) {
+		ss_log << "  Window scan " << j << ": EventWindow = " << scan_eb[j]->build_window;
+		ss_log << " ns, CeBr3HitWindow = " << scan_eb[j]->set->GetCeBr3HitWindow();
+		ss_log << " ns, HPGeHitWindow = " << scan_eb[j]->set->GetHPGeHitWindow();
+		ss_log << " ns" << std::endl;
+		ss_log << "   Events = " << scan_eb[j]->n_evts_built << std::endl;
+		if( scan_eb[j]->output_tree ) scan_eb[j]->output_tree->FlushBaskets();
+	}
 
 	std::cout << ss_log.str();
 	if( log_file.is_open() && flag_input_file ) log_file << ss_log.str();
@@ -462,6 +1058,7 @@ unsigned long GreatEventBuilder::BuildEvents() {
 	
 	// Force the rest of the events in the buffer to disk
 	output_tree->FlushBaskets();
+	WriteHists();
 	output_file->Write( 0, TObject::kWriteDelete );
 	//output_file->Print();
 	//output_file->Close();
@@ -471,8 +1068,8 @@ unsigned long GreatEventBuilder::BuildEvents() {
 
 	std::cout << " Writing output file... Done!" << std::endl << std::endl;
 
-	return n_entries;
-	
+	return;
+
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -495,7 +1092,7 @@ void GreatEventBuilder::TACFinder() {
 		tac_evt->SetTime( tac_ts_list[i] );
 
 		// Write event to tree
-		write_evts->AddEvt( tac_evt );
+		write_evts->AddEvt( *tac_evt );
 		tac_ctr++;
 
 	}
@@ -513,30 +1110,35 @@ void GreatEventBuilder::CeBr3Finder() {
 
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 
-	// Loop over gamma-ray events
-	for( unsigned int i = 0; i < cebr3_en_list.size(); ++i ) {
+	// Time order the hits and bucket them by detector
+	cebr3_coinc.Clear();
+	for( unsigned int i = 0; i < cebr3_en_list.size(); ++i )
+		cebr3_coinc.AddHit( cebr3_ts_list[i], cebr3_id_list[i], i );
 
-		// Histogram the data
-		cebr3_E->Fill( cebr3_en_list[i] );
-		cebr3_E_vs_det->Fill( cebr3_id_list[i], cebr3_en_list[i] );
+	// Time differences of the pairs within the range of the histogram
+	double td_range = set->GetEventWindow() + 20;
+	for( const auto &p : cebr3_coinc.FindPairs( td_range ) ) {
 
-		// Coincidences
-		for( unsigned int j = i+1; j < cebr3_en_list.size(); ++j ) {
+		double tdiff = cebr3_ts_list[p.second] - cebr3_ts_list[p.first];
+		cebr3_cebr3_td->Fill( tdiff );
+		cebr3_cebr3_td->Fill( -tdiff );
 
-			double tdiff = cebr3_ts_list[j] - cebr3_ts_list[i];
-			cebr3_cebr3_td->Fill( tdiff );
-			cebr3_cebr3_td->Fill( -tdiff );
+	}
 
-			// Just prompt hits for now in a gg matrix
-			// This should really be used for add-back?
-			if( TMath::Abs(tdiff) < set->GetCeBr3HitWindow() ){
+	// Just prompt hits for now in a gg matrix
+	// This should really be used for add-back?
+	for( const auto &p : cebr3_coinc.FindPairs( set->GetCeBr3HitWindow() ) ) {
 
-				cebr3_cebr3_E->Fill( cebr3_en_list[i], cebr3_en_list[j] );
-				cebr3_cebr3_E->Fill( cebr3_en_list[j], cebr3_en_list[i] );
+		cebr3_cebr3_E->Fill( cebr3_en_list[p.first], cebr3_en_list[p.second] );
 
-			} // prompt
+	} // prompt
 
-		} // j
+	// Loop over gamma-ray events
+	for( unsigned int i = 0; i < cebr3_en_list.size(); ++i ) {
+
+		// Histogram the data
+		cebr3_E->Fill( cebr3_en_list[i] );
+		cebr3_E_vs_det->Fill( cebr3_id_list[i], cebr3_en_list[i] );
 
 		// Set the CeBr3 event
 		cebr3_evt->SetEnergy( cebr3_en_list[i] );
@@ -546,7 +1148,7 @@ void GreatEventBuilder::CeBr3Finder() {
 		cebr3_evt->SetTime( cebr3_ts_list[i] );
 
 		// Write event to tree
-		write_evts->AddEvt( cebr3_evt );
+		write_evts->AddEvt( *cebr3_evt );
 		cebr3_ctr++;
 
 	} // i
@@ -557,76 +1159,95 @@ void GreatEventBuilder::CeBr3Finder() {
 
 
 ////////////////////////////////////////////////////////////////////////////////
-/// Builds gamma-ray events from segmented HPGe gamma-ray detectors
+/// Builds gamma-ray events from segmented HPGe gamma-ray detectors.
+/// Segments are matched to the core of the same detector from the detector
+/// buckets of the coincidence engine, while core-core pairs of different
+/// detectors are used for the timing and the gamma-gamma matrix.
 void GreatEventBuilder::HPGeFinder() {
 
 	//std::cout << __PRETTY_FUNCTION__ << std::endl;
 
-	// Loop over gamma-ray events
+	// Time order the hits and bucket them by detector
+	hpge_coinc.Clear();
+	hpge_core_coinc.Clear();
 	for( unsigned int i = 0; i < hpge_en_list.size(); ++i ) {
 
-		// Skip if we don't have a core
-		if( hpge_seg_list[i] != 0 ) continue;
+		hpge_coinc.AddHit( hpge_ts_list[i], hpge_id_list[i], i );
+		if( hpge_seg_list[i] == 0 )
+			hpge_core_coinc.AddHit( hpge_ts_list[i], hpge_id_list[i], i );
 
-		// Segment matching
-		short seg_id_max = 0;
-		float seg_en_max = -1.0;
+	}
 
-		// Histogram the data
-		hpge_E->Fill( hpge_en_list[i] );
-		hpge_E_vs_det->Fill( hpge_id_list[i], hpge_en_list[i] );
+	// Pairs outside the range of the time difference histograms and the hit window are not needed
+	double td_range = std::max( set->GetEventWindow() + 20, set->GetHPGeHitWindow() );
 
-		// Coincidences and segment search
-		for( unsigned int j = 0; j < hpge_en_list.size(); ++j ) {
+	// Segment matching, highest energy segment in the same detector
+	std::vector<short> seg_id_max( hpge_en_list.size(), 0 );
+	std::vector<float> seg_en_max( hpge_en_list.size(), -1.0 );
+	for( const auto &p : hpge_coinc.FindPairs( td_range, GreatCoincidenceFinder::kSameID ) ) {
 
-			// Skip self-coincidences
-			if( i == j ) continue;
+		// We need one core and one segment
+		unsigned int core, seg;
+		if( hpge_seg_list[p.first] == 0 && hpge_seg_list[p.second] != 0 ) {
+			core = p.first;
+			seg = p.second;
+		}
+		else if( hpge_seg_list[p.first] != 0 && hpge_seg_list[p.second] == 0 ) {
+			core = p.second;
+			seg = p.first;
+		}
+		else continue;
 
-			double tdiff = hpge_ts_list[j] - hpge_ts_list[i];
+		double tdiff = hpge_ts_list[seg] - hpge_ts_list[core];
+		hpge_seg_td[hpge_id_list[core]]->Fill( tdiff );
 
-			// If we're in the same detector, search for segment
-			if( hpge_id_list[i] == hpge_id_list[j] ) {
+		// Check if this has the highest energy
+		if( hpge_en_list[seg] > seg_en_max[core] &&
+		    TMath::Abs(tdiff) < set->GetHPGeHitWindow() ) {
 
-				hpge_seg_td[hpge_id_list[i]]->Fill( tdiff );
+			seg_en_max[core] = hpge_en_list[seg];
+			seg_id_max[core] = hpge_seg_list[seg];
 
-				// Check if this has the highest energy
-				if( hpge_en_list[i] > seg_en_max &&
-				    tdiff < set->GetHPGeHitWindow() ) {
+		}
 
-					seg_en_max = hpge_en_list[i];
-					seg_id_max = hpge_id_list[i];
+	} // same detector
 
-				}
+	// Coincidences between cores of different detectors
+	for( const auto &p : hpge_core_coinc.FindPairs( td_range, GreatCoincidenceFinder::kDiffID ) ) {
 
-			} // same detector
+		double tdiff = hpge_ts_list[p.second] - hpge_ts_list[p.first];
+		hpge_hpge_td->Fill( tdiff );
+		hpge_hpge_td->Fill( -tdiff );
 
-			// Otherwise we can make some coincidences
-			else {
+	}
 
-				hpge_hpge_td->Fill( tdiff );
+	// Just prompt hits for now in a gg matrix
+	// This should really be used for add-back?
+	for( const auto &p : hpge_core_coinc.FindPairs( set->GetHPGeHitWindow(), GreatCoincidenceFinder::kDiffID ) ) {
 
-				// Just prompt hits for now in a gg matrix
-				// This should really be used for add-back?
-				if( TMath::Abs(tdiff) < set->GetHPGeHitWindow() ){
+		hpge_hpge_E->Fill( hpge_en_list[p.first], hpge_en_list[p.second] );
 
-					hpge_hpge_E->Fill( hpge_en_list[i], hpge_en_list[j] );
-					hpge_hpge_E->Fill( hpge_en_list[j], hpge_en_list[i] );
+	} // prompt
 
-				} // prompt
+	// Loop over gamma-ray events
+	for( unsigned int i = 0; i < hpge_en_list.size(); ++i ) {
 
-			} // different detectors
+		// Skip if we don't have a core
+		if( hpge_seg_list[i] != 0 ) continue;
 
-		} // j
+		// Histogram the data
+		hpge_E->Fill( hpge_en_list[i] );
+		hpge_E_vs_det->Fill( hpge_id_list[i], hpge_en_list[i] );
 
 		// Set the HPGe event
 		hpge_evt->SetEnergy( hpge_en_list[i] );
 		hpge_evt->SetID( hpge_id_list[i] );
-		hpge_evt->SetSegment( seg_id_max );
+		hpge_evt->SetSegment( seg_id_max[i] );
 		hpge_evt->SetType( 0 );
 		hpge_evt->SetTime( hpge_ts_list[i] );
 
 		// Write event to tree
-		write_evts->AddEvt( hpge_evt );
+		write_evts->AddEvt( *hpge_evt );
 		hpge_ctr++;
 
 	} // i
@@ -643,25 +1264,28 @@ void GreatEventBuilder::MakeHists(){
 	
 	std::string hname, htitle;
 	std::string dirname, maindirname, subdirname;
+
+	// All histograms are booked in the set, in the output directory
+	hist_set.Clear();
+	hist_set.SetDirectory( output_dir );
 	
 	// ----------------- //
 	// Timing histograms //
 	// ----------------- //
 	dirname =  "timing";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	hist_set.MakeDirectory( dirname );
 
-	tdiff = new TH1F( "tdiff", "Time difference to first trigger;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 );
-	tdiff_clean = new TH1F( "tdiff_clean", "Time difference to first trigger without noise;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 );
+	tdiff = hist_set.Book( new TH1F( "tdiff", "Time difference to first trigger;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 ), dirname );
+	tdiff_clean = hist_set.Book( new TH1F( "tdiff_clean", "Time difference to first trigger without noise;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 ), dirname );
+	tdiff_trig = hist_set.Book( new TH1F( "tdiff_trig", "Time difference to the event trigger;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 ), dirname );
+	tdiff_trig_clean = hist_set.Book( new TH1F( "tdiff_trig_clean", "Time difference to the event trigger without noise;#Delta t [ns]", 1.5e3, -0.5e5, 1.0e5 ), dirname );
+	hit_mult = hist_set.Book( new TH1F( "hit_mult", "Number of hits in each event;Multiplicity;Counts", 100, -0.5, 99.5 ), dirname );
 
 	// -------------- //
 	// TAC histograms //
 	// -------------- //
 	dirname = "tac";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	hist_set.MakeDirectory( dirname );
 	
 	htac_id.resize( set->GetNumberOfTACs() );
 
@@ -670,7 +1294,7 @@ void GreatEventBuilder::MakeHists(){
 
 		hname = "tac_" + std::to_string(i);
 		htitle = "TAC time, ID " + std::to_string(i) + ";TAC time (ps);Counts per 2 ps";
-		htac_id[i] = new TH1F( hname.data(), htitle.data(), 16384, -16384, 16384 );
+		htac_id[i] = hist_set.Book( new TH1F( hname.data(), htitle.data(), 16384, -16384, 16384 ), dirname );
 		
 	}
 		
@@ -678,55 +1302,51 @@ void GreatEventBuilder::MakeHists(){
 	// Gamma-ray histograms - CeBr3 //
 	// ---------------------------- //
 	dirname = "cebr3";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	TDirectory *cebr3_dir = hist_set.MakeDirectory( dirname );
 
 
 	hname = "cebr3_E_vs_det";
 	htitle = "Gamma-ray energy vs detector ID for CeBr3 detectors;Detector ID;Energy [keV];Counts per 2 keV";
-	cebr3_E_vs_det = new TH2F( hname.data(), htitle.data(),
-							  set->GetNumberOfCeBr3Detectors()+1, -0.5, set->GetNumberOfCeBr3Detectors()+0.5, 4000, 0, 8000 );
+	cebr3_E_vs_det = hist_set.Book( new TH2F( hname.data(), htitle.data(),
+							  set->GetNumberOfCeBr3Detectors()+1, -0.5, set->GetNumberOfCeBr3Detectors()+0.5, 4000, 0, 8000 ), dirname );
 
 	hname = "cebr3_E";
 	htitle = "Gamma-ray energy for CeBr3 detectors;Energy [keV];Counts per 2 keV";
-	cebr3_E = new TH1F( hname.data(), htitle.data(), 4000, 0, 8000 );
+	cebr3_E = hist_set.Book( new TH1F( hname.data(), htitle.data(), 4000, 0, 8000 ), dirname );
 
 	hname = "cebr3_cebr3_E";
 	htitle = "Gamma-ray energy coincidence matrix for CeBr3 detectors;Energy [keV];Energy [keV];Counts";
-	cebr3_cebr3_E = new TH2F( hname.data(), htitle.data(), 4000, 0, 8000, 4000, 0, 8000 );
+	cebr3_cebr3_E = hist_set.Book( std::make_shared<GreatSymMatrix>( hname, htitle, 4000, 0, 8000, cebr3_dir ), dirname );
 
 	hname = "cebr3_cebr3_td";
 	htitle = "Gamma-gamma time difference for CeBr3 detectors;#Deltat [ns];Counts";
-	cebr3_cebr3_td = new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 );
+	cebr3_cebr3_td = hist_set.Book( new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 ), dirname );
 
 
 	// --------------------------- //
 	// Gamma-ray histograms - HPGe //
 	// --------------------------- //
 	dirname = "hpge";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	TDirectory *hpge_dir = hist_set.MakeDirectory( dirname );
 
 
 	hname = "hpge_E_vs_det";
 	htitle = "Gamma-ray energy vs detector ID for HPGe detectors;Detector ID;Energy [keV];Counts per 2 keV";
-	hpge_E_vs_det = new TH2F( hname.data(), htitle.data(),
+	hpge_E_vs_det = hist_set.Book( new TH2F( hname.data(), htitle.data(),
 							  set->GetNumberOfHPGeDetectors()+1, -0.5, set->GetNumberOfHPGeDetectors()+0.5,
-							  4000, 0, 4000 );
+							  4000, 0, 4000 ), dirname );
 
 	hname = "hpge_E";
 	htitle = "Gamma-ray energy for HPGe detectors;Energy [keV];Counts per 2 keV";
-	hpge_E = new TH1F( hname.data(), htitle.data(), 4000, 0, 4000 );
+	hpge_E = hist_set.Book( new TH1F( hname.data(), htitle.data(), 4000, 0, 4000 ), dirname );
 
 	hname = "hpge_hpge_E";
 	htitle = "Gamma-ray energy coincidence matrix for HPGe detectors;Energy [keV];Energy [keV];Counts";
-	hpge_hpge_E = new TH2F( hname.data(), htitle.data(), 4000, 0, 4000, 4000, 0, 4000 );
+	hpge_hpge_E = hist_set.Book( std::make_shared<GreatSymMatrix>( hname, htitle, 4000, 0, 4000, hpge_dir ), dirname );
 
 	hname = "hpge_hpge_td";
 	htitle = "Gamma-gamma time difference for HPGe detectors;#Deltat [ns];Counts";
-	hpge_hpge_td = new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 );
+	hpge_hpge_td = hist_set.Book( new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 ), dirname );
 
 	hpge_seg_td.resize( set->GetNumberOfHPGeDetectors() );
 	for( unsigned int i = 0; i < set->GetNumberOfHPGeDetectors(); ++i ) {
@@ -734,7 +1354,7 @@ void GreatEventBuilder::MakeHists(){
 		hname = "hpge_seg_td_" + std::to_string(i);
 		htitle = "Core-segment time difference for HPGe detector " + std::to_string(i);
 		htitle += ";#Deltat [ns];Counts";
-		hpge_seg_td[i] = new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 );
+		hpge_seg_td[i] = hist_set.Book( new TH1F( hname.data(), htitle.data(), 600, -1.0*set->GetEventWindow()-20, set->GetEventWindow()+20 ), dirname );
 
 	}
 
@@ -742,10 +1362,45 @@ void GreatEventBuilder::MakeHists(){
 	
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// Expands the gamma-gamma matrices in to ROOT histograms in their directories.
+/// Only needed when the web server scans the output file itself.
+void GreatEventBuilder::SyncHists() {
+
+	cebr3_cebr3_E->Sync();
+	hpge_hpge_E->Sync();
+
+	for( unsigned int j = 0; j < scan_eb.size(); ++j )
+		scan_eb[j]->SyncHists();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The gamma-gamma matrices are only expanded while they are written
+void GreatEventBuilder::WriteHists() {
+
+	hist_set.WriteCompact();
+
+	for( unsigned int j = 0; j < scan_eb.size(); ++j )
+		scan_eb[j]->WriteHists();
+
+	return;
+
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 /// This function empties the histograms used in the EventBuilder class; used during the DataSpy
 void GreatEventBuilder::ResetHists() {
 
+	// The matrices are in the set as well
+	hist_set.Reset();
+
+	// Also the histograms of the window scan
+	for( unsigned int j = 0; j < scan_eb.size(); ++j )
+		scan_eb[j]->ResetHists();
+
 	return;
 
 }
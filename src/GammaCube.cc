@@ -0,0 +1,457 @@
+#include "GammaCube.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only the list of blocks is allocated here
+/// \param[in] name The name of the tree and the base name of the exported histograms
+/// \param[in] title The title for the tree and the exported histograms
+/// \param[in] nbins The number of bins along each axis
+/// \param[in] max The upper edge of the last bin, the bin width is max/nbins
+GreatGammaCube::GreatGammaCube( std::string name, std::string title,
+								unsigned int nbins, double max ){
+
+	this->name = name;
+	this->title = title;
+	this->nbins = nbins;
+	this->max = max;
+
+	nblocks = ( nbins + kBlockSize - 1 ) / kBlockSize;
+	nblocks_tot = nblocks * ( nblocks + 1 ) * ( nblocks + 2 ) / 6;
+
+	blocks.reset( new std::atomic<count_t*>[nblocks_tot] );
+	carry.reset( new std::atomic<carry_t*>[nblocks_tot] );
+	for( unsigned long b = 0; b < nblocks_tot; ++b ) {
+
+		blocks[b].store( nullptr );
+		carry[b].store( nullptr );
+
+	}
+
+	entries = 0;
+	outside = 0;
+
+}
+
+GreatGammaCube::~GreatGammaCube(){
+
+	for( unsigned long b = 0; b < nblocks_tot; ++b ) {
+
+		delete [] blocks[b].load();
+		delete [] carry[b].load();
+
+	}
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// If two threads need the same new block at the same time, only one of them
+/// gets to keep it and the other one is thrown away
+/// \param[in] b The index of the block
+/// \return The block, never nullptr
+GreatGammaCube::count_t* GreatGammaCube::GetBlock( unsigned long b ){
+
+	count_t *blk = blocks[b].load( std::memory_order_acquire );
+	if( blk ) return blk;
+
+	count_t *fresh = new count_t[kCells]();
+	if( blocks[b].compare_exchange_strong( blk, fresh, std::memory_order_acq_rel ) )
+		return fresh;
+
+	// Somebody else was faster
+	delete [] fresh;
+	return blk;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Allocated in the same way as the blocks, see GreatGammaCube::GetBlock
+/// \param[in] b The index of the block
+/// \return The carry of the block, never nullptr
+GreatGammaCube::carry_t* GreatGammaCube::GetCarry( unsigned long b ){
+
+	carry_t *cr = carry[b].load( std::memory_order_acquire );
+	if( cr ) return cr;
+
+	carry_t *fresh = new carry_t[kCells]();
+	if( carry[b].compare_exchange_strong( cr, fresh, std::memory_order_acq_rel ) )
+		return fresh;
+
+	// Somebody else was faster
+	delete [] fresh;
+	return cr;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Safe to call from several threads, each wrap of the cell is carried once
+/// \param[in] b The index of the block
+/// \param[in] c The cell in the block
+/// \param[in] n The counts to add
+void GreatGammaCube::AddCount( unsigned long b, unsigned int c, unsigned long long n ){
+
+	if( !n ) return;
+
+	count_t *blk = GetBlock( b );
+	unsigned long long low = n & 0xffff;
+	unsigned long long high = n >> 16;
+	if( low ) high += ( blk[c].fetch_add( low, std::memory_order_relaxed ) + low ) >> 16;
+	if( high ) GetCarry( b )[c].fetch_add( high, std::memory_order_relaxed );
+
+	return;
+
+}
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] e1 First energy
+/// \param[in] e2 Second energy
+/// \param[in] e3 Third energy
+void GreatGammaCube::Fill( double e1, double e2, double e3 ){
+
+	entries.fetch_add( 1, std::memory_order_relaxed );
+
+	int b[3] = { GetBin( e1 ), GetBin( e2 ), GetBin( e3 ) };
+	if( b[0] < 0 || b[1] < 0 || b[2] < 0 ) {
+
+		outside.fetch_add( 1, std::memory_order_relaxed );
+		return;
+
+	}
+
+	// Symmetrise, i >= j >= k
+	std::sort( b, b+3 );
+	unsigned int i = b[2], j = b[1], k = b[0];
+
+	unsigned long blk_idx = BlockIndex( i/kBlockSize, j/kBlockSize, k/kBlockSize );
+	unsigned int c = (i%kBlockSize)*kBlockSize*kBlockSize + (j%kBlockSize)*kBlockSize + k%kBlockSize;
+	if( GetBlock( blk_idx )[c].fetch_add( 1, std::memory_order_relaxed ) == 0xffff )
+		GetCarry( blk_idx )[c].fetch_add( 1, std::memory_order_relaxed );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] energies All gamma-ray energies in the event, nothing is done for less than three
+void GreatGammaCube::FillEvent( const std::vector<float> &energies ){
+
+	for( unsigned int i = 0; i < energies.size(); ++i )
+		for( unsigned int j = i+1; j < energies.size(); ++j )
+			for( unsigned int k = j+1; k < energies.size(); ++k )
+				Fill( energies[i], energies[j], energies[k] );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Not thread safe with respect to the other cube, which should not be filled at the same time
+/// \param[in] other The cube to add to this one
+/// \return false if the binning is different
+bool GreatGammaCube::Add( const GreatGammaCube &other ){
+
+	if( other.nbins != nbins || other.max != max ) {
+
+		std::cerr << "Cannot add " << other.name << " to " << name;
+		std::cerr << ", the binning is different" << std::endl;
+		return false;
+
+	}
+
+	for( unsigned long b = 0; b < nblocks_tot; ++b ) {
+
+		const count_t *src = other.blocks[b].load( std::memory_order_acquire );
+		if( !src ) continue;
+
+		GetBlock( b );
+		for( unsigned int c = 0; c < kCells; ++c )
+			AddCount( b, c, other.GetCount( b, src, c ) );
+
+	}
+
+	entries += other.entries.load();
+	outside += other.outside.load();
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] other Another GreatGammaCube, e.g. from a histogram cache
+/// \return false if it is not a cube or the binning is different
+bool GreatGammaCube::Add( const GreatCompactHist &other ){
+
+	const GreatGammaCube *cube = dynamic_cast<const GreatGammaCube*>( &other );
+	if( !cube ) {
+
+		std::cerr << "Cannot add " << other.GetName() << " to " << name;
+		std::cerr << ", it is not a cube" << std::endl;
+		return false;
+
+	}
+
+	return Add( *cube );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return A cube with the same name and binning, no blocks are allocated yet
+std::unique_ptr<GreatCompactHist> GreatGammaCube::CloneEmpty() const {
+
+	return std::make_unique<GreatGammaCube>( name, title, nbins, max );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The blocks are only set to zero, they are never released while the cube
+/// exists, so a thread that is filling never writes to freed memory. Counts
+/// filled during the reset may or may not be kept.
+void GreatGammaCube::Reset(){
+
+	for( unsigned long b = 0; b < nblocks_tot; ++b ) {
+
+		count_t *blk = blocks[b].load( std::memory_order_acquire );
+		carry_t *cr = carry[b].load( std::memory_order_acquire );
+		for( unsigned int c = 0; blk && c < kCells; ++c )
+			blk[c].store( 0, std::memory_order_relaxed );
+		for( unsigned int c = 0; cr && c < kCells; ++c )
+			cr[c].store( 0, std::memory_order_relaxed );
+
+	}
+
+	entries = 0;
+	outside = 0;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] bin The bin number
+/// \param[in] lo The lower edge of the gate
+/// \param[in] hi The upper edge of the gate
+bool GreatGammaCube::InGate( unsigned int bin, double lo, double hi ) const {
+
+	double centre = ( bin + 0.5 ) * max / nbins;
+	return centre >= lo && centre <= hi;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The cube itself is too big to expand, so this is what is shown of it
+/// \return The total projection in no directory, owned by the caller
+TH1* GreatGammaCube::MakeHist() const {
+
+	TH1D *h = Projection( name + "_proj" );
+	h->SetDirectory( nullptr );
+
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] hname The name of the new histogram
+/// \return A new histogram in the current directory, owned by the caller
+TH1D* GreatGammaCube::Projection( std::string hname ) const {
+
+	std::string htitle = title + " projection;Energy [keV];Counts";
+	TH1D *h = new TH1D( hname.data(), htitle.data(), nbins, 0, max );
+
+	ForEachCell( [&]( unsigned int i, unsigned int j, unsigned int k, unsigned long long n ){
+		h->AddBinContent( i+1, n );
+		h->AddBinContent( j+1, n );
+		h->AddBinContent( k+1, n );
+	} );
+
+	h->ResetStats();
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// For each triple with an energy inside the gate, the other two energies are
+/// filled symmetrically in the matrix. A triple with more than one energy in
+/// the gate is used once for each of them.
+/// \param[in] hname The name of the new histogram
+/// \param[in] lo The lower edge of the gate in keV
+/// \param[in] hi The upper edge of the gate in keV
+/// \return A new histogram in the current directory, owned by the caller
+TH2D* GreatGammaCube::Slice( std::string hname, double lo, double hi ) const {
+
+	std::string htitle = title + " gated on " + std::to_string( lo ) + "-" + std::to_string( hi );
+	htitle += " keV;Energy [keV];Energy [keV];Counts";
+	TH2D *h = new TH2D( hname.data(), htitle.data(), nbins, 0, max, nbins, 0, max );
+
+	ForEachCell( [&]( unsigned int i, unsigned int j, unsigned int k, unsigned long long n ){
+		unsigned int e[3] = { i, j, k };
+		for( unsigned int m = 0; m < 3; ++m ) {
+			if( !InGate( e[m], lo, hi ) ) continue;
+			unsigned int x = e[(m+1)%3];
+			unsigned int y = e[(m+2)%3];
+			h->SetBinContent( x+1, y+1, h->GetBinContent( x+1, y+1 ) + n );
+			h->SetBinContent( y+1, x+1, h->GetBinContent( y+1, x+1 ) + n );
+		}
+	} );
+
+	h->ResetStats();
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// For each triple with one energy in the first gate and another one in the
+/// second gate, the remaining energy is filled. All assignments of the energies
+/// to the gates are used.
+/// \param[in] hname The name of the new histogram
+/// \param[in] lo1 The lower edge of the first gate in keV
+/// \param[in] hi1 The upper edge of the first gate in keV
+/// \param[in] lo2 The lower edge of the second gate in keV
+/// \param[in] hi2 The upper edge of the second gate in keV
+/// \return A new histogram in the current directory, owned by the caller
+TH1D* GreatGammaCube::DoubleGate( std::string hname, double lo1, double hi1, double lo2, double hi2 ) const {
+
+	std::string htitle = title + " double gated;Energy [keV];Counts";
+	TH1D *h = new TH1D( hname.data(), htitle.data(), nbins, 0, max );
+
+	ForEachCell( [&]( unsigned int i, unsigned int j, unsigned int k, unsigned long long n ){
+		unsigned int e[3] = { i, j, k };
+		for( unsigned int m1 = 0; m1 < 3; ++m1 ) {
+			if( !InGate( e[m1], lo1, hi1 ) ) continue;
+			for( unsigned int m2 = 0; m2 < 3; ++m2 ) {
+				if( m2 == m1 || !InGate( e[m2], lo2, hi2 ) ) continue;
+				h->AddBinContent( e[3-m1-m2]+1, n );
+			}
+		}
+	} );
+
+	h->ResetStats();
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// One entry per allocated block, with its index in the packed tetrahedron and
+/// its counts including the carry. The projection is written next to it, which
+/// also records the binning that is needed to read the cube back.
+/// \param[in] dir The directory to write in to
+void GreatGammaCube::Write( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	TDirectory *olddir = gDirectory;
+	dir->cd();
+
+	const unsigned int ncells = kCells;
+	unsigned int block;
+	std::vector<unsigned int> counts( ncells );
+
+	TTree *tree = new TTree( name.data(), title.data() );
+	tree->Branch( "block", &block, "block/i" );
+	tree->Branch( "counts", counts.data(), ( "counts[" + std::to_string( ncells ) + "]/i" ).data() );
+
+	for( unsigned long b = 0; b < nblocks_tot; ++b ) {
+
+		const count_t *blk = blocks[b].load( std::memory_order_acquire );
+		if( !blk ) continue;
+
+		block = b;
+		for( unsigned int c = 0; c < ncells; ++c )
+			counts[c] = GetCount( b, blk, c );
+
+		tree->Fill();
+
+	}
+
+	tree->Write( 0, TObject::kWriteDelete );
+	delete tree;
+
+	TH1D *proj = Projection( name + "_proj" );
+	proj->Write( 0, TObject::kWriteDelete );
+	delete proj;
+
+	olddir->cd();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The cube must have the same binning as the one that was written
+/// \param[in] tree The tree made by GreatGammaCube::Write
+/// \return The number of blocks that were read
+unsigned long long GreatGammaCube::Read( TTree *tree ){
+
+	const unsigned int ncells = kCells;
+	unsigned int block;
+	std::vector<unsigned int> counts( ncells );
+
+	tree->SetBranchAddress( "block", &block );
+	tree->SetBranchAddress( "counts", counts.data() );
+
+	unsigned long long nread = 0;
+	for( long long e = 0; e < tree->GetEntries(); ++e ) {
+
+		tree->GetEntry(e);
+		if( block >= nblocks_tot ) {
+
+			std::cerr << "Block " << block << " is outside of " << name;
+			std::cerr << ", the binning is probably different" << std::endl;
+			continue;
+
+		}
+
+		GetBlock( block );
+		for( unsigned int c = 0; c < ncells; ++c ) {
+
+			AddCount( block, c, counts[c] );
+			entries += counts[c];
+
+		}
+
+		nread++;
+
+	}
+
+	tree->ResetBranchAddresses();
+
+	return nread;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The binning is checked with the projection that is written next to the tree
+/// \param[in] dir The directory that was given to GreatGammaCube::Write
+/// \return false if something is missing or the binning is different
+bool GreatGammaCube::AddFrom( TDirectory *dir ){
+
+	if( !dir ) return false;
+
+	TTree *tree = dynamic_cast<TTree*>( dir->Get( name.data() ) );
+	TH1 *proj = dynamic_cast<TH1*>( dir->Get( ( name + "_proj" ).data() ) );
+	bool success = tree && proj && (unsigned int)proj->GetNbinsX() == nbins &&
+				   proj->GetXaxis()->GetXmin() == 0 && proj->GetXaxis()->GetXmax() == max;
+
+	if( tree && proj && !success ) {
+
+		std::cerr << "Cannot add " << name << " from " << dir->GetName();
+		std::cerr << ", the binning is different" << std::endl;
+
+	}
+
+	if( success ) Read( tree );
+
+	delete tree;
+	delete proj;
+
+	return success;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return The number of blocks that have been allocated, each of kBlockSize^3 counts
+unsigned long GreatGammaCube::GetNumberOfBlocks() const {
+
+	unsigned long n = 0;
+	for( unsigned long b = 0; b < nblocks_tot; ++b )
+		if( blocks[b].load( std::memory_order_relaxed ) ) n++;
+
+	return n;
+
+}
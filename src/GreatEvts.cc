@@ -15,7 +15,7 @@ double GreatEvts::GetTime() const {
 	// Check minimum time from all TAC events
 	for( unsigned int i = 0; i < this->GetTACMultiplicity(); ++i ){
 
-		double cur_time = this->GetTACEvt(i)->GetTime();
+		double cur_time = this->GetTACEvtRef(i).GetTime();
 		if( cur_time < min_time || min_time < 0 )
 			min_time = cur_time;
 
@@ -24,7 +24,7 @@ double GreatEvts::GetTime() const {
 	// Check minimum time from all CeBr3 events
 	for( unsigned int i = 0; i < this->GetCeBr3Multiplicity(); ++i ){
 
-		double cur_time = this->GetCeBr3Evt(i)->GetTime();
+		double cur_time = this->GetCeBr3EvtRef(i).GetTime();
 		if( cur_time < min_time || min_time < 0 )
 			min_time = cur_time;
 
@@ -33,7 +33,7 @@ double GreatEvts::GetTime() const {
 	// Check minimum time from all HPGe events
 	for( unsigned int i = 0; i < this->GetHPGeMultiplicity(); ++i ){
 
-		double cur_time = this->GetHPGeEvt(i)->GetTime();
+		double cur_time = this->GetHPGeEvtRef(i).GetTime();
 		if( cur_time < min_time || min_time < 0 )
 			min_time = cur_time;
 
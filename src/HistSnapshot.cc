@@ -0,0 +1,280 @@
+#include "HistSnapshot.hh"
+
+std::mutex GreatHistSnapshot::serv_mutex;
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] myserv The web server, which has to call GreatHistSnapshot::ProcessRequests instead of its own timer
+/// \param[in] period Time in s between two snapshots
+GreatHistSnapshot::GreatHistSnapshot( THttpServer *myserv, double period ){
+
+	serv = myserv;
+	this->period = period;
+	last = std::chrono::steady_clock::now();
+	flag_reset = false;
+
+	n_publish = 0;
+	n_hists = 0;
+	copy_last = 0;
+	copy_max = 0;
+	copy_sum = 0;
+	swap_max = 0;
+
+}
+
+GreatHistSnapshot::~GreatHistSnapshot(){
+
+	std::lock_guard<std::mutex> lock( serv_mutex );
+	for( unsigned int i = 0; i < sources.size(); ++i )
+		for( unsigned int j = 0; j < sources[i].copies.size(); ++j )
+			Drop( sources[i].copies[j] );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The set is read again for every snapshot, so histograms booked later, or
+/// booked again by a new output file, are picked up as well
+/// \param[in] set The histograms of a stage of the sort
+/// \param[in] folder Folder in the server, the directories of the set go below it
+void GreatHistSnapshot::Add( GreatHistogramSet *set, std::string folder ){
+
+	if( !set ) return;
+
+	source_t s;
+	s.set = set;
+	s.folder = folder;
+	sources.push_back( std::move( s ) );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] h The histogram, filled by the thread that calls Publish
+/// \param[in] folder Folder in the server
+void GreatHistSnapshot::Add( TH1 *h, std::string folder ){
+
+	if( !h ) return;
+
+	source_t s;
+	s.hist = h;
+	s.folder = folder;
+	sources.push_back( std::move( s ) );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] c The copies of the histogram
+/// \param[in] h The histogram to copy
+/// \param[in] folder Folder in the server
+void GreatHistSnapshot::Copy( copy_t &c, TH1 *h, std::string folder ){
+
+	// The first time, or the histogram was booked again
+	if( !c.back || c.source != h ) {
+
+		c.back.reset( (TH1*)h->Clone() );
+		c.back->SetDirectory( nullptr );
+
+	}
+
+	// Same binning, so just the contents
+	else {
+
+		c.back->Reset( "ICESM" );
+		c.back->Add( h );
+		c.back->SetEntries( h->GetEntries() );
+
+	}
+
+	c.source = h;
+	c.compact = nullptr;
+	c.folder = folder;
+	c.flag_new = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] c The copies of the histogram
+/// \param[in] h The compact histogram to copy
+/// \param[in] folder Folder in the server
+void GreatHistSnapshot::Copy( copy_t &c, const GreatCompactHist *h, std::string folder ){
+
+	// The first time, or the histogram was booked again
+	if( !c.back || c.compact != h ) {
+
+		c.back.reset( h->MakeHist() );
+		if( !c.back ) return;
+
+	}
+
+	// Same binning, so just the contents
+	else h->CopyTo( c.back.get() );
+
+	c.source = nullptr;
+	c.compact = h;
+	c.folder = folder;
+	c.flag_new = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] c The copies of the histogram, the spare one is shown afterwards
+void GreatHistSnapshot::Swap( copy_t &c ){
+
+	if( !c.flag_new ) return;
+
+	if( c.front ) serv->Unregister( c.front.get() );
+	serv->Register( c.folder.data(), c.back.get() );
+	std::swap( c.front, c.back );
+	c.flag_new = false;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] c The copies of a histogram that no longer exists
+void GreatHistSnapshot::Drop( copy_t &c ){
+
+	if( c.front ) serv->Unregister( c.front.get() );
+	c.front.reset();
+	c.back.reset();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Has to be called by the thread that fills the histograms, as often as it
+/// likes, so that they are not changed during the copy
+/// \param[in] force Publish even if the period has not passed yet
+/// \return true if a new snapshot was published
+bool GreatHistSnapshot::Publish( bool force ){
+
+	// Is a snapshot due?
+	auto start = std::chrono::steady_clock::now();
+	if( !force && std::chrono::duration<double>( start - last ).count() < period )
+		return false;
+	last = start;
+
+	// Copy everything in to the spare copies, the server does not see them
+	std::vector<copy_t> dropped;
+	unsigned int n_copied = 0;
+	for( unsigned int i = 0; i < sources.size(); ++i ) {
+
+		source_t &s = sources[i];
+
+		// All histograms of a set, in the order they were booked
+		if( s.set ) {
+
+			unsigned int n_hists = s.set->GetSize();
+			unsigned int n_total = n_hists + s.set->GetNumberOfCompact();
+			while( s.copies.size() > n_total ) {
+				dropped.push_back( std::move( s.copies.back() ) );
+				s.copies.pop_back();
+			}
+			s.copies.resize( n_total );
+
+			for( unsigned int j = 0; j < s.set->GetSize(); ++j ) {
+
+				TH1 *h = s.set->GetHist(j);
+				if( !h ) continue;
+				std::string folder = s.folder;
+				if( !s.set->GetDirName(j).empty() ) folder += "/" + s.set->GetDirName(j);
+				Copy( s.copies[j], h, folder );
+				n_copied++;
+
+			}
+
+			// Then the compact ones, once they have been filled
+			for( unsigned int j = 0; j < s.set->GetNumberOfCompact(); ++j ) {
+
+				const GreatCompactHist *h = s.set->GetCompact(j).get();
+				copy_t &c = s.copies[n_hists+j];
+				if( !h || ( !c.back && !c.front && !h->GetEntries() ) ) continue;
+				std::string folder = s.folder;
+				if( !s.set->GetCompactDirName(j).empty() ) folder += "/" + s.set->GetCompactDirName(j);
+				Copy( c, h, folder );
+				n_copied++;
+
+			}
+
+		}
+
+		// A single histogram
+		else {
+
+			TH1 *h = s.hist;
+			if( !h ) continue;
+			s.copies.resize( 1 );
+			Copy( s.copies[0], h, s.folder );
+			n_copied++;
+
+		}
+
+	}
+
+	auto copied = std::chrono::steady_clock::now();
+
+	// Swap them in, the server waits only for this
+	{
+
+		std::lock_guard<std::mutex> lock( serv_mutex );
+		for( unsigned int i = 0; i < dropped.size(); ++i )
+			Drop( dropped[i] );
+		for( unsigned int i = 0; i < sources.size(); ++i )
+			for( unsigned int j = 0; j < sources[i].copies.size(); ++j )
+				Swap( sources[i].copies[j] );
+
+	}
+
+	auto swapped = std::chrono::steady_clock::now();
+
+	// Keep track of the cost, only this thread writes it
+	double copy_time = std::chrono::duration<double,std::milli>( copied - start ).count();
+	double swap_time = std::chrono::duration<double,std::milli>( swapped - copied ).count();
+	n_hists = n_copied;
+	copy_last = copy_time;
+	copy_sum = copy_sum + copy_time;
+	if( copy_time > copy_max ) copy_max = copy_time;
+	if( swap_time > swap_max ) swap_max = swap_time;
+	n_publish++;
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] name Name of the histograms, e.g. Singles
+void GreatHistSnapshot::PrintCost( std::string name ){
+
+	unsigned long long n = n_publish;
+	if( !n ) return;
+
+	std::cout << " Snapshot of " << name << ": " << n_hists << " histograms in ";
+	std::cout << std::fixed << std::setprecision(1) << copy_last << " ms (mean ";
+	std::cout << copy_sum / n << " ms, max " << copy_max << " ms), web server held for at most ";
+	std::cout << std::setprecision(2) << swap_max << " ms" << std::endl;
+	std::cout << std::defaultfloat << std::setprecision(6);
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Replaces the timer of the server, see THttpServer::SetTimer, and has to be
+/// called regularly by the thread that made the server
+/// \param[in] serv The web server
+void GreatHistSnapshot::ProcessRequests( THttpServer *serv ){
+
+	std::lock_guard<std::mutex> lock( serv_mutex );
+	serv->ProcessRequests();
+
+	return;
+
+}
@@ -0,0 +1,326 @@
+#include "HistogramSet.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] dir The base directory, usually the output file. If nullptr, the
+/// histograms booked afterwards are detached from any file and owned by the set
+void GreatHistogramSet::SetDirectory( TDirectory *dir ){
+
+	base = dir;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used before booking the histograms of a directory, in the same way as the
+/// mkdir and cd calls on the output file. Nothing happens for a detached set.
+/// \param[in] dirname The name of the directory, relative to the base
+/// \return The directory, or nullptr if the set is detached
+TDirectory* GreatHistogramSet::MakeDirectory( std::string dirname ){
+
+	if( !base ) return nullptr;
+
+	if( !base->GetDirectory( dirname.data() ) )
+		base->mkdir( dirname.data() );
+	base->cd( dirname.data() );
+
+	return base->GetDirectory( dirname.data() );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] dir The parent directory
+/// \param[in] dirname The path below dir, which may be empty
+/// \param[in] create Make the directory if it does not exist yet
+/// \return The directory, or nullptr if it does not exist
+TDirectory* GreatHistogramSet::GetSubDirectory( TDirectory *dir, std::string dirname, bool create ){
+
+	if( !dir || dirname.empty() ) return dir;
+
+	if( create && !dir->GetDirectory( dirname.data() ) )
+		dir->mkdir( dirname.data() );
+
+	return dir->GetDirectory( dirname.data() );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The histograms in a file are not deleted, they still belong to their file
+void GreatHistogramSet::Clear(){
+
+	hists.clear();
+	dirs.clear();
+	owned.clear();
+	compact.clear();
+	compact_dirs.clear();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] h The histogram, of any type derived from TH1
+/// \param[in] dirname The directory of the histogram, relative to the base
+void GreatHistogramSet::Register( TH1 *h, std::string dirname ){
+
+	// Detached histograms are owned by the set
+	if( !base ) {
+
+		h->SetDirectory( nullptr );
+		owned.push_back( std::unique_ptr<TH1>( h ) );
+
+	}
+
+	hists.push_back( h );
+	dirs.push_back( dirname );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The compact histogram is shared with the stage that fills it
+/// \param[in] c The compact histogram
+/// \param[in] dirname The directory it is written in to, relative to the base
+void GreatHistogramSet::Register( std::shared_ptr<GreatCompactHist> c, std::string dirname ){
+
+	if( !c ) return;
+
+	compact.push_back( c );
+	compact_dirs.push_back( dirname );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Resets contents, errors and statistics of all histograms
+void GreatHistogramSet::Reset(){
+
+	for( unsigned int i = 0; i < hists.size(); ++i )
+		hists[i]->Reset("ICESM");
+
+	for( unsigned int i = 0; i < compact.size(); ++i )
+		compact[i]->Reset();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The histograms are added one by one in the order they were booked, and they
+/// are checked by name. Merging the workers in the same order always gives the
+/// same result, regardless of the threads.
+/// \param[in] other A set booked in the same way, e.g. by a worker
+/// \return false if the two sets do not match, in which case nothing is added
+bool GreatHistogramSet::Merge( const GreatHistogramSet &other ){
+
+	// Check first so that we never merge half of the set
+	if( other.hists.size() != hists.size() ||
+	    other.compact.size() != compact.size() ) {
+
+		std::cerr << "Cannot merge histogram sets of different sizes: ";
+		std::cerr << hists.size() << "+" << compact.size() << " and ";
+		std::cerr << other.hists.size() << "+" << other.compact.size() << std::endl;
+		return false;
+
+	}
+
+	for( unsigned int i = 0; i < hists.size(); ++i ) {
+
+		if( std::string( hists[i]->GetName() ) != other.hists[i]->GetName() ||
+		    dirs[i] != other.dirs[i] ) {
+
+			std::cerr << "Cannot merge histogram sets, " << dirs[i] << "/";
+			std::cerr << hists[i]->GetName() << " does not match ";
+			std::cerr << other.dirs[i] << "/" << other.hists[i]->GetName() << std::endl;
+			return false;
+
+		}
+
+	}
+
+	for( unsigned int i = 0; i < compact.size(); ++i ) {
+
+		if( compact[i]->GetName() != other.compact[i]->GetName() ||
+		    compact_dirs[i] != other.compact_dirs[i] ) {
+
+			std::cerr << "Cannot merge histogram sets, " << compact_dirs[i] << "/";
+			std::cerr << compact[i]->GetName() << " does not match ";
+			std::cerr << other.compact_dirs[i] << "/" << other.compact[i]->GetName() << std::endl;
+			return false;
+
+		}
+
+	}
+
+	// Now add them
+	for( unsigned int i = 0; i < hists.size(); ++i )
+		hists[i]->Add( other.hists[i] );
+
+	// Shared ones are already filled
+	for( unsigned int i = 0; i < compact.size(); ++i )
+		if( compact[i] != other.compact[i] ) compact[i]->Add( *other.compact[i] );
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] share The compact histograms that several threads can fill at
+/// once are not copied, the new set fills the same ones and merging it back
+/// skips them. This is for the workers of one sort, not for a separate input.
+/// \return A detached set with an empty copy of each histogram
+std::unique_ptr<GreatHistogramSet> GreatHistogramSet::Clone( bool share ) const {
+
+	std::unique_ptr<GreatHistogramSet> copy = std::make_unique<GreatHistogramSet>();
+
+	for( unsigned int i = 0; i < hists.size(); ++i ) {
+
+		TH1 *h = (TH1*)hists[i]->Clone();
+		h->Reset("ICESM");
+		copy->Register( h, dirs[i] );
+
+	}
+
+	for( unsigned int i = 0; i < compact.size(); ++i ) {
+
+		if( share && compact[i]->IsThreadSafe() )
+			copy->Register( compact[i], compact_dirs[i] );
+		else copy->Register( std::shared_ptr<GreatCompactHist>( compact[i]->CloneEmpty() ), compact_dirs[i] );
+
+	}
+
+	return copy;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used for the histogram cache, the set itself stays where it is
+/// \param[in] dir The directory to write in to, e.g. a cache file
+void GreatHistogramSet::WriteTo( TDirectory *dir ) const {
+
+	TDirectory *olddir = gDirectory;
+
+	for( unsigned int i = 0; i < hists.size(); ++i ) {
+
+		if( !dir->GetDirectory( dirs[i].data() ) )
+			dir->mkdir( dirs[i].data() );
+		dir->cd( dirs[i].data() );
+
+		hists[i]->Write( hists[i]->GetName(), TObject::kOverwrite );
+
+	}
+
+	for( unsigned int i = 0; i < compact.size(); ++i )
+		compact[i]->Write( GetSubDirectory( dir, compact_dirs[i], true ) );
+
+	olddir->cd();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// All histograms must be found before anything is added, so a cache written
+/// with a different booking is never half merged
+/// \param[in] dir The directory that was given to GreatHistogramSet::WriteTo
+/// \return false if any histogram is missing, in which case nothing is added
+bool GreatHistogramSet::AddFrom( TDirectory *dir ){
+
+	std::vector<TH1*> found( hists.size(), nullptr );
+	for( unsigned int i = 0; i < hists.size(); ++i ) {
+
+		std::string path = dirs[i] + "/" + hists[i]->GetName();
+		found[i] = dynamic_cast<TH1*>( dir->Get( path.data() ) );
+		if( !found[i] || !SameBinning( hists[i], found[i] ) ) {
+
+			std::cerr << path << " is missing from " << dir->GetName();
+			if( found[i] ) std::cerr << " with the same binning";
+			std::cerr << std::endl;
+			for( unsigned int j = 0; j <= i; ++j ) delete found[j];
+			return false;
+
+		}
+
+	}
+
+	// The compact ones are read in to empty copies first
+	std::vector<std::unique_ptr<GreatCompactHist>> found_compact;
+	for( unsigned int i = 0; i < compact.size(); ++i ) {
+
+		// Each of them checks its own binning
+		found_compact.push_back( compact[i]->CloneEmpty() );
+		if( !found_compact.back()->AddFrom( GetSubDirectory( dir, compact_dirs[i], false ) ) ) {
+
+			std::cerr << compact_dirs[i] << "/" << compact[i]->GetName();
+			std::cerr << " is missing from " << dir->GetName() << " with the same binning" << std::endl;
+			for( unsigned int j = 0; j < hists.size(); ++j ) delete found[j];
+			return false;
+
+		}
+
+	}
+
+	for( unsigned int i = 0; i < hists.size(); ++i ) {
+
+		hists[i]->Add( found[i] );
+		delete found[i];
+
+	}
+
+	for( unsigned int i = 0; i < compact.size(); ++i )
+		compact[i]->Add( *found_compact[i] );
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The ROOT histograms are written with their file, this is for the compact
+/// ones, just before the file is written. Those that were never filled are
+/// left out, unlike GreatHistogramSet::WriteTo which has to write all of them.
+/// Nothing happens for a detached set.
+void GreatHistogramSet::WriteCompact(){
+
+	if( !base ) return;
+
+	TDirectory *olddir = gDirectory;
+
+	for( unsigned int i = 0; i < compact.size(); ++i ) {
+
+		// Unless an older copy has to be overwritten
+		TDirectory *dir = GetSubDirectory( base, compact_dirs[i], true );
+		if( !compact[i]->GetEntries() &&
+			!dir->GetListOfKeys()->Contains( compact[i]->GetName().data() ) ) continue;
+		compact[i]->Write( dir );
+
+	}
+
+	olddir->cd();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] a The first histogram
+/// \param[in] b The second histogram
+/// \return true if the number of bins and the range of every axis are the same
+bool GreatHistogramSet::SameBinning( TH1 *a, TH1 *b ){
+
+	if( a->GetDimension() != b->GetDimension() ) return false;
+
+	const TAxis *ax[3] = { a->GetXaxis(), a->GetYaxis(), a->GetZaxis() };
+	const TAxis *bx[3] = { b->GetXaxis(), b->GetYaxis(), b->GetZaxis() };
+	for( int d = 0; d < a->GetDimension(); ++d ) {
+
+		if( ax[d]->GetNbins() != bx[d]->GetNbins() ||
+			ax[d]->GetXmin() != bx[d]->GetXmin() ||
+			ax[d]->GetXmax() != bx[d]->GetXmax() ) return false;
+
+	}
+
+	return true;
+
+}
@@ -18,26 +18,74 @@ void GreatHistogrammer::MakeHists() {
 	
     std::string hname, htitle;
     std::string dirname;
+
+	// All histograms are booked in the set, detached if there is no output file
+	hist_set.Clear();
+	hist_set.SetDirectory( output_file );
 	
 	// Timing histograms
 	dirname = "Timing";
-	if( !output_file->GetDirectory( dirname.data() ) )
-		output_file->mkdir( dirname.data() );
-	output_file->cd( dirname.data() );
+	hist_set.MakeDirectory( dirname );
 
 	// Gamma-gamma time
 	hname = "gamma_gamma_td";
 	htitle = "Time difference between gamma-ray events";
 	htitle += ";#Deltat;Counts";
-	gamma_gamma_td = new TH1F( hname.data(), htitle.data(),
-									1000, -1.0*set->GetEventWindow()-50, 1.0*set->GetEventWindow()+50 );
+	idx_gamma_gamma_td = hist_set.GetSize();
+	hist_set.Book( new TH1F( hname.data(), htitle.data(),
+									1000, -1.0*set->GetEventWindow()-50, 1.0*set->GetEventWindow()+50 ), dirname );
 	
 	// Gamma-TAC time
 	hname = "gamma_tac_td";
 	htitle = "Time difference between gamma-ray and TAC events";
 	htitle += ";#Deltat;Counts";
-	gamma_tac_td = new TH1F( hname.data(), htitle.data(),
-									1000, -1.0*set->GetEventWindow()-50, 1.0*set->GetEventWindow()+50 );
+	idx_gamma_tac_td = hist_set.GetSize();
+	hist_set.Book( new TH1F( hname.data(), htitle.data(),
+									1000, -1.0*set->GetEventWindow()-50, 1.0*set->GetEventWindow()+50 ), dirname );
+
+	// User histograms
+	if( user_hists ) user_hists->Book( hist_set );
+
+	// Gamma-gamma-gamma cube
+	gamma_cube = MakeCube();
+	flag_cube_cebr3 = set->GetGammaCubeDetector() == "CeBr3";
+	if( gamma_cube ) {
+
+		dirname = "GammaCube";
+		hist_set.MakeDirectory( dirname );
+		idx_gamma_cube = hist_set.GetNumberOfCompact();
+		hist_set.Book( gamma_cube, dirname );
+
+	}
+
+	// Events handed over one at a time by the online pipeline
+	online_fill = MakeFill( hist_set );
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Fills the main histograms straight away, without an input tree. Only one
+/// thread can call it at a time and nothing else can fill the histograms then
+/// \param[in] evts The event, as it comes out of the event builder
+void GreatHistogrammer::FillOnline( const GreatEvts &evts ){
+
+	FillEvent( &evts, online_fill );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return An empty cube with the binning from the settings, or nullptr if it is not used
+std::shared_ptr<GreatGammaCube> GreatHistogrammer::MakeCube() {
+	
+	if( !set->IsGammaCube() ) return nullptr;
+	
+	unsigned int nbins = (unsigned int)( set->GetGammaCubeMaxEnergy() / set->GetGammaCubeBinWidth() + 0.5 );
+	std::string hname = "gamma_cube";
+	std::string htitle = set->GetGammaCubeDetector() + " gamma-gamma-gamma cube";
+	
+	return std::make_shared<GreatGammaCube>( hname, htitle, nbins, nbins * set->GetGammaCubeBinWidth() );
 	
 }
 
@@ -46,9 +94,7 @@ void GreatHistogrammer::ResetHists() {
 	
 	std::cout << "in GreatHistogrammer::Reset_Hist()" << std::endl;
 	
-	// Timing
-	gamma_gamma_td->Reset("ICESM");
-	gamma_tac_td->Reset("ICESM");
+	hist_set.Reset();
 
 	return;
 	
@@ -57,8 +103,11 @@ void GreatHistogrammer::ResetHists() {
 void GreatHistogrammer::SetInputTree( TTree *user_tree ){
 	
 	// Find the tree and set branch addresses
+	if( flag_own_input ) delete input_tree;
 	input_tree = (TChain*)user_tree;
 	input_tree->SetBranchAddress( "GreatEvts", &read_evts );
+	input_names.clear();
+	flag_own_input = false;
 	
 	return;
 	
@@ -67,13 +116,17 @@ void GreatHistogrammer::SetInputTree( TTree *user_tree ){
 void GreatHistogrammer::SetInputFile( std::vector<std::string> input_file_names ) {
 	
 	/// Overlaaded function for a single file or multiple files
+	if( flag_own_input ) delete input_tree;
 	input_tree = new TChain( "evt_tree" );
+	flag_own_input = true;
 	for( unsigned int i = 0; i < input_file_names.size(); i++ ) {
 		
 		input_tree->Add( input_file_names[i].data() );
 		
 	}
 	input_tree->SetBranchAddress( "GreatEvts", &read_evts );
+	ConfigureInput( input_tree );
+	input_names = input_file_names;
 	
 	return;
 	
@@ -82,18 +135,215 @@ void GreatHistogrammer::SetInputFile( std::vector<std::string> input_file_names
 void GreatHistogrammer::SetInputFile( std::string input_file_name ) {
 	
 	/// Overloaded function for a single file or multiple files
+	if( flag_own_input ) delete input_tree;
 	input_tree = new TChain( "evt_tree" );
+	flag_own_input = true;
 	input_tree->Add( input_file_name.data() );
 	input_tree->SetBranchAddress( "GreatEvts", &read_evts );
+	ConfigureInput( input_tree );
+	input_names.clear();
+	input_names.push_back( input_file_name );
 	
 	return;
 	
 }
 
-// Main routine for filling the histograms
-unsigned long GreatHistogrammer::FillHists() {
+////////////////////////////////////////////////////////////////////////////////
+/// The histograms are found by their position in the set, which is the same
+/// for the main set and all of its clones
+/// \param[in] hs The set to fill, the main set or a clone of it
+/// \return The histograms to fill for one chunk
+GreatHistogrammer::hist_fill_t GreatHistogrammer::MakeFill( GreatHistogramSet &hs ){
+	
+	hist_fill_t fill;
+	fill.gamma_gamma_td = (TH1F*)hs.GetHist( idx_gamma_gamma_td );
+	fill.gamma_tac_td = (TH1F*)hs.GetHist( idx_gamma_tac_td );
+	fill.cube = gamma_cube ? (GreatGammaCube*)hs.GetCompact( idx_gamma_cube ).get() : nullptr;
+	if( user_hists ) fill.user = user_hists->GetHists( hs );
+	
+	return fill;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Physics of a single event, must only use the histograms in fill so that it
+/// can run in many threads at once.
+///
+/// With HistSelectBranches, only the fields switched on in ConfigureInput are
+/// read and all others are zero. Anything new that is used here has to be
+/// added there as well, or it is silently empty.
+/// \param[in] evts The event to process
+/// \param[in] fill The histograms of the current chunk
+void GreatHistogrammer::FillEvent( const GreatEvts *evts, hist_fill_t &fill ){
+	
+	// Gamma-gamma time, both orderings
+	ForEachPair( evts->GetCeBr3Evts(), [&]( const GreatCeBr3Evt &a, const GreatCeBr3Evt &b ){
+		double tdiff = a.GetTime() - b.GetTime();
+		fill.gamma_gamma_td->Fill( tdiff );
+		fill.gamma_gamma_td->Fill( -tdiff );
+	} );
+
+	// Gamma-TAC time
+	ForEachPair( evts->GetCeBr3Evts(), evts->GetTACEvts(), [&]( const GreatCeBr3Evt &g, const GreatTACEvt &t ){
+		fill.gamma_tac_td->Fill( t.GetTime() - g.GetTime() );
+	} );
+
+	// User histograms, all kernels in one go
+	if( user_hists ) user_hists->Fill( *evts, fill.user, fill.user_scratch );
+
+	// Gamma-gamma-gamma cube, all triples in the event
+	if( fill.cube ) {
+
+		fill.cube_energies.clear();
+		if( flag_cube_cebr3 ) {
+			for( const GreatCeBr3Evt &g : evts->GetCeBr3Evts() )
+				fill.cube_energies.push_back( g.GetEnergy() );
+		}
+		else {
+			for( const GreatHPGeEvt &g : evts->GetHPGeEvts() )
+				fill.cube_energies.push_back( g.GetEnergy() );
+		}
+
+		if( fill.cube_energies.size() >= 3 )
+			fill.cube->FillEvent( fill.cube_energies );
+
+	}
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The chunks are always the same for a given input, whatever the number of
+/// threads, so merging them in order gives the same histograms every time
+/// \param[in] target The set that the chunk is merged in to, which shares its cube
+/// \param[in] chain The chain to read from, owned by the calling thread
+/// \param[in] evts The branch address of the chain
+/// \param[in] chunk The number of the chunk, covering kChunkSize entries
+/// \return A detached set with the histograms of this chunk only
+std::unique_ptr<GreatHistogramSet> GreatHistogrammer::FillChunk( const GreatHistogramSet &target, TChain *chain, GreatEvts *&evts, unsigned long chunk ){
+	
+	std::unique_ptr<GreatHistogramSet> partial;
+	{
+		std::lock_guard<std::mutex> lock( clone_mutex );
+		partial = target.Clone( true );
+	}
+	hist_fill_t fill = MakeFill( *partial );
+	
+	unsigned long first = chunk * kChunkSize;
+	unsigned long last = std::min( first + kChunkSize, n_entries );
+	for( unsigned long i = first; i < last; ++i ){
+		
+		chain->GetEntry(i);
+		FillEvent( evts, fill );
+		
+	}
+	
+	return partial;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only called from the main thread, because of the GUI
+/// \param[in] n_done The number of entries processed so far
+void GreatHistogrammer::UpdateProgress( unsigned long n_done ){
+	
+	// Percent complete
+	float percent = (float)n_done*100.0/(float)n_entries;
+	
+	// Progress bar in GUI
+	if( _prog_ ) {
+		
+		prog->SetPosition( percent );
+		gSystem->ProcessEvents();
+		
+	}
+	
+	// Progress bar in terminal
+	std::cout << " " << std::setw(6) << std::setprecision(4);
+	std::cout << percent << "%    \r";
+	std::cout.flush();
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only the parts of the events that the histograms use are read, through a
+/// TTreeCache that learns which branches these are from the first entries.
+/// Each worker calls this for its own chain.
+/// \param[in] chain The input chain, after the branch address is set
+void GreatHistogrammer::ConfigureInput( TChain *chain ) {
+	
+	// Switch off all fields that are never used
+	if( set->IsHistSelectBranches() ) {
+		
+		// The built in histograms need the CeBr3 and TAC times
+		unsigned int mask[GreatUserHists::kNumberOfDetectors] = {0};
+		mask[GreatUserHists::kCeBr3] |= GreatUserHists::kReadTime;
+		mask[GreatUserHists::kTAC] |= GreatUserHists::kReadTime;
+		
+		// The cube needs the energies
+		if( set->IsGammaCube() ) {
+			
+			if( set->GetGammaCubeDetector() == "CeBr3" )
+				mask[GreatUserHists::kCeBr3] |= GreatUserHists::kReadEnergy;
+			else mask[GreatUserHists::kHPGe] |= GreatUserHists::kReadEnergy;
+			
+		}
+		
+		// The user histograms know what they need
+		if( user_hists ) {
+			for( unsigned int d = 0; d < GreatUserHists::kNumberOfDetectors; ++d )
+				mask[d] |= user_hists->GetReadMask( (GreatUserHists::det_t)d );
+		}
+		
+		const char *coll[GreatUserHists::kNumberOfDetectors] = { "cebr3_event", "hpge_event", "tac_event" };
+		chain->SetBranchStatus( "*", false );
+		for( unsigned int d = 0; d < GreatUserHists::kNumberOfDetectors; ++d ) {
+			
+			// The collection itself has the number of hits
+			chain->SetBranchStatus( Form( "*%s", coll[d] ), true );
+			if( mask[d] & GreatUserHists::kReadTime )
+				chain->SetBranchStatus( Form( "*%s.time", coll[d] ), true );
+			if( mask[d] & GreatUserHists::kReadEnergy )
+				chain->SetBranchStatus( Form( "*%s.energy", coll[d] ), true );
+			if( mask[d] & GreatUserHists::kReadID )
+				chain->SetBranchStatus( Form( "*%s.id", coll[d] ), true );
+			
+		}
+		
+	}
+	
+	// Cache with a learning phase, prefetching is switched on by FillSet if asked
+	chain->SetCacheSize( (Long64_t)( set->GetHistCacheSize() * 1048576 ) );
+	if( set->GetHistCacheSize() > 0 )
+		chain->SetCacheLearnEntries( set->GetHistCacheLearnEntries() );
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] chain The input chain
+/// \return Fraction of the baskets found in the cache for the current file, -1 without cache
+double GreatHistogrammer::CacheEfficiency( TChain *chain ) {
+	
+	if( !chain->GetTree() ) return -1;
+	TTreeCache *cache = chain->GetTree()->GetReadCache( chain->GetCurrentFile() );
+	if( !cache ) return -1;
+	
+	return cache->GetEfficiency();
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The input is split in chunks, each filling its own histograms that are then
+/// merged in order. This is the same with one thread or many.
+/// \param[in] target The set to add the histograms of all chunks to
+/// \return The number of entries in the input
+unsigned long GreatHistogrammer::FillSet( GreatHistogramSet &target ) {
 	
-	/// Main function to fill the histograms
 	n_entries = input_tree->GetEntries();
 	
 	std::cout << " GreatHistogrammer: number of entries in event tree = ";
@@ -105,78 +355,161 @@ unsigned long GreatHistogrammer::FillHists() {
 		return n_entries;
 		
 	}
-	else {
+	
+	// Prefetching is a global ROOT setting, so it is only changed while the
+	// events are read and the caches of their files are made
+	int prefetch_old = gEnv->GetValue( "TFile.AsyncPrefetching", 0 );
+	if( set->IsHistAsyncPrefetch() )
+		gEnv->SetValue( "TFile.AsyncPrefetching", 1 );
+	
+	// Input statistics, the byte counters are global so include all threads
+	Long64_t bytes_start = TFile::GetFileBytesRead();
+	Int_t calls_start = TFile::GetFileReadCalls();
+	double cache_eff = 0;
+	
+	unsigned long n_chunks = ( n_entries + kChunkSize - 1 ) / kChunkSize;
+	unsigned int n_workers = std::min( (unsigned long)n_threads, n_chunks );
+	if( n_workers > 1 && !input_names.size() ) {
 		
-		std::cout << " GreatHistogrammer: Start filling histograms" << std::endl;
+		std::cout << " GreatHistogrammer: input tree given directly, using one thread" << std::endl;
+		n_workers = 1;
 		
 	}
 	
+	std::cout << " GreatHistogrammer: Start filling histograms";
+	if( n_workers > 1 ) std::cout << " with " << n_workers << " threads";
+	std::cout << std::endl;
+	
 	// ------------------------------------------------------------------------ //
-	// Main loop over TTree to find events
+	// Serial, on the input tree, straight in to the target
 	// ------------------------------------------------------------------------ //
-	for( unsigned int i = 0; i < n_entries; ++i ){
-		
-		// Current event data
-		input_tree->GetEntry(i);
+	if( n_workers == 1 ) {
 		
-		// tdiff variable
-		double tdiff;
-		
-		// Loop over gamma-ray events
-		for( unsigned int j = 0; j < read_evts->GetCeBr3Multiplicity(); ++j ){
-
-			// Loop over gamma-ray events
-			for( unsigned int k = j+1; k < read_evts->GetCeBr3Multiplicity(); ++k ){
-
-				// Time difference
-				double tdiff = read_evts->GetCeBr3Evt(j)->GetTime();
-				tdiff -= read_evts->GetCeBr3Evt(k)->GetTime();
-				gamma_gamma_td->Fill( tdiff );
-				gamma_gamma_td->Fill( -tdiff );
-				
-			}
+		hist_fill_t fill = MakeFill( target );
+		for( unsigned long i = 0; i < n_entries; ++i ){
 			
-			// Loop over TAC events
-			for( unsigned int k = 0; k < read_evts->GetTACMultiplicity(); ++k ){
-				
-				// Time difference
-				double tdiff = read_evts->GetCeBr3Evt(j)->GetTime();
-				tdiff -= read_evts->GetTACEvt(k)->GetTime();
-				gamma_gamma_td->Fill( -tdiff );
-				
-			}
+			input_tree->GetEntry(i);
+			FillEvent( read_evts, fill );
+			if( ( i + 1 ) % kChunkSize == 0 || i + 1 == n_entries )
+				UpdateProgress( i + 1 );
 			
 		}
 		
+		cache_eff = CacheEfficiency( input_tree );
 		
-		// Progress bar
-		bool update_progress = false;
-		if( n_entries < 200 )
-			update_progress = true;
-		else if( i % (n_entries/100) == 0 || i+1 == n_entries )
-			update_progress = true;
+	}
+	
+	// ------------------------------------------------------------------------ //
+	// Parallel, each worker with its own chain, merged in order by this thread
+	// ------------------------------------------------------------------------ //
+	else {
 		
-		if( update_progress ) {
+		std::vector<std::unique_ptr<GreatHistogramSet>> partials( n_chunks );
+		std::mutex partial_mutex;
+		std::condition_variable partial_ready;
+		std::atomic<unsigned long> next_chunk( 0 );
+		std::atomic<unsigned long> n_done( 0 );
+		
+		// Chains are made here, one per worker
+		std::vector<TChain*> chains( n_workers );
+		std::vector<GreatEvts*> evts( n_workers, nullptr );
+		for( unsigned int w = 0; w < n_workers; ++w ){
 			
-			// Percent complete
-			float percent = (float)(i+1)*100.0/(float)n_entries;
+			chains[w] = new TChain( "evt_tree" );
+			for( unsigned int i = 0; i < input_names.size(); ++i )
+				chains[w]->Add( input_names[i].data() );
+			chains[w]->SetBranchAddress( "GreatEvts", &evts[w] );
+			ConfigureInput( chains[w] );
 			
-			// Progress bar in GUI
-			if( _prog_ ) {
+		}
+		
+		std::vector<std::thread> workers;
+		for( unsigned int w = 0; w < n_workers; ++w ){
+			
+			workers.emplace_back( [&,w](){
 				
-				prog->SetPosition( percent );
-				gSystem->ProcessEvents();
+				unsigned long c;
+				while( ( c = next_chunk++ ) < n_chunks ){
+					
+					std::unique_ptr<GreatHistogramSet> partial = FillChunk( target, chains[w], evts[w], c );
+					n_done += std::min( ( c + 1 ) * kChunkSize, n_entries ) - c * kChunkSize;
+					
+					std::lock_guard<std::mutex> lock( partial_mutex );
+					partials[c] = std::move( partial );
+					partial_ready.notify_one();
+					
+				}
 				
+			} );
+			
+		}
+		
+		// Merge in chunk order as soon as the next one is ready
+		for( unsigned long c = 0; c < n_chunks; ++c ){
+			
+			std::unique_ptr<GreatHistogramSet> partial;
+			{
+				std::unique_lock<std::mutex> lock( partial_mutex );
+				while( !partials[c] ) {
+					
+					partial_ready.wait_for( lock, std::chrono::milliseconds( 200 ) );
+					if( !partials[c] ) {
+						
+						lock.unlock();
+						UpdateProgress( n_done );
+						lock.lock();
+						
+					}
+					
+				}
+				partial = std::move( partials[c] );
 			}
 			
-			// Progress bar in terminal
-			std::cout << " " << std::setw(6) << std::setprecision(4);
-			std::cout << percent << "%    \r";
-			std::cout.flush();
+			target.Merge( *partial );
+			UpdateProgress( n_done );
+			
+		}
+		
+		for( unsigned int w = 0; w < n_workers; ++w ){
+			
+			workers[w].join();
+			double eff = CacheEfficiency( chains[w] );
+			if( eff < 0 || cache_eff < 0 ) cache_eff = -1;
+			else cache_eff += eff / n_workers;
+			delete chains[w];
+			delete evts[w];
 			
 		}
 		
-	} // all events
+	}
+	
+	UpdateProgress( n_entries );
+	
+	std::cout << std::endl << " GreatHistogrammer: read ";
+	std::cout << ( TFile::GetFileBytesRead() - bytes_start ) / 1048576.0 << " MB in ";
+	std::cout << TFile::GetFileReadCalls() - calls_start << " calls";
+	if( cache_eff >= 0 ) std::cout << ", cache efficiency " << cache_eff * 100.0 << "%";
+	std::cout << std::endl;
+	
+	gEnv->SetValue( "TFile.AsyncPrefetching", prefetch_old );
+	
+	return n_entries;
+	
+}
+
+// Main routine for filling the histograms
+unsigned long GreatHistogrammer::FillHists() {
+	
+	/// Main function to fill the histograms
+	if( !FillSet( hist_set ) ) return 0;
+
+	// The cube is only written as a tree of its blocks when the output is closed
+	if( gamma_cube ) {
+
+		std::cout << " GreatHistogrammer: gamma cube has " << gamma_cube->GetEntries();
+		std::cout << " triples in " << gamma_cube->GetNumberOfBlocks() << " blocks" << std::endl;
+
+	}
 	
 	output_file->Write();
 	
@@ -184,3 +517,205 @@ unsigned long GreatHistogrammer::FillHists() {
 	
 }
 
+////////////////////////////////////////////////////////////////////////////////
+/// 64-bit FNV-1a hash, continued from a previous value
+/// \param[in] h The hash so far, or kFNVOffset to start
+/// \param[in] data The bytes to add
+/// \param[in] len The number of bytes
+/// \return The new hash
+unsigned long long GreatHistogrammer::HashBytes( unsigned long long h, const void *data, unsigned long len ){
+	
+	const unsigned char *bytes = (const unsigned char*)data;
+	for( unsigned long i = 0; i < len; ++i ) {
+		
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+		
+	}
+	
+	return h;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The key changes whenever the events file is rebuilt, the settings or
+/// reaction files are edited or the code writes its caches differently, so an
+/// old cache is never used by mistake
+/// \param[in] input_file_name The events file
+/// \return The key as a hexadecimal string
+std::string GreatHistogrammer::CacheKey( std::string input_file_name ){
+	
+	unsigned long long h = kFNVOffset;
+	
+	// Version of the cache format
+	unsigned int version = kCacheVersion;
+	h = HashBytes( h, &version, sizeof(version) );
+	
+	// When this file was compiled, so that a change to FillEvent is not hidden by the cache
+	const std::string build = __DATE__ " " __TIME__;
+	h = HashBytes( h, build.data(), build.size() );
+	
+	// Name, size and modification time of the events file
+	Long_t id, flags, modtime;
+	Long64_t size;
+	if( gSystem->GetPathInfo( input_file_name.data(), &id, &size, &flags, &modtime ) )
+		return "";
+	h = HashBytes( h, input_file_name.data(), input_file_name.size() );
+	h = HashBytes( h, &size, sizeof(size) );
+	h = HashBytes( h, &modtime, sizeof(modtime) );
+	
+	// Full content of the settings, reaction and histogram definition files
+	std::vector<std::string> config_names = { set->InputFile(), react->InputFile() };
+	if( user_hists ) config_names.push_back( user_hists->GetFileName() );
+	for( unsigned int i = 0; i < config_names.size(); ++i ) {
+		
+		std::ifstream config( config_names[i].data(), std::ios::binary );
+		std::string content( ( std::istreambuf_iterator<char>( config ) ),
+							std::istreambuf_iterator<char>() );
+		h = HashBytes( h, config_names[i].data(), config_names[i].size() );
+		h = HashBytes( h, content.data(), content.size() );
+		
+	}
+	
+	std::stringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << h;
+	
+	return ss.str();
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] input_file_name The events file
+/// \return The name of its histogram cache, next to it
+std::string GreatHistogrammer::CacheName( std::string input_file_name ){
+	
+	std::string name = input_file_name;
+	if( name.size() > 5 && name.substr( name.size() - 5 ) == ".root" )
+		name = name.substr( 0, name.size() - 5 );
+	
+	return name + "_hcache.root";
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is added unless the key matches and everything is in the file
+/// \param[in] cache_name The cache file
+/// \param[in] key The key that the cache must have been written with
+/// \return true if the histograms of the cache were added to the output
+bool GreatHistogrammer::LoadCache( std::string cache_name, std::string key ){
+	
+	if( key.empty() || gSystem->AccessPathName( cache_name.data() ) )
+		return false;
+	
+	TFile *cache_file = new TFile( cache_name.data(), "read" );
+	if( cache_file->IsZombie() ) {
+		
+		delete cache_file;
+		return false;
+		
+	}
+	
+	bool success = false;
+	TNamed *cache_key = (TNamed*)cache_file->Get( "cache_key" );
+	
+	// The cube is in the set as well
+	if( cache_key && key == cache_key->GetTitle() &&
+	    hist_set.AddFrom( cache_file ) )
+		success = true;
+	
+	delete cache_key;
+	cache_file->Close();
+	delete cache_file;
+	
+	return success;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] cache_name The cache file, overwritten
+/// \param[in] key The key of the input
+/// \param[in] partial The histograms of the input, including the cube
+void GreatHistogrammer::WriteCache( std::string cache_name, std::string key,
+								   const GreatHistogramSet &partial ){
+	
+	TDirectory *olddir = gDirectory;
+	
+	TFile *cache_file = new TFile( cache_name.data(), "recreate" );
+	if( cache_file->IsZombie() ) {
+		
+		std::cerr << "Cannot write histogram cache " << cache_name << std::endl;
+		delete cache_file;
+		olddir->cd();
+		return;
+		
+	}
+	
+	partial.WriteTo( cache_file );
+	
+	// The key goes last, so a cache that was cut short is never used
+	cache_file->cd();
+	TNamed cache_key( "cache_key", key.data() );
+	cache_key.Write();
+	
+	cache_file->Close();
+	delete cache_file;
+	olddir->cd();
+	
+	return;
+	
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Each events file has its own partial histograms in a cache file next to it.
+/// Files with a valid cache are just merged, the others are filled and their
+/// cache is written. Refreshing the histograms after adding a new subrun then
+/// only costs the new subrun.
+/// \param[in] input_file_names The events files
+/// \return The number of entries that had to be processed
+unsigned long GreatHistogrammer::FillHistsCached( std::vector<std::string> input_file_names ) {
+	
+	unsigned long n_processed = 0;
+	unsigned int n_cached = 0;
+	
+	for( unsigned int i = 0; i < input_file_names.size(); ++i ) {
+		
+		std::string key = CacheKey( input_file_names[i] );
+		std::string cache_name = CacheName( input_file_names[i] );
+		
+		if( LoadCache( cache_name, key ) ) {
+			
+			std::cout << " GreatHistogrammer: using cached histograms for ";
+			std::cout << input_file_names[i] << std::endl;
+			n_cached++;
+			continue;
+			
+		}
+		
+		// Fill this file alone, with its own cube
+		std::unique_ptr<GreatHistogramSet> partial = hist_set.Clone();
+		
+		SetInputFile( input_file_names[i] );
+		n_processed += FillSet( *partial );
+		
+		if( !key.empty() ) WriteCache( cache_name, key, *partial );
+		
+		hist_set.Merge( *partial );
+		
+	}
+	
+	std::cout << " GreatHistogrammer: " << n_cached << " of " << input_file_names.size();
+	std::cout << " files taken from the cache" << std::endl;
+
+	// The cube is only written as a tree of its blocks when the output is closed
+	if( gamma_cube ) {
+
+		std::cout << " GreatHistogrammer: gamma cube has " << gamma_cube->GetEntries();
+		std::cout << " triples in " << gamma_cube->GetNumberOfBlocks() << " blocks" << std::endl;
+
+	}
+	
+	output_file->Write();
+	
+	return n_processed;
+	
+}
@@ -0,0 +1,299 @@
+#include "Metrics.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Books the histograms, which are owned by the detached set
+/// \param[in] myset The settings, for the number of modules and the length of the history
+GreatMetrics::GreatMetrics( std::shared_ptr<GreatSettings> myset ){
+
+	set = myset;
+
+	for( unsigned int i = 0; i < kLatencyBins + 2; ++i )
+		lat_counts[i] = 0;
+	last = std::chrono::steady_clock::now();
+
+	unsigned int n_mod = set->GetNumberOfCAENModules();
+	last_hits.resize( n_mod, 0 );
+	hits_rate.resize( n_mod, 0 );
+	depth.resize( GreatOnlinePipeline::kNumberOfStages, 0 );
+
+	// History of the rates, the latest update is the last bin
+	unsigned int n_hist = set->GetMetricsHistory();
+	double lo = -(double)n_hist + 0.5;
+	double hi = 0.5;
+	h_blocks = hist_set.Book( new TH1F( "metrics_blocks", "Data blocks read;Update;Blocks/s",
+									   n_hist, lo, hi ), "rates" );
+	h_bytes = hist_set.Book( new TH1F( "metrics_bytes", "Data read;Update;MB/s",
+									  n_hist, lo, hi ), "rates" );
+	h_events = hist_set.Book( new TH1F( "metrics_events", "Events built;Update;Events/s",
+									   n_hist, lo, hi ), "rates" );
+	h_hits = hist_set.Book( new TH1F( "metrics_hits", "Hit rate of each CAEN module;Module;Hits/s",
+									 n_mod, -0.5, n_mod - 0.5 ), "rates" );
+
+	// Totals since the start
+	h_counters = hist_set.Book( new TH1F( "metrics_counters", "Totals since the start;;Counts",
+										 6, 0.5, 6.5 ), "rates" );
+	h_counters->GetXaxis()->SetBinLabel( 1, "blocks" );
+	h_counters->GetXaxis()->SetBinLabel( 2, "MB" );
+	h_counters->GetXaxis()->SetBinLabel( 3, "hits" );
+	h_counters->GetXaxis()->SetBinLabel( 4, "events" );
+	h_counters->GetXaxis()->SetBinLabel( 5, "lost buffers" );
+	h_counters->GetXaxis()->SetBinLabel( 6, "decode errors" );
+
+	// Queues in front of each stage of the pipeline and the hits held back for ordering
+	h_depth = hist_set.Book( new TH1F( "metrics_queues", "Queue in front of each stage;;Depth",
+									  GreatOnlinePipeline::kNumberOfStages + 1, 0.5,
+									  GreatOnlinePipeline::kNumberOfStages + 1.5 ), "queues" );
+	for( unsigned int s = 0; s < GreatOnlinePipeline::kNumberOfStages; ++s )
+		h_depth->GetXaxis()->SetBinLabel( s + 1,
+			GreatOnlinePipeline::GetStageName( (GreatOnlinePipeline::stage_t)s ).data() );
+	h_depth->GetXaxis()->SetBinLabel( GreatOnlinePipeline::kNumberOfStages + 1, "reorder" );
+
+	// Latency, in logarithmic bins
+	std::vector<double> edges;
+	for( unsigned int i = 0; i <= kLatencyBins; ++i )
+		edges.push_back( kLatencyMin * std::pow( kLatencyMax / kLatencyMin, (double)i / kLatencyBins ) );
+	h_latency = hist_set.Book( new TH1F( "metrics_latency",
+										"Time from reading a block to filling its events;Latency (ms);Counts",
+										kLatencyBins, edges.data() ), "latency" );
+	h_lat_mean = hist_set.Book( new TH1F( "metrics_latency_mean",
+										 "Mean time from reading a block to filling its events;Update;Latency (ms)",
+										 n_hist, lo, hi ), "latency" );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] n The number of blocks read from a file
+/// \param[in] bytes The number of bytes in them
+void GreatMetrics::AddBlocks( unsigned long n, unsigned long long bytes ){
+
+	n_blocks += n;
+	n_bytes += bytes;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] n The number of events built by the monitor loop
+void GreatMetrics::AddEvents( unsigned long n ){
+
+	n_events += n;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] ms The time in ms from reading a block to filling its events
+void GreatMetrics::AddLatency( double ms ){
+
+	unsigned int bin;
+	if( ms < kLatencyMin ) bin = 0;
+	else if( ms >= kLatencyMax ) bin = kLatencyBins + 1;
+	else {
+		bin = 1 + (unsigned int)( kLatencyBins * std::log( ms / kLatencyMin ) /
+								  std::log( kLatencyMax / kLatencyMin ) );
+		if( bin > kLatencyBins ) bin = kLatencyBins;
+	}
+	lat_counts[bin]++;
+
+	unsigned long long us = ms > 0 ? (unsigned long long)( ms * 1e3 ) : 0;
+	lat_n++;
+	lat_sum += us;
+	unsigned long long prev = lat_max;
+	while( us > prev && !lat_max.compare_exchange_weak( prev, us ) ){}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] h A history of the rates
+/// \param[in] value The latest rate
+void GreatMetrics::Shift( TH1 *h, double value ){
+
+	int n = h->GetNbinsX();
+	for( int i = 1; i < n; ++i )
+		h->SetBinContent( i, h->GetBinContent( i + 1 ) );
+	h->SetBinContent( n, value );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Counters that go down have been reset, e.g. by a new file in the converter,
+/// so the rate is worked out from zero
+void GreatMetrics::Sample(){
+
+	auto now = std::chrono::steady_clock::now();
+	double dt = std::chrono::duration<double>( now - last ).count();
+	if( dt <= 0 ) return;
+	last = now;
+
+	auto delta = []( unsigned long long now_ctr, unsigned long long last_ctr ){
+		return now_ctr >= last_ctr ? now_ctr - last_ctr : now_ctr;
+	};
+
+	// Data read
+	unsigned long long blocks = spy ? spy->GetBlocksRead() : n_blocks;
+	unsigned long long bytes = spy ? spy->GetBytesRead() : n_bytes;
+	lost = spy ? spy->GetLostBuffers() : 0;
+	blocks_rate = delta( blocks, last_blocks ) / dt;
+	bytes_rate = delta( bytes, last_bytes ) / dt;
+	lost_rate = delta( lost, last_lost ) / dt;
+	last_blocks = blocks;
+	last_bytes = bytes;
+	last_lost = lost;
+
+	// Hits on each module and the data that could not be decoded
+	unsigned long long hits = 0;
+	for( unsigned int i = 0; i < hits_rate.size() && conv; ++i ) {
+
+		unsigned long long h = conv->GetCAENHits(i);
+		hits_rate[i] = delta( h, last_hits[i] ) / dt;
+		last_hits[i] = h;
+		hits += h;
+
+	}
+	errors = conv ? conv->GetDecodeErrors() : 0;
+
+	// Events
+	unsigned long long events = n_events;
+	if( pipe ) events = pipe->GetMetrics( GreatOnlinePipeline::kBuild ).n_out;
+	events_rate = delta( events, last_events ) / dt;
+	last_events = events;
+
+	// The fullest queue is in front of the stage that holds up the others
+	bottleneck = "";
+	unsigned int max_depth = 0;
+	for( unsigned int s = 0; s < depth.size(); ++s ) {
+
+		depth[s] = pipe ? pipe->GetMetrics( (GreatOnlinePipeline::stage_t)s ).depth.load() : 0;
+		if( depth[s] > max_depth ) {
+			max_depth = depth[s];
+			bottleneck = GreatOnlinePipeline::GetStageName( (GreatOnlinePipeline::stage_t)s );
+		}
+
+	}
+	tail = conv && !pipe ? conv->GetOnlineTail() : 0;
+
+	// Buffers lost with empty queues, the decoding does not keep up with the DAQ
+	if( bottleneck.empty() && lost_rate > 0 )
+		bottleneck = GreatOnlinePipeline::GetStageName( GreatOnlinePipeline::kDecode );
+
+	// Latency since the last sample
+	unsigned long long n = lat_n;
+	unsigned long long sum = lat_sum;
+	lat_mean = n > last_lat_n ? ( sum - last_lat_sum ) * 1e-3 / ( n - last_lat_n ) : 0;
+	lat_last_max = lat_max.exchange( 0 ) * 1e-3;
+	last_lat_n = n;
+	last_lat_sum = sum;
+
+	// Histograms
+	Shift( h_blocks, blocks_rate );
+	Shift( h_bytes, bytes_rate * 1e-6 );
+	Shift( h_events, events_rate );
+	Shift( h_lat_mean, lat_mean );
+	for( unsigned int i = 0; i < hits_rate.size(); ++i )
+		h_hits->SetBinContent( i + 1, hits_rate[i] );
+	for( unsigned int s = 0; s < depth.size(); ++s )
+		h_depth->SetBinContent( s + 1, depth[s] );
+	h_depth->SetBinContent( depth.size() + 1, tail );
+	for( unsigned int i = 0; i < kLatencyBins + 2; ++i )
+		h_latency->SetBinContent( i, lat_counts[i] );
+	h_latency->SetEntries( n );
+	h_counters->SetBinContent( 1, blocks );
+	h_counters->SetBinContent( 2, bytes * 1e-6 );
+	h_counters->SetBinContent( 3, hits );
+	h_counters->SetBinContent( 4, events );
+	h_counters->SetBinContent( 5, lost );
+	h_counters->SetBinContent( 6, errors );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The text format of Prometheus, one value per line with # HELP and # TYPE
+/// comments, so it can be scraped as it is or read in a browser
+/// \return The page with the values of the last sample
+std::string GreatMetrics::GetText(){
+
+	std::ostringstream ss;
+	auto metric = [&]( std::string name, std::string help, std::string type ){
+		ss << "# HELP great_" << name << " " << help << "\n";
+		ss << "# TYPE great_" << name << " " << type << "\n";
+	};
+
+	metric( "blocks_per_second", "Data blocks read per second", "gauge" );
+	ss << "great_blocks_per_second " << blocks_rate << "\n";
+	metric( "bytes_per_second", "Bytes read per second", "gauge" );
+	ss << "great_bytes_per_second " << bytes_rate << "\n";
+
+	metric( "hits_per_second", "Hits per second on each CAEN module", "gauge" );
+	for( unsigned int i = 0; i < hits_rate.size(); ++i )
+		ss << "great_hits_per_second{module=\"" << i << "\"} " << hits_rate[i] << "\n";
+
+	metric( "events_per_second", "Events built per second", "gauge" );
+	ss << "great_events_per_second " << events_rate << "\n";
+
+	metric( "queue_depth", "Items waiting in front of each stage of the online pipeline", "gauge" );
+	for( unsigned int s = 0; s < depth.size(); ++s ) {
+		ss << "great_queue_depth{stage=\"";
+		ss << GreatOnlinePipeline::GetStageName( (GreatOnlinePipeline::stage_t)s );
+		ss << "\"} " << depth[s] << "\n";
+	}
+	metric( "reorder_held_hits", "Hits held back for time ordering by the monitor loop", "gauge" );
+	ss << "great_reorder_held_hits " << tail << "\n";
+
+	metric( "lost_buffers_total", "DataSpy buffers overwritten before they were read", "counter" );
+	ss << "great_lost_buffers_total " << lost << "\n";
+	metric( "decode_errors_total", "Data words of unknown type and incomplete blocks", "counter" );
+	ss << "great_decode_errors_total " << errors << "\n";
+
+	metric( "latency_ms", "Time from reading a block to filling its events", "histogram" );
+	unsigned long long cumulative = lat_counts[0];
+	for( unsigned int i = 1; i <= kLatencyBins; ++i ) {
+		cumulative += lat_counts[i];
+		ss << "great_latency_ms_bucket{le=\"" << h_latency->GetXaxis()->GetBinUpEdge(i);
+		ss << "\"} " << cumulative << "\n";
+	}
+	ss << "great_latency_ms_bucket{le=\"+Inf\"} " << cumulative + lat_counts[kLatencyBins+1] << "\n";
+	ss << "great_latency_ms_sum " << last_lat_sum * 1e-3 << "\n";
+	ss << "great_latency_ms_count " << last_lat_n << "\n";
+	metric( "latency_ms_mean", "Mean latency since the last update", "gauge" );
+	ss << "great_latency_ms_mean " << lat_mean << "\n";
+	metric( "latency_ms_max", "Longest latency since the last update", "gauge" );
+	ss << "great_latency_ms_max " << lat_last_max << "\n";
+
+	if( !bottleneck.empty() ) {
+		metric( "bottleneck", "Stage that the others are waiting for", "gauge" );
+		ss << "great_bottleneck{stage=\"" << bottleneck << "\"} 1\n";
+	}
+
+	return ss.str();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The page is written next to the file and then renamed, so a reader never
+/// gets half of it
+/// \param[in] filename The text page, e.g. in a directory served by the THttpServer
+/// \return false if the file could not be written
+bool GreatMetrics::WriteText( std::string filename ){
+
+	std::string tmpname = filename + ".tmp";
+	std::ofstream out( tmpname );
+	if( !out.is_open() ) {
+
+		std::cerr << "Cannot write the metrics to " << tmpname << std::endl;
+		return false;
+
+	}
+	out << GetText();
+	out.close();
+
+	return std::rename( tmpname.data(), filename.data() ) == 0;
+
+}
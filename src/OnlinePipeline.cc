@@ -0,0 +1,372 @@
+#include "OnlinePipeline.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// The steps have to be set up with their outputs and histograms already, the
+/// pipeline only drives them
+/// \param[in] myset The settings, for the queue sizes and the reorder tolerance
+/// \param[in] myconv The converter, with its histograms made
+/// \param[in] myeb The event builder, with its output set
+/// \param[in] myhist The histogrammer, with its output set
+/// \param[in] myspy The DataSpy streams, started by the caller
+GreatOnlinePipeline::GreatOnlinePipeline( std::shared_ptr<GreatSettings> myset,
+										 std::shared_ptr<GreatConverter> myconv,
+										 std::shared_ptr<GreatEventBuilder> myeb,
+										 std::shared_ptr<GreatHistogrammer> myhist,
+										 GreatSpyStreams *myspy ) :
+	decoded( myset->GetPipelineQueueSize() ),
+	ordered( myset->GetPipelineQueueSize() ),
+	built( myset->GetPipelineQueueSize() ) {
+
+	set = myset;
+	conv = myconv;
+	eb = myeb;
+	hist = myhist;
+	spy = myspy;
+
+	sync_period = set->GetPipelineSyncPeriod();
+
+	running = false;
+	for( unsigned int s = 0; s < kNumberOfStages; ++s ) {
+		done[s] = true;
+		rolling[s] = nullptr;
+		snapshot[s] = nullptr;
+	}
+
+}
+
+GreatOnlinePipeline::~GreatOnlinePipeline(){
+
+	Stop();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] s The stage
+/// \return A short name for printing
+std::string GreatOnlinePipeline::GetStageName( stage_t s ){
+
+	switch( s ) {
+		case kDecode:	return "decode";
+		case kOrder:	return "order";
+		case kBuild:	return "build";
+		case kHist:		return "histogram";
+		default:		return "unknown";
+	}
+
+}
+
+void GreatOnlinePipeline::Start(){
+
+	if( running ) return;
+
+	running = true;
+	for( unsigned int s = 0; s < kNumberOfStages; ++s )
+		done[s] = false;
+
+	threads.emplace_back( &GreatOnlinePipeline::RunDecode, this );
+	threads.emplace_back( &GreatOnlinePipeline::RunOrder, this );
+	threads.emplace_back( &GreatOnlinePipeline::RunBuild, this );
+	threads.emplace_back( &GreatOnlinePipeline::RunHist, this );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The decode stage takes what is left from the reader and then each stage
+/// finishes once the one before it has finished and its queue is empty
+void GreatOnlinePipeline::Stop(){
+
+	if( !running ) return;
+
+	running = false;
+	for( unsigned int i = 0; i < threads.size(); ++i )
+		if( threads[i].joinable() ) threads[i].join();
+	threads.clear();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Short spin with yields, then sleeps doubling from 50 µs to about 13 ms
+/// \param[in,out] n_idle The number of times in a row there was nothing to do
+void GreatOnlinePipeline::Backoff( unsigned int &n_idle ){
+
+	const unsigned int n_spin = 100;
+
+	if( n_idle < n_spin ) std::this_thread::yield();
+	else {
+
+		unsigned int shift = std::min( n_idle - n_spin, 8u );
+		std::this_thread::sleep_for( std::chrono::microseconds( 50 << shift ) );
+
+	}
+
+	n_idle++;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in,out] last The time of the last sync of the calling stage, updated if due
+/// \return true if the stage should sync its histograms now
+bool GreatOnlinePipeline::IsSyncDue( std::chrono::steady_clock::time_point &last ){
+
+	auto now = std::chrono::steady_clock::now();
+	if( std::chrono::duration<double>( now - last ).count() < sync_period )
+		return false;
+
+	last = now;
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// One batch of hits per block, in the order of the DAQ
+void GreatOnlinePipeline::RunDecode(){
+
+	unsigned int n_idle = 0;
+	auto last_sync = std::chrono::steady_clock::now();
+
+	auto decode = [&](){
+
+		metrics[kDecode].n_in++;
+
+		decoded_batch_t batch;
+		conv->TakePackets( batch.packets );
+		batch.watermark = spy->GetWatermark();
+		batch.read_time = spy->GetBlockTime();
+		if( batch.packets.empty() ) return;
+
+		metrics[kDecode].n_out += batch.packets.size();
+		Push( decoded, batch, kDecode );
+
+	};
+
+	while( running ) {
+
+		if( spy->Drain( *conv, decode ) ) n_idle = 0;
+		else {
+
+			metrics[kDecode].n_empty++;
+			Backoff( n_idle );
+
+		}
+
+		if( IsSyncDue( last_sync ) ) {
+
+			if( snapshot[kDecode] && snapshot[kDecode]->TakeReset() ) {
+
+				conv->ResetHists();
+				if( rolling[kDecode] ) rolling[kDecode]->Reset();
+
+			}
+			if( !snapshot[kDecode] ) conv->SyncHists();
+			if( rolling[kDecode] ) rolling[kDecode]->Update();
+			if( snapshot[kDecode] ) snapshot[kDecode]->Publish();
+
+		}
+
+	}
+
+	// Whatever is still waiting in the readers
+	spy->Drain( *conv, decode );
+	if( !snapshot[kDecode] ) conv->SyncHists();
+	if( snapshot[kDecode] ) snapshot[kDecode]->Publish( true );
+
+	done[kDecode] = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Hits are released once they are older than the tolerance compared to the
+/// latest hit and to the watermark of the streams, and the rest are released at the end
+void GreatOnlinePipeline::RunOrder(){
+
+	GreatReorderBuffer reorder( set->GetReorderTolerance(), set->GetReorderBufferSize() );
+	decoded_batch_t in;
+	ordered_batch_t out;
+	std::deque<held_block_t> held;	// blocks that may still have hits in the buffer, oldest first
+	double time_out = 0;			// time of the last hit released
+
+	while( Pop( decoded, in, kOrder ) ) {
+
+		metrics[kOrder].n_in += in.packets.size();
+
+		reorder.SetWatermark( in.watermark );
+		held.push_back( { std::numeric_limits<double>::lowest(), in.read_time } );
+		for( unsigned int i = 0; i < in.packets.size(); ++i ) {
+
+			if( reorder.Add( in.packets[i] ) )
+				held.back().time_max = std::max( held.back().time_max, in.packets[i]->GetTime() );
+			while( reorder.IsReady() ) {
+				out.packets.push_back( reorder.Next() );
+				time_out = out.packets.back()->GetTime();
+			}
+
+		}
+		in.packets.clear();
+
+		if( out.packets.size() ) {
+
+			// The hits can be from any block that was still held
+			out.read_time = held.front().read_time;
+
+			metrics[kOrder].n_out += out.packets.size();
+			Push( ordered, out, kOrder );
+			out.packets.clear();
+
+			// The hits come out in time order, so a block with none later
+			// than the last one out has nothing left in the buffer
+			while( held.size() && held.front().time_max <= time_out )
+				held.pop_front();
+
+		}
+
+	}
+
+	// Last hits
+	while( !reorder.IsEmpty() )
+		out.packets.push_back( reorder.Next() );
+	if( out.packets.size() ) {
+
+		if( held.size() ) out.read_time = held.front().read_time;
+		metrics[kOrder].n_out += out.packets.size();
+		Push( ordered, out, kOrder );
+
+	}
+
+	if( reorder.GetDropped() ) {
+
+		std::cout << "Online pipeline: " << reorder.GetDropped();
+		std::cout << " hits were too late to be put in order" << std::endl;
+
+	}
+
+	done[kOrder] = true;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The event builder hands every event it closes to this stage through its
+/// event sink, instead of the tree
+void GreatOnlinePipeline::RunBuild(){
+
+	ordered_batch_t in;
+	auto last_sync = std::chrono::steady_clock::now();
+
+	eb->SetEventSink( [this]( const GreatEvts &evts ){ event_out.events.push_back( evts ); } );
+	eb->StartFile();
+	eb->Initialise();
+
+	while( Pop( ordered, in, kBuild ) ) {
+
+		metrics[kBuild].n_in += in.packets.size();
+		if( event_out.events.empty() ) event_out.read_time = in.read_time;
+		for( unsigned int i = 0; i < in.packets.size(); ++i )
+			eb->ProcessData( in.packets[i].get() );
+		in.packets.clear();
+
+		if( event_out.events.size() ) {
+
+			metrics[kBuild].n_out += event_out.events.size();
+			Push( built, event_out, kBuild );
+			event_out.events.clear();
+
+		}
+
+		if( IsSyncDue( last_sync ) ) {
+
+			if( snapshot[kBuild] && snapshot[kBuild]->TakeReset() ) eb->ResetHists();
+			if( !snapshot[kBuild] ) eb->SyncHists();
+			if( snapshot[kBuild] ) snapshot[kBuild]->Publish();
+
+		}
+
+	}
+
+	// Last event
+	eb->FlushEvent();
+	if( event_out.events.size() ) {
+
+		metrics[kBuild].n_out += event_out.events.size();
+		Push( built, event_out, kBuild );
+		event_out.events.clear();
+
+	}
+
+	if( !snapshot[kBuild] ) eb->SyncHists();
+	if( snapshot[kBuild] ) snapshot[kBuild]->Publish( true );
+	eb->SetEventSink( nullptr );
+
+	done[kBuild] = true;
+
+	return;
+
+}
+
+void GreatOnlinePipeline::RunHist(){
+
+	event_batch_t in;
+	auto last_sync = std::chrono::steady_clock::now();
+
+	while( Pop( built, in, kHist ) ) {
+
+		metrics[kHist].n_in += in.events.size();
+		for( unsigned int i = 0; i < in.events.size(); ++i )
+			hist->FillOnline( in.events[i] );
+		metrics[kHist].n_out += in.events.size();
+		in.events.clear();
+
+		if( latency_sink ) latency_sink( std::chrono::duration<double,std::milli>(
+							std::chrono::steady_clock::now() - in.read_time ).count() );
+
+		if( IsSyncDue( last_sync ) ) {
+
+			if( snapshot[kHist] && snapshot[kHist]->TakeReset() ) {
+
+				hist->ResetHists();
+				if( rolling[kHist] ) rolling[kHist]->Reset();
+
+			}
+			if( rolling[kHist] ) rolling[kHist]->Update();
+			if( snapshot[kHist] ) snapshot[kHist]->Publish();
+
+		}
+
+	}
+
+	if( snapshot[kHist] ) snapshot[kHist]->Publish( true );
+
+	done[kHist] = true;
+
+	return;
+
+}
+
+void GreatOnlinePipeline::PrintMetrics(){
+
+	std::cout << "Online pipeline: DataSpy read " << spy->GetBlocksRead();
+	std::cout << " blocks, lost " << spy->GetLostBuffers() << std::endl;
+	if( spy->GetNumberOfStreams() > 1 ) spy->PrintCounters();
+
+	for( unsigned int s = 0; s < kNumberOfStages; ++s ) {
+
+		const stage_metrics_t &m = metrics[s];
+		std::cout << "  " << std::setw(10) << std::left << GetStageName( (stage_t)s ) << std::right;
+		std::cout << " in: " << std::setw(12) << m.n_in;
+		std::cout << " out: " << std::setw(12) << m.n_out;
+		std::cout << " queue: " << std::setw(4) << m.depth << " (max " << m.max_depth << ")";
+		std::cout << " waits full/empty: " << m.n_full << "/" << m.n_empty << std::endl;
+
+	}
+
+	return;
+
+}
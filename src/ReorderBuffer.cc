@@ -0,0 +1,79 @@
+#include "ReorderBuffer.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] tolerance The maximum lateness of a packet in ns that can still be put in order
+/// \param[in] max_size The maximum number of packets to hold, to bound the memory
+GreatReorderBuffer::GreatReorderBuffer( double tolerance, unsigned int max_size ){
+
+	this->tolerance = tolerance;
+	this->max_size = max_size > 0 ? max_size : 1;
+
+	Clear();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Empties the buffer and resets all counters, for example at the start of a new file
+void GreatReorderBuffer::Clear(){
+
+	std::priority_queue<reorder_item_t,std::vector<reorder_item_t>,reorder_compare_t>().swap(heap);
+
+	time_max = 0;
+	watermark = DBL_MAX;
+	time_out = 0;
+	flag_out = false;
+	seq = 0;
+
+	ctr_reordered = 0;
+	ctr_dropped = 0;
+	max_depth = 0;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] packet The data packet to add
+/// \return false if the packet was too late and has been dropped
+bool GreatReorderBuffer::Add( std::shared_ptr<GreatDataPackets> packet ){
+
+	reorder_item_t item;
+	item.time = packet->GetTime();
+	item.seq = seq++;
+	item.packet = packet;
+
+	// Too late, we already released something after it
+	if( flag_out && item.time < time_out ) {
+
+		ctr_dropped++;
+		return false;
+
+	}
+
+	// Late, but we can still put it in the right place
+	if( item.time < time_max ) ctr_reordered++;
+	else time_max = item.time;
+
+	heap.push( item );
+	if( heap.size() > max_depth ) max_depth = heap.size();
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Releases the earliest packet, regardless of whether it is ready. The caller
+/// should check GreatReorderBuffer::IsReady first, unless flushing at the end.
+/// \return The earliest packet in the buffer, or nullptr if it is empty
+std::shared_ptr<GreatDataPackets> GreatReorderBuffer::Next(){
+
+	if( heap.empty() ) return nullptr;
+
+	std::shared_ptr<GreatDataPackets> packet = heap.top().packet;
+	time_out = heap.top().time;
+	flag_out = true;
+	heap.pop();
+
+	return packet;
+
+}
@@ -0,0 +1,213 @@
+#include "RollingSpectra.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] slice_time The length of each slice in s, the resolution of the windows
+/// \param[in] windows The length of each view in s, rounded to whole slices
+GreatRollingSpectra::GreatRollingSpectra( double slice_time, std::vector<double> windows ){
+
+	this->slice_time = slice_time > 0 ? slice_time : 1.0;
+	n_slices_max = 1;
+
+	for( unsigned int w = 0; w < windows.size(); ++w ) {
+
+		unsigned int n = (unsigned int)( windows[w] / this->slice_time + 0.5 );
+		if( n < 1 ) n = 1;
+		window_slices.push_back( n );
+		if( n > n_slices_max ) n_slices_max = n;
+
+		// e.g. 1min or 30s
+		unsigned int secs = (unsigned int)( n * this->slice_time + 0.5 );
+		if( secs % 60 == 0 ) labels.push_back( std::to_string( secs / 60 ) + "min" );
+		else labels.push_back( std::to_string( secs ) + "s" );
+
+	}
+
+	slice_start = std::chrono::steady_clock::now();
+	flag_reset = false;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] r The spectrum
+/// \param[in] tmpl A histogram with the same binning
+/// \param[in] name Name of the spectrum, the window is added to it
+/// \param[in] title Title of the spectrum
+void GreatRollingSpectra::MakeViews( rolling_t &r, TH1 *tmpl, std::string name, std::string title ){
+
+	for( unsigned int w = 0; w < window_slices.size(); ++w ) {
+
+		TH1 *view = (TH1*)tmpl->Clone( ( name + "_" + labels[w] ).data() );
+		view->SetDirectory( nullptr );
+		view->Reset( "ICESM" );
+		view->SetTitle( ( title + " (last " + labels[w] + ")" ).data() );
+		r.views.push_back( std::unique_ptr<TH1>( view ) );
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only one-dimensional histograms are taken, a slice of a matrix is too big
+/// \param[in] h The histogram, filled by the thread that calls Update
+void GreatRollingSpectra::Add( TH1 *h ){
+
+	if( !h || h->GetDimension() != 1 ) return;
+
+	rolling_t r;
+	r.source = h;
+	MakeViews( r, h, h->GetName(), h->GetTitle() );
+	spectra.push_back( std::move( r ) );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] spec The spectrum, filled by the thread that calls Update
+void GreatRollingSpectra::Add( std::shared_ptr<GreatSpectrum> spec ){
+
+	if( !spec ) return;
+
+	rolling_t r;
+	r.source = nullptr;
+	r.spec = spec;
+
+	TH1F tmpl( "rolling_tmpl", "", spec->GetNbins(), spec->GetXmin(), spec->GetXmax() );
+	tmpl.SetDirectory( nullptr );
+	MakeViews( r, &tmpl, spec->GetName(), spec->GetTitle() );
+	spectra.push_back( std::move( r ) );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] serv The web server of the monitor
+/// \param[in] folder Base folder, the views go in to one sub-folder per window
+void GreatRollingSpectra::Register( THttpServer *serv, std::string folder ){
+
+	if( !serv ) return;
+
+	for( unsigned int i = 0; i < spectra.size(); ++i )
+		for( unsigned int w = 0; w < spectra[i].views.size(); ++w )
+			serv->Register( ( folder + "/" + labels[w] ).data(), spectra[i].views[w].get() );
+
+	return;
+
+}
+
+void GreatRollingSpectra::Update(){
+
+	// The spectra were reset from somewhere else
+	if( flag_reset.exchange( false ) ) Reset();
+
+	// Is a slice due?
+	auto now = std::chrono::steady_clock::now();
+	double dt = std::chrono::duration<double>( now - slice_start ).count();
+	if( dt < slice_time ) return;
+
+	// Slices that went by since the last call, all counts go in the latest
+	unsigned int n_new = (unsigned int)( dt / slice_time );
+	slice_start += std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					std::chrono::duration<double>( n_new * slice_time ) );
+
+	for( unsigned int i = 0; i < spectra.size(); ++i )
+		UpdateSpectrum( spectra[i], n_new );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] r The spectrum
+/// \param[in] n_new The number of slices closed now, the earlier ones are empty
+void GreatRollingSpectra::UpdateSpectrum( rolling_t &r, unsigned int n_new ){
+
+	// A compact spectrum is copied in to a TH1 once it has something in it
+	TH1 *src = r.source;
+	if( r.spec && ( r.current || r.spec->GetEntries() ) ) {
+
+		if( !r.current ) r.current.reset( r.spec->MakeHist() );
+		else r.spec->CopyTo( r.current.get() );
+		src = r.current.get();
+
+	}
+
+	// Counts since the last slice
+	std::unique_ptr<TH1> delta;
+	if( src ) {
+
+		// The spectrum was reset, start again from there
+		if( r.last && src->GetEntries() < r.last->GetEntries() ) {
+
+			r.slices.clear();
+			for( unsigned int w = 0; w < r.views.size(); ++w )
+				r.views[w]->Reset( "ICESM" );
+			r.last.reset();
+
+		}
+
+		delta.reset( (TH1*)src->Clone() );
+		delta->SetDirectory( nullptr );
+		if( r.last ) delta->Add( r.last.get(), -1 );
+		else {
+
+			r.last.reset( (TH1*)src->Clone() );
+			r.last->SetDirectory( nullptr );
+
+		}
+		r.last->Reset( "ICESM" );
+		r.last->Add( src );
+		r.last->SetEntries( src->GetEntries() );
+
+	}
+
+	// Empty slices for the time without an update
+	for( unsigned int k = 1; k < n_new; ++k )
+		r.slices.push_back( nullptr );
+	if( delta ) {
+		for( unsigned int w = 0; w < r.views.size(); ++w )
+			r.views[w]->Add( delta.get() );
+	}
+	r.slices.push_back( std::move( delta ) );
+
+	// Take out what has left each window
+	unsigned int n_slices = r.slices.size();
+	for( unsigned int w = 0; w < r.views.size(); ++w ) {
+
+		for( unsigned int k = 0; k < n_new; ++k ) {
+
+			long idx = (long)n_slices - (long)window_slices[w] - 1 - k;
+			if( idx < 0 ) break;
+			if( r.slices[idx] ) r.views[w]->Add( r.slices[idx].get(), -1 );
+
+		}
+
+	}
+
+	// Only keep what the longest window needs
+	while( r.slices.size() > n_slices_max )
+		r.slices.pop_front();
+
+	return;
+
+}
+
+void GreatRollingSpectra::Reset(){
+
+	for( unsigned int i = 0; i < spectra.size(); ++i ) {
+
+		spectra[i].slices.clear();
+		spectra[i].last.reset();
+		for( unsigned int w = 0; w < spectra[i].views.size(); ++w )
+			spectra[i].views[w]->Reset( "ICESM" );
+
+	}
+
+	slice_start = std::chrono::steady_clock::now();
+
+	return;
+
+}
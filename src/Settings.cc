@@ -1,6 +1,7 @@
 #include "Settings.hh"
 
 #include <iomanip>
+#include <sstream>
 
 GreatSettings::GreatSettings( std::string filename ) {
 	
@@ -33,11 +34,44 @@ void GreatSettings::ReadSettings() {
 	event_window = config->GetValue( "EventWindow", 3e3 );
 	cebr3_hit_window = config->GetValue( "CeBr3HitWindow", 500 );
 	hpge_hit_window = config->GetValue( "HPGeHitWindow", 500 );
+	reorder_tolerance = config->GetValue( "ReorderTolerance", 1e6 );
+	reorder_size = config->GetValue( "ReorderBufferSize", 100000 );
+	events_max_size = config->GetValue( "EventsFileMaxSize", 0.0 );
 
 	
 	// Data things
 	block_size = config->GetValue( "DataBlockSize", 0x10000 );
 	flag_caen_only = config->GetValue( "CAENOnlyData", false );
+	flag_full_sort = config->GetValue( "FullTimeSort", true );
+	if( !flag_full_sort && reorder_tolerance <= 0 ) {
+		std::cerr << "FullTimeSort is false but ReorderTolerance is 0, ";
+		std::cerr << "hits out of order will not be put back in order" << std::endl;
+	}
+	spy_queue_size = config->GetValue( "SpyQueueSize", 1024 );
+	spy_max_backoff = config->GetValue( "SpyMaxBackoff", 20.0 );
+	n_spy_streams = config->GetValue( "NumberOfSpyStreams", 1 );
+	if( n_spy_streams < 1 || n_spy_streams > 8 ) {
+		std::cerr << "NumberOfSpyStreams has to be between 1 and 8, using 1" << std::endl;
+		n_spy_streams = 1;
+	}
+	spy_stream_id.resize( n_spy_streams );
+	for( unsigned int i = 0; i < n_spy_streams; ++i )
+		spy_stream_id[i] = config->GetValue( Form( "SpyStream_%d.ID", i ), (int)i );
+	spy_stream_idle = config->GetValue( "SpyStreamIdle", 5.0 );
+	pipeline_queue_size = config->GetValue( "PipelineQueueSize", 256 );
+	pipeline_sync_period = config->GetValue( "PipelineSyncPeriod", 1.0 );
+	mon_snapshot_period = config->GetValue( "MonitorSnapshotPeriod", 0.0 );
+	tail_interval = config->GetValue( "TailFollowInterval", 1.0 );
+	flag_rolling = config->GetValue( "RollingSpectra", false );
+	rolling_slice = config->GetValue( "RollingSliceTime", 10.0 );
+	rolling_windows.clear();
+	std::istringstream ss_windows( config->GetValue( "RollingWindows", "60 600" ) );
+	double window;
+	while( ss_windows >> window )
+		if( window > 0 ) rolling_windows.push_back( window );
+	http_snapshot_period = config->GetValue( "HttpSnapshotPeriod", 2.0 );
+	metrics_history = config->GetValue( "MetricsHistory", 120 );
+	if( metrics_history < 1 ) metrics_history = 1;
 
 	
 	// TAC modules
@@ -137,6 +171,96 @@ void GreatSettings::ReadSettings() {
 	} // i
 
 
+	// Event trigger, needs to know about the detectors first
+	event_trigger = config->GetValue( "EventTrigger", "Free" );
+	trigger_pre_window = config->GetValue( "TriggerPreWindow", 1e3 );
+	trigger_post_window = config->GetValue( "TriggerPostWindow", 3e3 );
+	n_trigger_ch = config->GetValue( "NumberOfTriggerChannels", 0 );
+	if( event_trigger != "Free" && event_trigger != "TAC" &&
+	    event_trigger != "CeBr3" && event_trigger != "HPGe" &&
+	    event_trigger != "Channel" ) {
+
+		std::cerr << "Unknown EventTrigger: " << event_trigger;
+		std::cerr << ", must be Free, TAC, CeBr3, HPGe or Channel. Using Free" << std::endl;
+		event_trigger = "Free";
+
+	}
+
+	trigger_ch.resize( n_caen_mod );
+	for( unsigned int i = 0; i < n_caen_mod; ++i ) {
+
+		trigger_ch[i].resize( n_caen_ch, false );
+
+		for( unsigned int j = 0; j < n_caen_ch; ++j ) {
+
+			if( event_trigger == "TAC" )
+				trigger_ch[i][j] = tac_id[i][j] >= 0;
+			else if( event_trigger == "CeBr3" )
+				trigger_ch[i][j] = cebr3_id[i][j] >= 0;
+			else if( event_trigger == "HPGe" )	// cores only
+				trigger_ch[i][j] = hpge_id[i][j] >= 0 && hpge_seg[i][j] == 0;
+
+		}
+
+	}
+
+	for( unsigned int i = 0; i < n_trigger_ch && event_trigger == "Channel"; ++i ){
+
+		unsigned char mod = config->GetValue( Form( "Trigger_%d.Module", i ), (int)0 );
+		unsigned char ch  = config->GetValue( Form( "Trigger_%d.Channel", i ), (int)0 );
+
+		if( mod < n_caen_mod && ch < n_caen_ch )
+			trigger_ch[mod][ch] = true;
+
+		else {
+
+			std::cerr << "Dodgy trigger settings: module = " << (int)mod;
+			std::cerr << " channel = " << (int)ch << std::endl;
+
+		}
+
+	}
+
+
+	// Window scan, defaults to the main windows
+	n_window_scans = config->GetValue( "NumberOfWindowScans", 0 );
+	flag_scan_trees = config->GetValue( "WindowScanTrees", false );
+	scan_event_window.resize( n_window_scans );
+	scan_cebr3_hit_window.resize( n_window_scans );
+	scan_hpge_hit_window.resize( n_window_scans );
+	for( unsigned int i = 0; i < n_window_scans; ++i ){
+
+		scan_event_window[i] = config->GetValue( Form( "WindowScan_%d.EventWindow", i ), event_window );
+		scan_cebr3_hit_window[i] = config->GetValue( Form( "WindowScan_%d.CeBr3HitWindow", i ), cebr3_hit_window );
+		scan_hpge_hit_window[i] = config->GetValue( Form( "WindowScan_%d.HPGeHitWindow", i ), hpge_hit_window );
+
+	}
+
+
+	// Histogrammer
+	flag_gamma_cube = config->GetValue( "GammaCube", false );
+	gamma_cube_det = config->GetValue( "GammaCubeDetector", "HPGe" );
+	gamma_cube_width = config->GetValue( "GammaCubeBinWidth", 2.0 );
+	gamma_cube_max = config->GetValue( "GammaCubeMaxEnergy", 4000.0 );
+	flag_hist_select = config->GetValue( "HistSelectBranches", false );
+	hist_cache_size = config->GetValue( "HistCacheSize", 30.0 );
+	hist_cache_learn = config->GetValue( "HistCacheLearnEntries", 100 );
+	flag_hist_prefetch = config->GetValue( "HistAsyncPrefetch", false );
+	if( gamma_cube_det != "HPGe" && gamma_cube_det != "CeBr3" ) {
+
+		std::cerr << "Unknown GammaCubeDetector " << gamma_cube_det;
+		std::cerr << ", using HPGe" << std::endl;
+		gamma_cube_det = "HPGe";
+
+	}
+	if( gamma_cube_width <= 0 ) {
+
+		std::cerr << "GammaCubeBinWidth must be positive, using 2 keV" << std::endl;
+		gamma_cube_width = 2.0;
+
+	}
+
+
 	// Finished
 	delete config;
 	
@@ -216,6 +340,16 @@ short GreatSettings::GetHPGeDetector( unsigned char mod, unsigned char ch ) {
 
 }
 
+bool GreatSettings::IsEventTrigger( unsigned char mod, unsigned char ch ) {
+
+	/// Return true if this channel can open an event in the triggered modes
+	if( mod < n_caen_mod && ch < n_caen_ch )
+		return trigger_ch[(int)mod][(int)ch];
+
+	else return false;
+
+}
+
 short GreatSettings::GetHPGeSegment( unsigned char mod, unsigned char ch ) {
 
 	/// Return the segment ID of a HPGe event by module and channel number
@@ -0,0 +1,247 @@
+#include "Spectrum.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is allocated here, the bins are only made on the first fill
+/// \param[in] name The name of the ROOT histogram
+/// \param[in] title The title of the ROOT histogram, including the axis titles
+/// \param[in] nbins The number of bins
+/// \param[in] xmin The lower edge of the first bin
+/// \param[in] xmax The upper edge of the last bin
+/// \param[in] dir The directory for the ROOT histogram, the current directory if nullptr
+GreatSpectrum::GreatSpectrum( std::string name, std::string title,
+							  unsigned int nbins, double xmin, double xmax,
+							  TDirectory *dir ){
+
+	this->name = name;
+	this->title = title;
+	this->nbins = nbins;
+	this->xmin = xmin;
+	this->xmax = xmax;
+	this->dir = dir ? dir : gDirectory;
+
+	// Check if we can index the bins directly with integers
+	first = std::lround( xmin + 0.5 );
+	flag_unit = nbins > 0 && xmax - xmin == (double)nbins &&
+				(double)first - 0.5 == xmin;
+
+	underflow = 0;
+	overflow = 0;
+	entries = 0;
+
+	hist = nullptr;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] bin The bin, starting from 0 and without the underflow
+/// \param[in] n The counts to add
+void GreatSpectrum::AddCount( unsigned int bin, unsigned long long n ){
+
+	if( !n ) return;
+	if( counts.empty() ) counts.resize( nbins, 0 );
+
+	n += counts[bin];
+	counts[bin] = n & 0xffff;
+	if( n >> 16 ) carry[bin] += n >> 16;
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The binning has to be identical, otherwise nothing is added
+/// \param[in] other The spectrum to add to this one
+/// \return false if the binning is different
+bool GreatSpectrum::Add( const GreatSpectrum &other ){
+
+	if( other.nbins != nbins || other.xmin != xmin || other.xmax != xmax ) {
+
+		std::cerr << "Cannot add " << other.name << " to " << name;
+		std::cerr << ", the binning is different" << std::endl;
+		return false;
+
+	}
+
+	for( unsigned int i = 0; i < other.counts.size(); ++i )
+		AddCount( i, other.counts[i] );
+	for( auto it = other.carry.begin(); it != other.carry.end(); ++it )
+		AddCount( it->first, it->second << 16 );
+
+	underflow += other.underflow;
+	overflow += other.overflow;
+	entries += other.entries;
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] other Another GreatSpectrum, e.g. the copy of a worker
+/// \return false if it is not a spectrum or the binning is different
+bool GreatSpectrum::Add( const GreatCompactHist &other ){
+
+	const GreatSpectrum *spec = dynamic_cast<const GreatSpectrum*>( &other );
+	if( !spec ) {
+
+		std::cerr << "Cannot add " << other.GetName() << " to " << name;
+		std::cerr << ", it is not a spectrum" << std::endl;
+		return false;
+
+	}
+
+	return Add( *spec );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return A spectrum with the same name and binning, nothing is allocated yet
+std::unique_ptr<GreatCompactHist> GreatSpectrum::CloneEmpty() const {
+
+	return std::make_unique<GreatSpectrum>( name, title, nbins, xmin, xmax, dir );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return A TH1F in no directory, owned by the caller
+TH1* GreatSpectrum::MakeHist() const {
+
+	TH1F *h = new TH1F( name.data(), title.data(), nbins, xmin, xmax );
+	h->SetDirectory( nullptr );
+	h->Sumw2( false );	// Poisson errors from the counts
+	CopyTo( h );
+
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The statistics are recalculated from the bin contents and the number of
+/// entries is set to the number of fills
+/// \param[in] h A histogram with the same binning, e.g. made by GreatSpectrum::MakeHist
+void GreatSpectrum::CopyTo( TH1 *h ) const {
+
+	if( !h ) return;
+
+	h->Reset( "ICESM" );
+	for( unsigned int i = 0; i < counts.size(); ++i )
+		if( counts[i] ) h->SetBinContent( i+1, counts[i] );
+	for( auto it = carry.begin(); it != carry.end(); ++it )
+		h->SetBinContent( it->first+1, GetCount( it->first ) );
+	h->SetBinContent( 0, underflow );
+	h->SetBinContent( nbins+1, overflow );
+
+	h->ResetStats();
+	h->SetEntries( entries );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used to read back a histogram that was written before, e.g. from a cache
+/// \param[in] dir The directory with the histogram
+/// \return false if it is missing or its binning is different
+bool GreatSpectrum::AddFrom( TDirectory *dir ){
+
+	TH1 *h = dir ? dynamic_cast<TH1*>( dir->Get( name.data() ) ) : nullptr;
+	if( !h ) return false;
+
+	bool success = h->GetDimension() == 1 && (unsigned int)h->GetNbinsX() == nbins &&
+				   h->GetXaxis()->GetXmin() == xmin && h->GetXaxis()->GetXmax() == xmax;
+
+	if( !success ) {
+
+		std::cerr << "Cannot add " << h->GetName() << " from " << dir->GetName();
+		std::cerr << " to " << name << ", the binning is different" << std::endl;
+
+	}
+
+	else {
+
+		for( unsigned int i = 0; i < nbins; ++i )
+			AddCount( i, (unsigned long long)( h->GetBinContent( i+1 ) + 0.5 ) );
+
+		underflow += (unsigned long long)( h->GetBinContent( 0 ) + 0.5 );
+		overflow += (unsigned long long)( h->GetBinContent( nbins+1 ) + 0.5 );
+		entries += (unsigned long long)( h->GetEntries() + 0.5 );
+
+	}
+
+	delete h;
+	return success;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The TH1F only exists while it is written, unless GreatSpectrum::Sync made
+/// one in the directory.
+/// \param[in] dir The directory to write in to
+void GreatSpectrum::Write( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	// The one the web server sees is written with its directory as well
+	if( hist && hist->GetDirectory() == dir ) {
+
+		TDirectory *olddir = gDirectory;
+		dir->cd();
+		CopyTo( hist );
+		hist->Write( hist->GetName(), TObject::kOverwrite );
+		olddir->cd();
+		return;
+
+	}
+
+	GreatCompactHist::Write( dir );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only for the monitor when the web server scans the directories itself, see
+/// GreatHistSnapshot for the other case. The ROOT histogram is made the first
+/// time there are some entries and is then kept in the directory. The
+/// statistics are recalculated from the bin contents and the number of entries
+/// is set to the number of fills.
+/// \return The ROOT histogram, or nullptr if it was never filled
+TH1F* GreatSpectrum::Sync(){
+
+	// Nothing to show yet
+	if( !hist && !entries ) return nullptr;
+
+	// Make the histogram the first time
+	if( !hist ) {
+
+		TDirectory *olddir = gDirectory;
+		dir->cd();
+		hist = new TH1F( name.data(), title.data(), nbins, xmin, xmax );
+		hist->Sumw2( false );	// Poisson errors from the counts
+		hist->SetDirectory( dir );
+		olddir->cd();
+
+	}
+
+	// Copy the counts
+	CopyTo( hist );
+
+	return hist;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The memory for the bins is kept, since a spectrum that was filled once is
+/// likely to be filled again
+void GreatSpectrum::Reset(){
+
+	std::fill( counts.begin(), counts.end(), 0 );
+	carry.clear();
+	underflow = 0;
+	overflow = 0;
+	entries = 0;
+
+	if( hist ) hist->Reset( "ICESM" );
+
+	return;
+
+}
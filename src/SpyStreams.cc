@@ -0,0 +1,168 @@
+#include "SpyStreams.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is opened until GreatSpyStreams::Start
+/// \param[in] myset The settings, for the streams and the reader parameters
+GreatSpyStreams::GreatSpyStreams( std::shared_ptr<GreatSettings> myset ){
+
+	idle_time = myset->GetSpyStreamIdle();
+
+	for( unsigned int s = 0; s < myset->GetNumberOfSpyStreams(); ++s ) {
+
+		ids.push_back( myset->GetSpyStreamID( s ) );
+		readers.push_back( std::make_unique<GreatDataSpyReader>( ids.back(),
+												myset->GetBlockSize(),
+												myset->GetSpyQueueSize(),
+												myset->GetSpyMaxBackoff() ) );
+
+	}
+
+	stream_time.resize( readers.size(), 0 );
+	last_data.resize( readers.size(), std::chrono::steady_clock::now() );
+
+}
+
+GreatSpyStreams::~GreatSpyStreams(){
+
+	Stop();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Every stream counts as active from now, so it holds back the others until
+/// it sends data or becomes idle
+/// \return The number of streams that could be opened
+unsigned int GreatSpyStreams::Start(){
+
+	unsigned int n_started = 0;
+	for( unsigned int s = 0; s < readers.size(); ++s ) {
+
+		if( readers[s]->Start() ) n_started++;
+		else std::cerr << "Cannot open DataSpy stream " << s << " with ID " << ids[s] << std::endl;
+
+	}
+
+	std::lock_guard<std::mutex> lock( state_mutex );
+	for( unsigned int s = 0; s < readers.size(); ++s )
+		last_data[s] = std::chrono::steady_clock::now();
+
+	return n_started;
+
+}
+
+void GreatSpyStreams::Stop(){
+
+	for( unsigned int s = 0; s < readers.size(); ++s )
+		readers[s]->Stop();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] s The stream
+/// \param[in] t The latest hit time of the stream after its last block
+void GreatSpyStreams::Update( unsigned int s, double t ){
+
+	std::lock_guard<std::mutex> lock( state_mutex );
+	stream_time[s] = t;
+	last_data[s] = std::chrono::steady_clock::now();
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] s The stream
+/// \return true if the stream has not sent a block for SpyStreamIdle seconds
+bool GreatSpyStreams::IsIdle( unsigned int s ) const {
+
+	std::lock_guard<std::mutex> lock( state_mutex );
+	auto now = std::chrono::steady_clock::now();
+	return std::chrono::duration<double>( now - last_data[s] ).count() > idle_time;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return The latest hit time of the slowest stream that is not idle, or
+/// DBL_MAX if they are all idle
+double GreatSpyStreams::GetWatermark() const {
+
+	double watermark = DBL_MAX;
+	for( unsigned int s = 0; s < readers.size(); ++s ) {
+
+		if( IsIdle( s ) ) continue;
+
+		std::lock_guard<std::mutex> lock( state_mutex );
+		if( stream_time[s] < watermark ) watermark = stream_time[s];
+
+	}
+
+	return watermark;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] s The stream
+/// \return The difference in ns between the latest hit time of any stream and that of this one
+double GreatSpyStreams::GetLag( unsigned int s ) const {
+
+	std::lock_guard<std::mutex> lock( state_mutex );
+
+	double time_max = 0;
+	for( unsigned int i = 0; i < stream_time.size(); ++i )
+		if( stream_time[i] > time_max ) time_max = stream_time[i];
+
+	return time_max - stream_time[s];
+
+}
+
+unsigned long long GreatSpyStreams::GetBlocksRead() const {
+
+	unsigned long long n = 0;
+	for( unsigned int s = 0; s < readers.size(); ++s )
+		n += readers[s]->GetBlocksRead();
+
+	return n;
+
+}
+
+unsigned long long GreatSpyStreams::GetBytesRead() const {
+
+	unsigned long long n = 0;
+	for( unsigned int s = 0; s < readers.size(); ++s )
+		n += readers[s]->GetBytesRead();
+
+	return n;
+
+}
+
+unsigned long long GreatSpyStreams::GetLostBuffers() const {
+
+	unsigned long long n = 0;
+	for( unsigned int s = 0; s < readers.size(); ++s )
+		n += readers[s]->GetLostBuffers();
+
+	return n;
+
+}
+
+void GreatSpyStreams::PrintCounters(){
+
+	for( unsigned int s = 0; s < readers.size(); ++s ) {
+
+		std::cout << "  DataSpy stream " << s << " (ID " << ids[s] << "):";
+		std::cout << " blocks: " << std::setw(10) << readers[s]->GetBlocksRead();
+		std::cout << " MB: " << std::setw(8) << std::fixed << std::setprecision(1);
+		std::cout << readers[s]->GetBytesRead() / 1024. / 1024.;
+		std::cout << std::defaultfloat;
+		std::cout << " lost: " << readers[s]->GetLostBuffers();
+		std::cout << " lag: " << GetLag( s ) * 1e-6 << " ms";
+		if( IsIdle( s ) ) std::cout << " (idle)";
+		std::cout << std::endl;
+
+	}
+
+	return;
+
+}
@@ -0,0 +1,279 @@
+#include "SymMatrix.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is allocated here apart from the list of blocks
+/// \param[in] name The name of the ROOT histogram
+/// \param[in] title The title of the ROOT histogram, including the axis titles
+/// \param[in] nbins The number of bins along each axis
+/// \param[in] min The lower edge of the first bin
+/// \param[in] max The upper edge of the last bin
+/// \param[in] dir The directory for the ROOT histogram, the current directory if nullptr
+GreatSymMatrix::GreatSymMatrix( std::string name, std::string title,
+								unsigned int nbins, double min, double max,
+								TDirectory *dir ){
+
+	this->name = name;
+	this->title = title;
+	this->nbins = nbins;
+	this->min = min;
+	this->max = max;
+	this->dir = dir ? dir : gDirectory;
+
+	nblocks = ( nbins + kBlockSize - 1 ) / kBlockSize;
+	blocks.resize( nblocks * ( nblocks + 1 ) / 2 );
+
+	entries = 0;
+	outside = 0;
+
+	hist = nullptr;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The binning has to be identical, otherwise nothing is added
+/// \param[in] other The matrix to add to this one
+/// \return false if the binning is different
+bool GreatSymMatrix::Add( const GreatSymMatrix &other ){
+
+	if( other.nbins != nbins || other.min != min || other.max != max ) {
+
+		std::cerr << "Cannot add " << other.name << " to " << name;
+		std::cerr << ", the binning is different" << std::endl;
+		return false;
+
+	}
+
+	for( unsigned int b = 0; b < blocks.size(); ++b ) {
+
+		if( !other.blocks[b] ) continue;
+		if( !blocks[b] ) blocks[b].reset( new unsigned int[kBlockSize*kBlockSize]() );
+
+		for( unsigned int k = 0; k < kBlockSize*kBlockSize; ++k )
+			blocks[b][k] += other.blocks[b][k];
+
+	}
+
+	entries += other.entries;
+	outside += other.outside;
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] other Another GreatSymMatrix, e.g. the copy of a worker
+/// \return false if it is not a matrix or the binning is different
+bool GreatSymMatrix::Add( const GreatCompactHist &other ){
+
+	const GreatSymMatrix *mat = dynamic_cast<const GreatSymMatrix*>( &other );
+	if( !mat ) {
+
+		std::cerr << "Cannot add " << other.GetName() << " to " << name;
+		std::cerr << ", it is not a symmetric matrix" << std::endl;
+		return false;
+
+	}
+
+	return Add( *mat );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return A matrix with the same name and binning, no blocks are allocated yet
+std::unique_ptr<GreatCompactHist> GreatSymMatrix::CloneEmpty() const {
+
+	return std::make_unique<GreatSymMatrix>( name, title, nbins, min, max, dir );
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return A TH2F in no directory, owned by the caller
+TH1* GreatSymMatrix::MakeHist() const {
+
+	TH2F *h = new TH2F( name.data(), title.data(), nbins, min, max, nbins, min, max );
+	h->SetDirectory( nullptr );
+	h->Sumw2( false );	// Poisson errors from the counts
+	CopyTo( h );
+
+	return h;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Each cell of the lower triangle goes in to both (x,y) and (y,x) of the
+/// TH2F, and the diagonal gets twice the counts, which is the same as the
+/// symmetric filling of the full matrix.
+/// \param[in] h A histogram with the same binning, e.g. made by GreatSymMatrix::MakeHist
+void GreatSymMatrix::CopyTo( TH1 *h ) const {
+
+	if( !h ) return;
+
+	// Expand the allocated blocks
+	h->Reset( "ICESM" );
+	for( unsigned int bi = 0; bi < nblocks; ++bi ) {
+
+		for( unsigned int bj = 0; bj <= bi; ++bj ) {
+
+			const std::unique_ptr<unsigned int[]> &blk = blocks[ bi*(bi+1)/2 + bj ];
+			if( !blk ) continue;
+
+			for( unsigned int k = 0; k < kBlockSize*kBlockSize; ++k ) {
+
+				if( !blk[k] ) continue;
+
+				unsigned int i = bi * kBlockSize + k / kBlockSize;
+				unsigned int j = bj * kBlockSize + k % kBlockSize;
+
+				if( i == j ) h->SetBinContent( i+1, j+1, 2.0 * blk[k] );
+				else {
+
+					h->SetBinContent( i+1, j+1, blk[k] );
+					h->SetBinContent( j+1, i+1, blk[k] );
+
+				}
+
+			}
+
+		}
+
+	}
+
+	h->ResetStats();
+	h->SetEntries( 2.0 * entries );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used to read back a matrix that was written before, e.g. from a cache. Only
+/// the lower triangle is read, the diagonal has twice the counts.
+/// \param[in] dir The directory with the histogram
+/// \return false if it is missing or its binning is different
+bool GreatSymMatrix::AddFrom( TDirectory *dir ){
+
+	TH1 *h = dir ? dynamic_cast<TH1*>( dir->Get( name.data() ) ) : nullptr;
+	if( !h ) return false;
+
+	bool success = h->GetDimension() == 2 &&
+				   (unsigned int)h->GetNbinsX() == nbins && (unsigned int)h->GetNbinsY() == nbins &&
+				   h->GetXaxis()->GetXmin() == min && h->GetXaxis()->GetXmax() == max &&
+				   h->GetYaxis()->GetXmin() == min && h->GetYaxis()->GetXmax() == max;
+
+	if( !success ) {
+
+		std::cerr << "Cannot add " << h->GetName() << " from " << dir->GetName();
+		std::cerr << " to " << name << ", the binning is different" << std::endl;
+
+	}
+
+	else {
+
+		for( unsigned int i = 0; i < nbins; ++i ) {
+
+			for( unsigned int j = 0; j <= i; ++j ) {
+
+				double n = h->GetBinContent( i+1, j+1 );
+				if( i == j ) n *= 0.5;
+				if( n < 0.5 ) continue;
+
+				std::unique_ptr<unsigned int[]> &blk = blocks[ (i/kBlockSize)*(i/kBlockSize+1)/2 + j/kBlockSize ];
+				if( !blk ) blk.reset( new unsigned int[kBlockSize*kBlockSize]() );
+				blk[ (i%kBlockSize)*kBlockSize + (j%kBlockSize) ] += (unsigned int)( n + 0.5 );
+
+			}
+
+		}
+
+		entries += (unsigned long long)( 0.5 * h->GetEntries() + 0.5 );
+
+	}
+
+	delete h;
+	return success;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The TH2F only exists while it is written, unless GreatSymMatrix::Sync made
+/// one in the directory.
+/// \param[in] dir The directory to write in to
+void GreatSymMatrix::Write( TDirectory *dir ){
+
+	if( !dir ) return;
+
+	// The one the web server sees is written with its directory as well
+	if( hist && hist->GetDirectory() == dir ) {
+
+		TDirectory *olddir = gDirectory;
+		dir->cd();
+		CopyTo( hist );
+		hist->Write( hist->GetName(), TObject::kOverwrite );
+		olddir->cd();
+		return;
+
+	}
+
+	GreatCompactHist::Write( dir );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Only for the monitor when the web server scans the directories itself, see
+/// GreatHistSnapshot for the other case. The ROOT histogram stays in its
+/// directory and is written with it.
+/// \return The ROOT histogram, or nullptr if it was never filled
+TH2F* GreatSymMatrix::Sync(){
+
+	// Nothing to show yet
+	if( !hist && !entries ) return nullptr;
+
+	// Make the histogram the first time
+	if( !hist ) {
+
+		TDirectory *olddir = gDirectory;
+		dir->cd();
+		hist = new TH2F( name.data(), title.data(), nbins, min, max, nbins, min, max );
+		hist->Sumw2( false );	// Poisson errors from the counts
+		hist->SetDirectory( dir );
+		olddir->cd();
+
+	}
+
+	// Expand the allocated blocks
+	CopyTo( hist );
+
+	return hist;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// The allocated blocks are only set to zero, they are never released while
+/// the matrix exists, so a block that is being filled never goes away
+void GreatSymMatrix::Reset(){
+
+	for( unsigned int b = 0; b < blocks.size(); ++b )
+		if( blocks[b] ) std::fill( blocks[b].get(), blocks[b].get() + kBlockSize*kBlockSize, 0u );
+
+	entries = 0;
+	outside = 0;
+
+	if( hist ) hist->Reset( "ICESM" );
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return The number of blocks that have been allocated, each of kBlockSize^2 counts
+unsigned int GreatSymMatrix::GetNumberOfBlocks() const {
+
+	unsigned int n = 0;
+	for( unsigned int b = 0; b < blocks.size(); ++b )
+		if( blocks[b] ) n++;
+
+	return n;
+
+}
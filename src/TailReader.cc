@@ -0,0 +1,146 @@
+#include "TailReader.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Nothing is opened until the first read
+/// \param[in] filename The run file to follow
+/// \param[in] block_size The size of each block in bytes
+GreatTailReader::GreatTailReader( std::string filename, unsigned int block_size ){
+
+	this->filename = filename;
+	this->block_size = block_size;
+	block.resize( block_size );
+
+	fd = -1;
+	notify_fd = -1;
+	watch = -1;
+	offset = 0;
+	n_blocks = 0;
+
+}
+
+GreatTailReader::~GreatTailReader(){
+
+	Close();
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \return false if the file cannot be opened, watching is optional
+bool GreatTailReader::Open(){
+
+	if( fd >= 0 ) return true;
+
+	fd = open( filename.data(), O_RDONLY );
+	if( fd < 0 ) {
+
+		std::cout << "Cannot open " << filename << std::endl;
+		return false;
+
+	}
+
+#ifdef LINUX
+
+	notify_fd = inotify_init1( IN_NONBLOCK );
+	if( notify_fd >= 0 )
+		watch = inotify_add_watch( notify_fd, filename.data(), IN_MODIFY | IN_CLOSE_WRITE );
+	if( watch < 0 )
+		std::cout << "Cannot watch " << filename << ", checking it after every wait instead" << std::endl;
+
+#endif
+
+	return true;
+
+}
+
+void GreatTailReader::Close(){
+
+#ifdef LINUX
+
+	if( watch >= 0 ) inotify_rm_watch( notify_fd, watch );
+	if( notify_fd >= 0 ) close( notify_fd );
+
+#endif
+
+	watch = -1;
+	notify_fd = -1;
+
+	if( fd >= 0 ) close( fd );
+	fd = -1;
+
+	return;
+
+}
+
+void GreatTailReader::CheckTruncated(){
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 || st.st_size >= offset ) return;
+
+	std::cout << filename << " got shorter, reading it again from the start" << std::endl;
+	offset = 0;
+	n_blocks = 0;
+
+	return;
+
+}
+
+bool GreatTailReader::HasBlock(){
+
+	if( fd < 0 ) return false;
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 ) return false;
+
+	return st.st_size < offset || st.st_size - offset >= (off_t)block_size;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Always waits for the minimum time, so that a busy DAQ does not keep the
+/// monitor spinning, and then returns as soon as a complete block is there
+/// \param[in] min_wait Minimum time to wait in s
+/// \param[in] max_wait Maximum time to wait in s
+/// \return true if a new complete block is waiting
+bool GreatTailReader::Wait( double min_wait, double max_wait ){
+
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+							std::chrono::duration<double>( std::max( min_wait, max_wait ) ) );
+
+	std::this_thread::sleep_for( std::chrono::duration<double>( min_wait ) );
+
+	while( !HasBlock() ) {
+
+		auto now = std::chrono::steady_clock::now();
+		if( now >= deadline ) return false;
+		long remaining = std::chrono::duration_cast<std::chrono::milliseconds>( deadline - now ).count();
+
+#ifdef LINUX
+
+		// Sleep until the file is written to, then empty the events
+		if( watch >= 0 ) {
+
+			struct pollfd pfd;
+			pfd.fd = notify_fd;
+			pfd.events = POLLIN;
+			pfd.revents = 0;
+			if( poll( &pfd, 1, (int)remaining ) > 0 ) {
+
+				char events[4096];
+				while( read( notify_fd, events, sizeof(events) ) > 0 ) {}
+
+			}
+			continue;
+
+		}
+
+#endif
+
+		// No inotify, check again once in a while
+		std::this_thread::sleep_for( std::chrono::milliseconds( std::min( remaining, 200L ) ) );
+
+	}
+
+	return true;
+
+}
@@ -0,0 +1,268 @@
+#include "UserHists.hh"
+
+////////////////////////////////////////////////////////////////////////////////
+/// Definitions with an unknown type or detector are skipped with a warning
+/// \param[in] filename The histogram definition file, in TEnv format
+GreatUserHists::GreatUserHists( std::string filename ) {
+
+	fInputFile = filename;
+	TEnv *config = new TEnv( fInputFile.data() );
+
+	unsigned int n_hists = config->GetValue( "NumberOfHistograms", 0 );
+	for( unsigned int i = 0; i < n_hists; ++i ) {
+
+		kernel_t k;
+		std::string prefix = "Hist_" + std::to_string(i) + ".";
+
+		k.name = config->GetValue( ( prefix + "Name" ).data(), Form( "user_hist_%d", i ) );
+		k.title = config->GetValue( ( prefix + "Title" ).data(), k.name.data() );
+
+		std::string type = config->GetValue( ( prefix + "Type" ).data(), "Energy" );
+		std::string det1 = config->GetValue( ( prefix + "Detector" ).data(), "CeBr3" );
+		std::string det2 = config->GetValue( ( prefix + "Detector2" ).data(), det1.data() );
+		if( !ReadType( type, k.type ) || !ReadDetector( det1, k.det1 ) || !ReadDetector( det2, k.det2 ) ) {
+
+			std::cerr << "Skipping user histogram " << k.name << std::endl;
+			continue;
+
+		}
+
+		k.id1 = config->GetValue( ( prefix + "ID" ).data(), -1 );
+		k.id2 = config->GetValue( ( prefix + "ID2" ).data(), -1 );
+		k.emin1 = config->GetValue( ( prefix + "EnergyMin" ).data(), -1e12 );
+		k.emax1 = config->GetValue( ( prefix + "EnergyMax" ).data(), 1e12 );
+		k.emin2 = config->GetValue( ( prefix + "Energy2Min" ).data(), -1e12 );
+		k.emax2 = config->GetValue( ( prefix + "Energy2Max" ).data(), 1e12 );
+		k.tmin = config->GetValue( ( prefix + "TimeDiffMin" ).data(), -1e12 );
+		k.tmax = config->GetValue( ( prefix + "TimeDiffMax" ).data(), 1e12 );
+
+		// Read as signed, so that a negative number is not taken as a huge one
+		int nbins = config->GetValue( ( prefix + "NBins" ).data(), 4096 );
+		int nbinsy = config->GetValue( ( prefix + "NBinsY" ).data(), nbins );
+		k.min = config->GetValue( ( prefix + "Min" ).data(), 0.0 );
+		k.max = config->GetValue( ( prefix + "Max" ).data(), 4096.0 );
+		k.miny = config->GetValue( ( prefix + "MinY" ).data(), k.min );
+		k.maxy = config->GetValue( ( prefix + "MaxY" ).data(), k.max );
+
+		if( nbins <= 0 || nbinsy <= 0 ) {
+
+			std::cerr << "NBins of user histogram " << k.name << " must be positive, got ";
+			std::cerr << nbins << " and " << nbinsy << " for NBinsY, skipping" << std::endl;
+			continue;
+
+		}
+
+		k.nbins = nbins;
+		k.nbinsy = nbinsy;
+		if( k.max <= k.min || k.maxy <= k.miny ) {
+
+			std::cerr << "Bad binning for user histogram " << k.name << ", skipping" << std::endl;
+			continue;
+
+		}
+
+		k.idx = 0;
+		kernels.push_back( k );
+
+	}
+
+	delete config;
+
+	std::cout << "User histograms: " << kernels.size() << " from " << fInputFile << std::endl;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] name CeBr3, HPGe or TAC
+/// \param[out] det The detector type
+/// \return false if the name is unknown
+bool GreatUserHists::ReadDetector( std::string name, det_t &det ){
+
+	if( name == "CeBr3" ) det = kCeBr3;
+	else if( name == "HPGe" ) det = kHPGe;
+	else if( name == "TAC" ) det = kTAC;
+	else {
+
+		std::cerr << "Unknown detector type in user histograms: " << name << std::endl;
+		return false;
+
+	}
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] name Energy, Multiplicity, TimeDiff, EnergyEnergy or EnergyTimeDiff
+/// \param[out] type The kernel type
+/// \return false if the name is unknown
+bool GreatUserHists::ReadType( std::string name, kernel_type_t &type ){
+
+	if( name == "Energy" ) type = kEnergy;
+	else if( name == "Multiplicity" ) type = kMultiplicity;
+	else if( name == "TimeDiff" ) type = kTimeDiff;
+	else if( name == "EnergyEnergy" ) type = kEnergyEnergy;
+	else if( name == "EnergyTimeDiff" ) type = kEnergyTimeDiff;
+	else {
+
+		std::cerr << "Unknown histogram type in user histograms: " << name << std::endl;
+		return false;
+
+	}
+
+	return true;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Each kernel remembers where its histogram is in the set, which is the same
+/// position in every clone of the set
+/// \param[in] hs The set of the histogrammer
+void GreatUserHists::Book( GreatHistogramSet &hs ){
+
+	std::string dirname = "UserHists";
+	hs.MakeDirectory( dirname );
+
+	for( unsigned int i = 0; i < kernels.size(); ++i ) {
+
+		kernel_t &k = kernels[i];
+		k.idx = hs.GetSize();
+
+		if( k.type == kEnergyEnergy || k.type == kEnergyTimeDiff ) {
+
+			hs.Book( new TH2F( k.name.data(), k.title.data(),
+							  k.nbins, k.min, k.max, k.nbinsy, k.miny, k.maxy ), dirname );
+
+		}
+		else {
+
+			hs.Book( new TH1F( k.name.data(), k.title.data(),
+							  k.nbins, k.min, k.max ), dirname );
+
+		}
+
+	}
+
+	return;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// \param[in] hs The set of the histogrammer, or a clone of it
+/// \return The histogram of each kernel, in the same order
+std::vector<TH1*> GreatUserHists::GetHists( const GreatHistogramSet &hs ) const {
+
+	std::vector<TH1*> hists( kernels.size() );
+	for( unsigned int i = 0; i < kernels.size(); ++i )
+		hists[i] = hs.GetHist( kernels[i].idx );
+
+	return hists;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Used to switch off the branches of the input that no kernel needs
+/// \param[in] det The detector type
+/// \return A combination of the read_t bits
+unsigned int GreatUserHists::GetReadMask( det_t det ) const {
+
+	unsigned int mask = 0;
+	for( unsigned int i = 0; i < kernels.size(); ++i ) {
+
+		const kernel_t &k = kernels[i];
+		bool pairs = k.type != kEnergy && k.type != kMultiplicity;
+
+		// The energy gate is always checked
+		if( k.det1 == det ) {
+
+			mask |= kReadEnergy;
+			if( k.id1 >= 0 ) mask |= kReadID;
+			if( pairs ) mask |= kReadTime;
+
+		}
+
+		if( pairs && k.det2 == det ) {
+
+			mask |= kReadEnergy | kReadTime;
+			if( k.id2 >= 0 ) mask |= kReadID;
+
+		}
+
+	}
+
+	return mask;
+
+}
+
+////////////////////////////////////////////////////////////////////////////////
+/// Does not change anything in this class, so it can run in many threads as
+/// long as each one has its own histograms and scratch lists
+/// \param[in] evts The event
+/// \param[in] hists The histograms from GreatUserHists::GetHists
+/// \param[in] scratch Lists of hits reused from one event to the next
+void GreatUserHists::Fill( const GreatEvts &evts, const std::vector<TH1*> &hists, scratch_t &scratch ) const {
+
+	if( kernels.empty() ) return;
+
+	// Collect the hits once for all kernels
+	for( unsigned int d = 0; d < kNumberOfDetectors; ++d )
+		scratch.hits[d].clear();
+	for( const GreatCeBr3Evt &h : evts.GetCeBr3Evts() )
+		scratch.hits[kCeBr3].push_back( &h );
+	for( const GreatHPGeEvt &h : evts.GetHPGeEvts() )
+		scratch.hits[kHPGe].push_back( &h );
+	for( const GreatTACEvt &h : evts.GetTACEvts() )
+		scratch.hits[kTAC].push_back( &h );
+
+	// Run the kernels
+	for( unsigned int i = 0; i < kernels.size(); ++i ) {
+
+		const kernel_t &k = kernels[i];
+		const std::vector<const GreatDetectorEvt*> &list1 = scratch.hits[k.det1];
+		const std::vector<const GreatDetectorEvt*> &list2 = scratch.hits[k.det2];
+
+		// Single hits
+		if( k.type == kEnergy || k.type == kMultiplicity ) {
+
+			unsigned int mult = 0;
+			for( const GreatDetectorEvt *a : list1 ) {
+
+				if( !Pass( a, k.id1, k.emin1, k.emax1 ) ) continue;
+				if( k.type == kEnergy ) hists[i]->Fill( a->GetEnergy() );
+				mult++;
+
+			}
+
+			if( k.type == kMultiplicity ) hists[i]->Fill( mult );
+			continue;
+
+		}
+
+		// Pairs, both orders for the same detector type but never a hit with itself
+		for( const GreatDetectorEvt *a : list1 ) {
+
+			if( !Pass( a, k.id1, k.emin1, k.emax1 ) ) continue;
+
+			for( const GreatDetectorEvt *b : list2 ) {
+
+				if( a == b || !Pass( b, k.id2, k.emin2, k.emax2 ) ) continue;
+
+				double tdiff = b->GetTime() - a->GetTime();
+				if( tdiff < k.tmin || tdiff > k.tmax ) continue;
+
+				if( k.type == kTimeDiff )
+					hists[i]->Fill( tdiff );
+				else if( k.type == kEnergyEnergy )
+					( (TH2*)hists[i] )->Fill( a->GetEnergy(), b->GetEnergy() );
+				else
+					( (TH2*)hists[i] )->Fill( a->GetEnergy(), tdiff );
+
+			}
+
+		}
+
+	}
+
+	return;
+
+}